@@ -0,0 +1,274 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "esp_extconn.h"
+#include "esp_sip.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "ext_default.h"
+#include "ext_sdio_adapter.h"
+#include "sdio_host_reg.h"
+#include "sip2_common.h"
+#include "host_stack.h"
+#include "sdio_slave_sim.h"
+#include "test_utils.h"
+
+/*
+ * Transport benchmarks against the simulated slave, one per process like the tests:
+ * bench_transport <name>. Bus time is what the model accounts for the commands issued,
+ * at the clock the adapter set and an assumed cost per command. CPU time is that of the
+ * whole process, the simulated slave copying the data included, the same for every path.
+ */
+
+/* The SDMMC driver and the command round trip, per transaction, on the P4 */
+#define BENCH_CMD_NS        (10 * 1000)
+#define BENCH_CLK_KHZ       (40 * 1000)
+#define BENCH_WAIT_MS       (30 * 1000)
+#define BENCH_FW_ADDR       (0x40100000)
+
+#define BENCH_TX_FRAMES     (2000)
+#define BENCH_TX_LEN        (1500)
+#define BENCH_TX_BUF_SIZE   (1600)
+
+#define BENCH_FW_LEN        (64 * 1024)
+
+static sdio_slave_sim_t s_sim;
+
+static int64_t cpu_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* The firmware takes every packet at once, the slave never runs out of buffers */
+static bool target_take_all(sdio_slave_sim_t *sim, const uint8_t *pkt, size_t len, void *arg)
+{
+    return true;
+}
+
+/* Bus up and SIP state reset, where the boot path downloads */
+static int start_bus(void)
+{
+    sdio_slave_sim_reset(&s_sim);
+    s_sim.cmd_ns = BENCH_CMD_NS;
+    s_sim.clk_khz = BENCH_CLK_KHZ;
+    TEST_ASSERT_EQ(ESP_OK, esp_extconn_sdio_init_ops(&sdio_slave_sim_ops, &s_sim, false));
+    TEST_ASSERT_EQ(ESP_OK, esp_sip_init());
+    return 0;
+}
+
+static int start(void)
+{
+    esp_extconn_config_t config = ESP_EXTCONN_CONFIG_DEFAULT();
+
+    TEST_ASSERT(start_bus() == 0);
+    TEST_ASSERT_EQ(ESP_OK, esp_extconn_trans_recv_init(&config));
+    TEST_ASSERT_EQ(ESP_OK, esp_extconn_trans_wifi_init(&config));
+    TEST_ASSERT_EQ(ESP_OK, esp_sip_bootup(BENCH_FW_ADDR));
+    s_sim.target = target_take_all;
+    return 0;
+}
+
+/* Send BENCH_TX_FRAMES frames at offset into buffers of size, as the Wi-Fi stack would */
+static int bench_wifi_tx_path(const char *name, size_t offset, size_t size)
+{
+    static esf_buf_t *ebs[BENCH_TX_FRAMES];
+
+    for (int i = 0; i < BENCH_TX_FRAMES; i++) {
+        ebs[i] = host_stack_tx_alloc(offset, BENCH_TX_LEN, size);
+        TEST_ASSERT(ebs[i] != NULL);
+        memset((void *)ebs[i]->u_data_start, i, BENCH_TX_LEN);
+    }
+
+    uint32_t done = host_stack.tx_done;
+    uint32_t cmd53 = s_sim.cmd53;
+    uint32_t bounces = s_sim.data_bounces;
+    uint64_t bus_ns = s_sim.bus_ns;
+    int64_t cpu = cpu_ns();
+    int64_t wall = esp_timer_get_time();
+
+    for (int i = 0; i < BENCH_TX_FRAMES; i++) {
+        TEST_ASSERT_EQ(ESP_OK, host_stack.tx_data(ebs[i]));
+    }
+    TEST_ASSERT(host_stack_wait(&host_stack.tx_done, done + BENCH_TX_FRAMES, BENCH_WAIT_MS));
+
+    wall = esp_timer_get_time() - wall;
+    cpu = cpu_ns() - cpu;
+    printf("%-10s %7.0f ns cpu %7.2f us wall %5.2f cmd53 %5.2f bounced %6.1f us bus\n", name,
+           (double)cpu / BENCH_TX_FRAMES, (double)wall / BENCH_TX_FRAMES,
+           (double)(s_sim.cmd53 - cmd53) / BENCH_TX_FRAMES,
+           (double)(s_sim.data_bounces - bounces) / BENCH_TX_FRAMES,
+           (double)(s_sim.bus_ns - bus_ns) / 1000 / BENCH_TX_FRAMES);
+
+    for (int i = 0; i < BENCH_TX_FRAMES; i++) {
+        host_stack_tx_free(ebs[i]);
+    }
+    return 0;
+}
+
+/* Per frame cost of the Wi-Fi send task, copy path against the payload sent in place */
+static int bench_wifi_tx(void)
+{
+    TEST_ASSERT(start() == 0);
+
+    printf("%d frames of %d bytes\n", BENCH_TX_FRAMES, BENCH_TX_LEN);
+    /* No room to pad the tail in the buffer, so the frame is copied */
+    TEST_ASSERT(bench_wifi_tx_path("copy", 0, BENCH_TX_LEN) == 0);
+    TEST_ASSERT(bench_wifi_tx_path("zero copy", 0, BENCH_TX_BUF_SIZE) == 0);
+    TEST_ASSERT(bench_wifi_tx_path("zc framed", SIP_CTRL_HDR_LEN, BENCH_TX_BUF_SIZE) == 0);
+    return 0;
+}
+
+/* Firmware download of a BENCH_FW_LEN image, in the mode the build selects */
+static int bench_fw_download(void)
+{
+    static uint8_t image[BENCH_FW_LEN];
+
+    TEST_ASSERT(start_bus() == 0);
+    s_sim.target = target_take_all;
+#ifdef CONFIG_ESP_EXT_CONN_FW_DL_BLOCK_MODE
+    printf("%d bytes, block mode, frames of %d bytes\n", BENCH_FW_LEN, CONFIG_ESP_EXT_CONN_FW_DL_BUF_SIZE);
+#else
+    printf("%d bytes, byte mode, frames of %d bytes\n", BENCH_FW_LEN, SIP_BOOT_BUF_SIZE);
+#endif
+    memset(image, 0x5a, sizeof(image));
+
+    uint32_t cmd52 = s_sim.cmd52;
+    uint32_t cmd53 = s_sim.cmd53;
+    uint64_t bus_ns = s_sim.bus_ns;
+    int64_t cpu = cpu_ns();
+    int64_t wall = esp_timer_get_time();
+
+    TEST_ASSERT_EQ(ESP_OK, esp_sip_write_mem(BENCH_FW_ADDR, image, sizeof(image)));
+    TEST_ASSERT_EQ(ESP_OK, esp_sip_write_flush());
+
+    wall = esp_timer_get_time() - wall;
+    cpu = cpu_ns() - cpu;
+    uint32_t frames = esp_sip_increase_txseq();
+    printf("%" PRIu32 " frames, %" PRIu32 " cmd52 %" PRIu32 " cmd53, %.2f ms bus, %.2f ms wall, %.2f ms cpu\n",
+           frames, s_sim.cmd52 - cmd52, s_sim.cmd53 - cmd53, (double)(s_sim.bus_ns - bus_ns) / 1000000,
+           (double)wall / 1000, (double)cpu / 1000000);
+    return 0;
+}
+
+/* Pre-framed image as gen_fw_frames.py writes it, frame_size bytes at most per frame */
+static size_t build_frames(uint8_t *out, size_t len, size_t frame_size)
+{
+    size_t hdrs = SIP_CTRL_HDR_LEN + sizeof(struct sip_cmd_write_memory);
+    size_t n = 0;
+    uint32_t seq = 0;
+
+    for (size_t off = 0; off < len; seq++) {
+        size_t chunk = len - off < frame_size - hdrs ? len - off : frame_size - hdrs;
+        struct sip_hdr hdr = { 0 };
+        struct sip_cmd_write_memory cmd = { .addr = BENCH_FW_ADDR + off, .len = chunk };
+
+        SIP_HDR_SET_TYPE(hdr.fc[0], SIP_CTRL);
+        hdr.c_cmdid = SIP_CMD_WRITE_MEMORY;
+        hdr.len = hdrs + chunk;
+        hdr.seq = seq;
+        memcpy(out + n, &hdr, sizeof(hdr));
+        memcpy(out + n + SIP_CTRL_HDR_LEN, &cmd, sizeof(cmd));
+        memset(out + n + hdrs, (uint8_t)seq, chunk);
+        n += (hdrs + chunk + 3) & ~3;
+        off += chunk;
+    }
+    return n;
+}
+
+static void print_dl(const char *name, uint32_t frames, int64_t cpu, int64_t wall, uint32_t cmd53,
+                     uint32_t bounces, uint64_t bus_ns)
+{
+    printf("%-10s %4" PRIu32 " frames %7.2f ms cpu %7.2f ms wall %5.2f cmd53 %5.2f bounced %6.1f us bus per frame\n",
+           name, frames, (double)cpu / 1000000, (double)wall / 1000, (double)cmd53 / frames,
+           (double)bounces / frames, (double)bus_ns / 1000 / frames);
+}
+
+/*
+ * Pre-framed download, frames sent straight from the image as before, each one through the
+ * adapter bounce buffer, against frames staged into the download pipeline by esp_sip_write_frames.
+ */
+static int bench_fw_frames(void)
+{
+    static uint8_t image[BENCH_FW_LEN * 2];
+    /* Off every cache line, as an array in flash would be */
+    uint8_t *rodata = image + 4;
+    size_t len = build_frames(rodata, BENCH_FW_LEN, SIP_BOOT_BUF_SIZE);
+    uint32_t frames = 0;
+
+    TEST_ASSERT(start_bus() == 0);
+    s_sim.target = target_take_all;
+    printf("%d bytes in frames of %d bytes\n", BENCH_FW_LEN, SIP_BOOT_BUF_SIZE);
+
+    uint32_t cmd53 = s_sim.cmd53;
+    uint32_t bounces = s_sim.data_bounces;
+    uint64_t bus_ns = s_sim.bus_ns;
+    int64_t cpu = cpu_ns();
+    int64_t wall = esp_timer_get_time();
+
+    /* What esp_sip_write_frames did before staging, byte mode pacing included */
+    for (size_t off = 0; off < len; frames++) {
+        struct sip_hdr hdr;
+        memcpy(&hdr, rodata + off, sizeof(hdr));
+        size_t padded = (hdr.len + 3) & ~3;
+
+        vTaskDelay(pdMS_TO_TICKS(1));
+        esp_extconn_sdio_lock();
+        TEST_ASSERT_EQ(ESP_OK, esp_extconn_sdio_write_bytes(1, ESP_SLAVE_CMD53_END_ADDR - hdr.len, rodata + off, padded));
+        esp_extconn_sdio_unlock();
+        off += padded;
+    }
+    print_dl("direct", frames, cpu_ns() - cpu, esp_timer_get_time() - wall, s_sim.cmd53 - cmd53,
+             s_sim.data_bounces - bounces, s_sim.bus_ns - bus_ns);
+
+    cmd53 = s_sim.cmd53;
+    bounces = s_sim.data_bounces;
+    bus_ns = s_sim.bus_ns;
+    cpu = cpu_ns();
+    wall = esp_timer_get_time();
+    TEST_ASSERT_EQ(ESP_OK, esp_sip_write_frames(rodata, len));
+    TEST_ASSERT_EQ(ESP_OK, esp_sip_write_flush());
+    print_dl("staged", frames, cpu_ns() - cpu, esp_timer_get_time() - wall, s_sim.cmd53 - cmd53,
+             s_sim.data_bounces - bounces, s_sim.bus_ns - bus_ns);
+    return 0;
+}
+
+static const struct {
+    const char *name;
+    int (*fn)(void);
+} s_benches[] = {
+    { "wifi_tx", bench_wifi_tx },
+    { "fw_download", bench_fw_download },
+    { "fw_frames", bench_fw_frames },
+};
+
+int main(int argc, char **argv)
+{
+    size_t n = sizeof(s_benches) / sizeof(s_benches[0]);
+
+    if (argc != 2) {
+        for (size_t i = 0; i < n; i++) {
+            printf("%s\n", s_benches[i].name);
+        }
+        return argc == 1 ? 0 : 1;
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (strcmp(argv[1], s_benches[i].name) == 0) {
+            return s_benches[i].fn();
+        }
+    }
+    fprintf(stderr, "no benchmark %s\n", argv[1]);
+    return 1;
+}
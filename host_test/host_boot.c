@@ -0,0 +1,62 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "esp_err.h"
+
+#include "esp_extconn.h"
+#include "esp_sip.h"
+#include "ext_default.h"
+#include "ext_sdio_adapter.h"
+#include "host_boot.h"
+
+host_boot_t host_boot;
+
+esp_err_t esp_extconn_boot(void)
+{
+    esp_err_t ret = esp_extconn_sdio_init_ops(&sdio_slave_sim_ops, host_boot.sim, false);
+
+    esp_extconn_boot_mark(ESP_EXTCONN_BOOT_SDIO_START);
+    return ret;
+}
+
+static esp_err_t host_boot_load(void)
+{
+    esp_err_t ret = esp_sip_init();
+
+    if (ret == ESP_OK) {
+        ret = esp_sip_write_mem(host_boot.entry_addr, host_boot.image, host_boot.image_len);
+        esp_err_t flush = esp_sip_write_flush();
+        ret = ret == ESP_OK ? flush : ret;
+        esp_extconn_boot_mark(ESP_EXTCONN_BOOT_FW_DOWNLOAD);
+    }
+    return ret;
+}
+
+esp_err_t esp_extconn_fw_init(esp_extconn_config_t *config)
+{
+    esp_err_t ret = host_boot_load();
+
+    if (ret == ESP_OK) {
+        ret = esp_extconn_trans_recv_init(config);
+    }
+    if (ret == ESP_OK) {
+        ret = esp_sip_bootup(host_boot.entry_addr);
+    }
+    return ret;
+}
+
+esp_err_t esp_extconn_fw_recover(void)
+{
+    host_boot.recovers++;
+    if (host_boot.target_reset) {
+        host_boot.target_reset(host_boot.sim);
+    }
+
+    esp_err_t ret = host_boot_load();
+    if (ret == ESP_OK) {
+        ret = esp_sip_bootup(host_boot.entry_addr);
+    }
+    return ret;
+}
@@ -0,0 +1,37 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef __HOST_BOOT_H__
+#define __HOST_BOOT_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sdio_slave_sim.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Boot path of ext_boot.c for builds with extconn.c, against the simulated slave: the bus
+ * is brought up on sim, there are no pins or card, and the firmware is the image below.
+ */
+typedef struct {
+    sdio_slave_sim_t *sim;
+    const uint8_t *image;
+    size_t image_len;
+    uint32_t entry_addr;
+    void (*target_reset)(sdio_slave_sim_t *sim); /* The reset pulse of a recovery */
+    uint32_t recovers;                           /* Recoveries started */
+} host_boot_t;
+
+extern host_boot_t host_boot;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __HOST_BOOT_H__ */
@@ -0,0 +1,172 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_bluedroid_hci.h"
+#include "esp_timer.h"
+#include "ext_default.h"
+#include "ext_sdio_adapter.h"
+#include "host_stack.h"
+
+/* A TX buffer and what hangs off it, freed together */
+typedef struct {
+    esf_buf_t eb;
+    lldesc_t ds;
+    esf_tx_desc_t desc;
+} host_stack_tx_t;
+
+host_stack_t host_stack;
+
+bool host_stack_wait(const uint32_t *counter, uint32_t n, uint32_t wait_ms)
+{
+    int64_t deadline = esp_timer_get_time() + (int64_t)wait_ms * 1000;
+
+    while (__atomic_load_n(counter, __ATOMIC_ACQUIRE) < n) {
+        if (esp_timer_get_time() >= deadline) {
+            return false;
+        }
+        vTaskDelay(1);
+    }
+    return true;
+}
+
+esf_buf_t *host_stack_tx_alloc(size_t offset, size_t len, size_t size)
+{
+    host_stack_tx_t *tx = calloc(1, sizeof(*tx));
+
+    if (tx == NULL) {
+        return NULL;
+    }
+    tx->eb.buf_begin = esp_extconn_sdio_dma_alloc(offset + size, NULL);
+    if (tx->eb.buf_begin == NULL) {
+        free(tx);
+        return NULL;
+    }
+    tx->ds.buf = tx->eb.buf_begin + offset;
+    tx->ds.length = len;
+    tx->ds.size = size;
+    tx->eb.ds_head = &tx->ds;
+    tx->eb.ds_tail = &tx->ds;
+    tx->eb.data_len = len;
+    tx->eb.type = ESF_BUF_TX_PB;
+    tx->eb.desc.tx_desc = &tx->desc;
+    return &tx->eb;
+}
+
+void host_stack_tx_free(esf_buf_t *eb)
+{
+    free(eb->buf_begin);
+    free(eb);
+}
+
+void sip_register_tx_data_cb(sip_tx_data_t fn)
+{
+    host_stack.tx_data = fn;
+}
+
+void sip_register_tx_cmd_cb(sip_tx_cmd_t fn)
+{
+    host_stack.tx_cmd = fn;
+}
+
+void sip_register_get_coex_status_cb(sip_get_coex_status fn)
+{
+}
+
+/* Control frames of the stack, the buffer holds the SIP header and the command */
+esf_buf *esf_buf_alloc(void *buffer, esf_buf_type_t type, uint32_t len)
+{
+    esf_buf_t *eb = host_stack_tx_alloc(0, len, len);
+
+    if (eb != NULL) {
+        eb->type = type;
+    }
+    return eb;
+}
+
+void esf_buf_recycle(esf_buf *eb)
+{
+    host_stack_tx_free(eb);
+}
+
+bool esp_wifi_is_tx_callback(esf_buf *eb)
+{
+    return false;
+}
+
+void net80211_en_txdq(esf_buf *eb)
+{
+}
+
+void esp_sip_txd_post(void)
+{
+}
+
+/* The test owns data frames, it checks them after the transport is done */
+void esp_sip_recycle(esf_buf *eb)
+{
+    if (eb->type == ESF_BUF_TX_SIP || eb->type == ESF_BUF_TX_SIP_TEST) {
+        host_stack_tx_free(eb);
+    }
+    __atomic_add_fetch(&host_stack.tx_done, 1, __ATOMIC_RELEASE);
+}
+
+void sip_rx_process(uint8_t *buf, uint32_t len)
+{
+    const struct sip_hdr *hdr = (const struct sip_hdr *)buf;
+
+    while (__atomic_load_n(&host_stack.rx_hold, __ATOMIC_ACQUIRE)) {
+        vTaskDelay(1);
+    }
+    uint32_t n = host_stack.rx_frames;
+
+    if (n < HOST_STACK_RX_MAX) {
+        host_stack.rx_seq[n] = hdr->seq;
+    }
+    __atomic_store_n(&host_stack.rx_frames, n + 1, __ATOMIC_RELEASE);
+}
+
+void coex_schm_status_set(uint16_t wifi_st, uint16_t ble_st, uint16_t bt_st)
+{
+}
+
+#ifdef HOST_STACK_EXTCONN
+/* trans_bt.c and extconn.c are built in, Bluedroid is on the other side of the HCI driver */
+static int host_stack_bt_recv(uint8_t *data, uint16_t len)
+{
+    host_stack.bt_rx_len = len;
+    __atomic_add_fetch(&host_stack.bt_rx, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+esp_err_t esp_bluedroid_attach_hci_driver(const esp_bluedroid_hci_driver_operations_t *ops)
+{
+    static const esp_bluedroid_hci_driver_callbacks_t callbacks = {
+        .notify_host_recv = host_stack_bt_recv,
+    };
+
+    host_stack.bt_send = ops->send;
+    return ops->register_host_callback(&callbacks);
+}
+#else
+void esp_extconn_trans_bt_recv(uint8_t *buff, size_t len)
+{
+    host_stack.bt_rx_len = len;
+    __atomic_add_fetch(&host_stack.bt_rx, 1, __ATOMIC_RELEASE);
+}
+
+void esp_extconn_trans_bt_send_unlock(void)
+{
+}
+
+void esp_extconn_boot_mark(esp_extconn_boot_phase_t phase)
+{
+}
+#endif
@@ -0,0 +1,51 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef __HOST_STACK_H__
+#define __HOST_STACK_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_sip.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HOST_STACK_RX_MAX   (256)
+
+/*
+ * What the Wi-Fi and BT host stacks saw of the transport. They are closed libraries on
+ * the target, host_stack.c stands in for the calls the transport makes into them.
+ */
+typedef struct {
+    sip_tx_data_t tx_data;                      /* Registered by trans_wifi */
+    sip_tx_cmd_t tx_cmd;
+    uint32_t rx_frames;                         /* Data frames handed to the stack */
+    uint32_t rx_seq[HOST_STACK_RX_MAX];         /* Their sequence numbers, in order */
+    bool rx_hold;                               /* Data frames wait in the stack while set */
+    uint32_t tx_done;                           /* Frames the transport gave back */
+    uint32_t bt_rx;                             /* BT packets handed to the stack */
+    size_t bt_rx_len;
+    void (*bt_send)(uint8_t *data, uint16_t len); /* Registered by trans_bt, when it is built in */
+} host_stack_t;
+
+extern host_stack_t host_stack;
+
+/* Wait until a counter of host_stack reaches n, false on timeout */
+bool host_stack_wait(const uint32_t *counter, uint32_t n, uint32_t wait_ms);
+
+/* A Wi-Fi TX buffer of the stack: len payload bytes in size, offset bytes after a cache line start */
+esf_buf_t *host_stack_tx_alloc(size_t offset, size_t len, size_t size);
+
+void host_stack_tx_free(esf_buf_t *eb);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __HOST_STACK_H__ */
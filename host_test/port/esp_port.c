@@ -0,0 +1,497 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "esp_cpu.h"
+#include "esp_dma_utils.h"
+#include "esp_random.h"
+#include "esp_rom_sys.h"
+#include "esp_timer.h"
+#include "ext_sdio_adapter.h"
+
+struct host_sem {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    UBaseType_t count;
+    UBaseType_t max;
+};
+
+struct host_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+    uint8_t items[];
+};
+
+struct host_event_group {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    EventBits_t bits;
+};
+
+struct host_task {
+    TaskFunction_t fn;
+    void *arg;
+    UBaseType_t prio;
+    SemaphoreHandle_t notify;       /* The notification value is its count */
+};
+
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void *arg;
+    uint64_t timeout_us;
+};
+
+/* There is no SDMMC host on Linux, the tests bring the bus up with esp_extconn_sdio_init_ops */
+const esp_extconn_sdio_ops_t esp_extconn_sdio_sdmmc_ops = { 0 };
+
+static pthread_mutex_t s_critical = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+static __thread struct host_task *s_self;
+
+static void host_sleep_us(uint64_t us)
+{
+    struct timespec ts = {
+        .tv_sec = us / 1000000,
+        .tv_nsec = (us % 1000000) * 1000,
+    };
+
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
+
+/* Absolute CLOCK_REALTIME deadline for pthread_cond_timedwait, ticks from now */
+static struct timespec host_deadline(TickType_t ticks)
+{
+    struct timespec deadline;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    uint64_t ns = deadline.tv_nsec + (uint64_t)ticks * portTICK_PERIOD_MS * 1000000;
+    deadline.tv_sec += ns / 1000000000;
+    deadline.tv_nsec = ns % 1000000000;
+    return deadline;
+}
+
+/* Wait on cond until ready() holds, false on timeout. Called and returns with lock held */
+static bool host_wait(pthread_cond_t *cond, pthread_mutex_t *lock, TickType_t ticks,
+                      bool (*ready)(const void *obj), const void *obj)
+{
+    struct timespec deadline = host_deadline(ticks);
+    int rc = 0;
+
+    while (!ready(obj) && rc == 0) {
+        rc = ticks == portMAX_DELAY ? pthread_cond_wait(cond, lock)
+             : pthread_cond_timedwait(cond, lock, &deadline);
+    }
+    return ready(obj);
+}
+
+void host_critical_enter(void)
+{
+    pthread_mutex_lock(&s_critical);
+}
+
+void host_critical_exit(void)
+{
+    pthread_mutex_unlock(&s_critical);
+}
+
+esp_cpu_cycle_count_t esp_cpu_get_cycle_count(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (esp_cpu_cycle_count_t)((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+int64_t esp_timer_get_time(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle)
+{
+    struct esp_timer *timer = calloc(1, sizeof(*timer));
+
+    if (timer == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    timer->callback = create_args->callback;
+    timer->arg = create_args->arg;
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+static void *host_timer_thread(void *arg)
+{
+    struct esp_timer *timer = arg;
+
+    host_sleep_us(timer->timeout_us);
+    timer->callback(timer->arg);
+    return NULL;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    pthread_t thread;
+
+    timer->timeout_us = timeout_us;
+    if (pthread_create(&thread, NULL, host_timer_thread, timer) != 0) {
+        return ESP_FAIL;
+    }
+    pthread_detach(thread);
+    return ESP_OK;
+}
+
+void esp_rom_delay_us(uint32_t us)
+{
+    host_sleep_us(us);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    host_sleep_us((uint64_t)ticks * portTICK_PERIOD_MS * 1000);
+}
+
+uint32_t esp_random(void)
+{
+    return (uint32_t)random();
+}
+
+static SemaphoreHandle_t host_sem_create(UBaseType_t max, UBaseType_t initial);
+
+static void host_task_free(struct host_task *task)
+{
+    vSemaphoreDelete(task->notify);
+    free(task);
+}
+
+static void *host_task_thread(void *arg)
+{
+    s_self = arg;
+    s_self->fn(s_self->arg);
+    host_task_free(s_self);
+    return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+                                   UBaseType_t prio, TaskHandle_t *handle, BaseType_t core)
+{
+    struct host_task *task = calloc(1, sizeof(*task));
+    pthread_t thread;
+
+    /* Every task is a plain thread, unnamed and unpinned, with the default stack */
+    (void)name;
+    (void)stack;
+    (void)core;
+    if (task == NULL) {
+        return pdFAIL;
+    }
+    task->fn = fn;
+    task->arg = arg;
+    task->prio = prio;
+    task->notify = host_sem_create(UINT32_MAX, 0);
+    if (task->notify == NULL) {
+        free(task);
+        return pdFAIL;
+    }
+    if (pthread_create(&thread, NULL, host_task_thread, task) != 0) {
+        host_task_free(task);
+        return pdFAIL;
+    }
+    pthread_detach(thread);
+    if (handle) {
+        *handle = task;
+    }
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if (task == NULL || task == s_self) {
+        host_task_free(s_self);
+        pthread_exit(NULL);
+    }
+    abort();
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task)
+{
+    task = task ? task : s_self;
+    return task ? task->prio : 1;
+}
+
+void taskYIELD(void)
+{
+    sched_yield();
+}
+
+static SemaphoreHandle_t host_sem_create(UBaseType_t max, UBaseType_t initial)
+{
+    struct host_sem *sem = calloc(1, sizeof(*sem));
+
+    if (sem != NULL) {
+        pthread_mutex_init(&sem->lock, NULL);
+        pthread_cond_init(&sem->cond, NULL);
+        sem->count = initial;
+        sem->max = max;
+    }
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return host_sem_create(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return host_sem_create(1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial)
+{
+    return host_sem_create(max, initial);
+}
+
+static bool host_sem_ready(const void *obj)
+{
+    return ((const struct host_sem *)obj)->count > 0;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+    pthread_mutex_lock(&sem->lock);
+    BaseType_t taken = host_wait(&sem->cond, &sem->lock, ticks, host_sem_ready, sem) ? pdTRUE : pdFALSE;
+    if (taken) {
+        sem->count--;
+    }
+    pthread_mutex_unlock(&sem->lock);
+    return taken;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    BaseType_t given = pdFALSE;
+
+    pthread_mutex_lock(&sem->lock);
+    if (sem->count < sem->max) {
+        sem->count++;
+        given = pdTRUE;
+        pthread_cond_broadcast(&sem->cond);
+    }
+    pthread_mutex_unlock(&sem->lock);
+    return given;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem)
+{
+    pthread_mutex_destroy(&sem->lock);
+    pthread_cond_destroy(&sem->cond);
+    free(sem);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return s_self;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    xSemaphoreGive(task->notify);
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks)
+{
+    struct host_sem *sem = s_self->notify;
+    uint32_t value = 0;
+
+    pthread_mutex_lock(&sem->lock);
+    if (host_wait(&sem->cond, &sem->lock, ticks, host_sem_ready, sem)) {
+        value = sem->count;
+        sem->count = clear ? 0 : sem->count - 1;
+    }
+    pthread_mutex_unlock(&sem->lock);
+    return value;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    struct host_queue *queue = calloc(1, sizeof(*queue) + length * item_size);
+
+    if (queue != NULL) {
+        pthread_mutex_init(&queue->lock, NULL);
+        pthread_cond_init(&queue->cond, NULL);
+        queue->length = length;
+        queue->item_size = item_size;
+    }
+    return queue;
+}
+
+static bool host_queue_has_room(const void *obj)
+{
+    const struct host_queue *queue = obj;
+
+    return queue->count < queue->length;
+}
+
+static bool host_queue_has_item(const void *obj)
+{
+    return ((const struct host_queue *)obj)->count > 0;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks)
+{
+    pthread_mutex_lock(&queue->lock);
+    BaseType_t sent = host_wait(&queue->cond, &queue->lock, ticks, host_queue_has_room, queue) ? pdTRUE : pdFALSE;
+    if (sent) {
+        UBaseType_t tail = (queue->head + queue->count) % queue->length;
+        memcpy(&queue->items[tail * queue->item_size], item, queue->item_size);
+        queue->count++;
+        pthread_cond_broadcast(&queue->cond);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return sent;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks)
+{
+    pthread_mutex_lock(&queue->lock);
+    BaseType_t received = host_wait(&queue->cond, &queue->lock, ticks, host_queue_has_item, queue) ? pdTRUE : pdFALSE;
+    if (received) {
+        memcpy(item, &queue->items[queue->head * queue->item_size], queue->item_size);
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+        pthread_cond_broadcast(&queue->cond);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return received;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    UBaseType_t count = queue->count;
+    pthread_mutex_unlock(&queue->lock);
+    return count;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->cond);
+    free(queue);
+}
+
+EventGroupHandle_t xEventGroupCreate(void)
+{
+    struct host_event_group *group = calloc(1, sizeof(*group));
+
+    if (group != NULL) {
+        pthread_mutex_init(&group->lock, NULL);
+        pthread_cond_init(&group->cond, NULL);
+    }
+    return group;
+}
+
+void vEventGroupDelete(EventGroupHandle_t group)
+{
+    pthread_mutex_destroy(&group->lock);
+    pthread_cond_destroy(&group->cond);
+    free(group);
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    pthread_mutex_lock(&group->lock);
+    group->bits |= bits;
+    EventBits_t now = group->bits;
+    pthread_cond_broadcast(&group->cond);
+    pthread_mutex_unlock(&group->lock);
+    return now;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    pthread_mutex_lock(&group->lock);
+    EventBits_t before = group->bits;
+    group->bits &= ~bits;
+    pthread_mutex_unlock(&group->lock);
+    return before;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group)
+{
+    pthread_mutex_lock(&group->lock);
+    EventBits_t now = group->bits;
+    pthread_mutex_unlock(&group->lock);
+    return now;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear,
+                                BaseType_t all, TickType_t ticks)
+{
+    struct timespec deadline = host_deadline(ticks);
+    int rc = 0;
+
+    pthread_mutex_lock(&group->lock);
+    while (rc == 0) {
+        EventBits_t set = group->bits & bits;
+        if (all ? set == bits : set != 0) {
+            break;
+        }
+        rc = ticks == portMAX_DELAY ? pthread_cond_wait(&group->cond, &group->lock)
+             : pthread_cond_timedwait(&group->cond, &group->lock, &deadline);
+    }
+    EventBits_t now = group->bits;
+    EventBits_t set = now & bits;
+    if (clear && (all ? set == bits : set != 0)) {
+        group->bits &= ~bits;
+    }
+    pthread_mutex_unlock(&group->lock);
+    return now;
+}
+
+esp_err_t esp_dma_capable_malloc(size_t size, const esp_dma_mem_info_t *dma_mem_info, void **out_ptr, size_t *actual_size)
+{
+    size_t align = dma_mem_info->dma_alignment_bytes ? dma_mem_info->dma_alignment_bytes : 4;
+    size_t padded = (size + align - 1) / align * align;
+
+    *out_ptr = aligned_alloc(align, padded);
+    if (*out_ptr == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (actual_size) {
+        *actual_size = padded;
+    }
+    return ESP_OK;
+}
+
+bool esp_dma_is_buffer_alignment_satisfied(const void *ptr, size_t size, esp_dma_mem_info_t dma_mem_info)
+{
+    size_t align = dma_mem_info.dma_alignment_bytes;
+
+    return align == 0 || ((uintptr_t)ptr % align == 0 && size % align == 0);
+}
@@ -0,0 +1,9 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+/* The layouts checked are those of the 32-bit target, pointers are wider on the host */
+#define ESP_STATIC_ASSERT(expr, msg)
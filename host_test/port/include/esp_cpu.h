@@ -0,0 +1,13 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include <stdint.h>
+
+typedef uint32_t esp_cpu_cycle_count_t;
+
+/* Nanoseconds of the monotonic clock, cycles of a 1 GHz CPU */
+esp_cpu_cycle_count_t esp_cpu_get_cycle_count(void);
@@ -0,0 +1,13 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include <stdlib.h>
+
+#include "esp_bit_defs.h"
+
+#define MALLOC_CAP_DMA      BIT(3)
+#define MALLOC_CAP_INTERNAL BIT(11)
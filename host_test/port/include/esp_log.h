@@ -0,0 +1,38 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include <inttypes.h>
+#include <stdio.h>
+
+/* Takes the arguments of a log that is not printed, as a variable only logged is still used */
+static inline void esp_log_discard(const char *tag, const char *fmt, ...)
+{
+    (void)tag;
+    (void)fmt;
+}
+
+/* Errors and warnings only, the adapter logs every register it sets up at info level */
+#define ESP_LOGE(tag, fmt, ...) fprintf(stderr, "E %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) fprintf(stderr, "W %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) esp_log_discard(tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...) esp_log_discard(tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGV(tag, fmt, ...) esp_log_discard(tag, fmt, ##__VA_ARGS__)
+
+typedef enum {
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE,
+} esp_log_level_t;
+
+#define ESP_LOG_LEVEL_LOCAL(level, tag, fmt, ...) do {                      \
+        if ((level) <= ESP_LOG_WARN) {                                      \
+            fprintf(stderr, "%c %s: " fmt "\n", (level) == ESP_LOG_ERROR ? 'E' : 'W', tag, ##__VA_ARGS__); \
+        }                                                                   \
+    } while (0)
@@ -0,0 +1,32 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define pdTRUE  1
+#define pdFALSE 0
+#define pdPASS  pdTRUE
+#define pdFAIL  pdFALSE
+#define portMAX_DELAY           UINT32_MAX
+#define portTICK_PERIOD_MS      1
+#define pdMS_TO_TICKS(ms)       ((TickType_t)(ms) / portTICK_PERIOD_MS)
+#define tskNO_AFFINITY          ((BaseType_t)0x7FFFFFFF)
+#define configMAX_PRIORITIES    25
+
+/* Tasks are threads, every critical section takes the same process wide lock */
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED 0
+#define portENTER_CRITICAL(mux) ((void)(mux), host_critical_enter())
+#define portEXIT_CRITICAL(mux)  ((void)(mux), host_critical_exit())
+
+void host_critical_enter(void);
+
+void host_critical_exit(void);
@@ -0,0 +1,25 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include "esp_bit_defs.h"
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_event_group *EventGroupHandle_t;
+typedef uint32_t EventBits_t;
+
+EventGroupHandle_t xEventGroupCreate(void);
+
+void vEventGroupDelete(EventGroupHandle_t group);
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits);
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits);
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group);
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear,
+                                BaseType_t all, TickType_t ticks);
@@ -0,0 +1,20 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_queue *QueueHandle_t;
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size);
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks);
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks);
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+
+void vQueueDelete(QueueHandle_t queue);
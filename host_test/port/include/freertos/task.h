@@ -0,0 +1,32 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_task *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *arg);
+
+/* A detached thread, priority and core are only recorded */
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+                                   UBaseType_t prio, TaskHandle_t *handle, BaseType_t core);
+
+/* Only a task deleting itself is supported */
+void vTaskDelete(TaskHandle_t task);
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task);
+
+void vTaskDelay(TickType_t ticks);
+
+/* NULL outside the transport tasks, on the test thread */
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+
+void taskYIELD(void);
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+
+/* Only for the calling task, as on FreeRTOS */
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks);
@@ -0,0 +1,16 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#define SDMMC_FREQ_PROBING      400
+
+#define SD_IO_CCCR_FN_ENABLE    0x02
+#define SD_IO_CCCR_INT_ENABLE   0x04
+#define SD_IO_CCCR_CTL          0x06
+#define SD_IO_CCCR_BUS_WIDTH    0x07
+#define CCCR_BUS_WIDTH_ECSI     (1 << 5)
+#define SD_IO_CCCR_BLKSIZEL     0x10
+#define SD_IO_CCCR_BLKSIZEH     0x11
@@ -0,0 +1,13 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include <stdint.h>
+
+/* Only what the adapter reads, there is no SDMMC host on Linux */
+typedef struct {
+    int max_freq_khz;
+} sdmmc_card_t;
@@ -0,0 +1,20 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+/* Kconfig defaults the host test is built with, a variant #include_next's this and overrides */
+#define CONFIG_ESP_EXT_CONN_ENABLE              1
+#define CONFIG_ESP_EXT_CONN_WIFI_ENABLE         1
+#define CONFIG_ESP_EXT_CONN_BT_ENABLE           1
+#define CONFIG_ESP_EXT_CONN_RECV_RING_SLOTS     1
+#define CONFIG_ESP_EXT_CONN_RECV_POLL_US        0
+#define CONFIG_ESP_EXT_CONN_WIFI_TX_ZERO_COPY   1
+#define CONFIG_ESP_EXT_CONN_FW_DL_PIPELINE_DEPTH 2
+#define CONFIG_ESP_EXT_CONN_FW_RAW              1
+#define CONFIG_ESP_EXT_CONN_SDIO_BLOCK_SIZE     512
+#define CONFIG_ESP_EXT_CONN_SDIO_ARENA_SLOTS    4
+#define CONFIG_ESP_EXT_CONN_SDIO_RETRY_MAX      3
+#define CONFIG_ESP_EXT_CONN_SDIO_DOWNSHIFT_ERRORS 4
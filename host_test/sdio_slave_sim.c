@@ -0,0 +1,585 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/param.h>
+
+#include "sd_protocol_defs.h"
+#include "esp_bit_defs.h"
+#include "sdio_host_reg.h"
+#include "sip2_common.h"
+#include "sdio_slave_sim.h"
+
+/* A BT packet starts with its length in the low 24 bits, the slave finds the end from it */
+#define SIM_BT_LEN(word)    ((word) & 0xffffff)
+
+static bool sim_queue_push(sdio_slave_sim_queue_t *q, const void *data, size_t len)
+{
+    if (q->count == SDIO_SLAVE_SIM_QUEUE_LEN) {
+        return false;
+    }
+    sdio_slave_sim_pkt_t *pkt = &q->pkt[(q->head + q->count) % SDIO_SLAVE_SIM_QUEUE_LEN];
+    pkt->data = malloc(len);
+    if (pkt->data == NULL) {
+        return false;
+    }
+    memcpy(pkt->data, data, len);
+    pkt->len = len;
+    q->count++;
+    return true;
+}
+
+static void sim_queue_drop(sdio_slave_sim_queue_t *q)
+{
+    free(q->pkt[q->head].data);
+    q->pkt[q->head].data = NULL;
+    q->head = (q->head + 1) % SDIO_SLAVE_SIM_QUEUE_LEN;
+    q->count--;
+}
+
+static void sim_queue_clear(sdio_slave_sim_queue_t *q)
+{
+    while (q->count) {
+        sim_queue_drop(q);
+    }
+    q->head = 0;
+}
+
+static uint32_t sim_tx_bufs(size_t len)
+{
+    return (len + EXT_CONN_SDIO_SLAVE_BUF_SIZE - 1) / EXT_CONN_SDIO_SLAVE_BUF_SIZE;
+}
+
+static size_t sim_bt_rx_left(const sdio_slave_sim_t *sim)
+{
+    if (sim->bt_rx_q.count == 0) {
+        return 0;
+    }
+    return sim->bt_rx_q.pkt[sim->bt_rx_q.head].len - sim->bt_rx_off;
+}
+
+static uint16_t sim_block_size(const sdio_slave_sim_t *sim, uint32_t function)
+{
+    const uint8_t *fbr = &sim->cccr[function * 0x100];
+    uint16_t bs = fbr[SD_IO_CCCR_BLKSIZEL] | (fbr[SD_IO_CCCR_BLKSIZEH] << 8);
+
+    return MIN(bs, sim->max_block_size);
+}
+
+static uint32_t sim_reg_word(const sdio_slave_sim_t *sim, uint32_t addr)
+{
+    uint32_t value = 0;
+
+    switch (addr) {
+    case ESP_SDIO_TOKEN_RDATA:
+        return (sim->token & TX_BUFFER_MASK) << ESP_SDIO_SEND_OFFSET;
+    case ESP_SDIO_SLC1_HOST_PF: {
+        /* Big endian in bytes 1 to 3, as the adapter decodes it */
+        uint32_t len = sim_bt_rx_left(sim);
+        uint8_t *pf = (uint8_t *)&value;
+        pf[1] = len >> 16;
+        pf[2] = len >> 8;
+        pf[3] = len;
+        return value;
+    }
+    case ESP_SDIO_INT_RAW:
+        return sim->int_raw0;
+    case ESP_SDIO_INT_RAW1:
+        return sim->int_raw1 | (sim->bt_rx_q.count ? SLCHOST_SLC1_BT_RX_NEW_PACKET_INT_RAW : 0);
+    case ESP_SDIO_PKT_LEN:
+        return sim->pkt_len & RX_BYTE_MASK;
+    default:
+        memcpy(&value, &sim->regs[addr], sizeof(value));
+        return value;
+    }
+}
+
+static uint8_t sim_reg_read(const sdio_slave_sim_t *sim, uint32_t addr)
+{
+    uint32_t word = sim_reg_word(sim, addr & ~3);
+
+    return word >> ((addr & 3) * 8);
+}
+
+static void sim_window(sdio_slave_sim_t *sim)
+{
+    uint8_t index = sim->regs[ESP_SDIO_WIN_CMD] & 0x7f;
+    uint8_t cmd = sim->regs[ESP_SDIO_WIN_CMD + 1];
+
+    if (cmd == 0x80) {
+        memcpy(&sim->regs[ESP_SDIO_STATE_W0], &sim->slc[index], sizeof(uint32_t));
+    } else if (cmd == 0xc0) {
+        memcpy(&sim->slc[index], &sim->regs[ESP_SDIO_CONFIG_W5], sizeof(uint32_t));
+    }
+}
+
+static void sim_reg_write(sdio_slave_sim_t *sim, uint32_t addr, uint8_t value)
+{
+    /* Interrupt clear registers are write 1 to clear and read back as 0 */
+    if (addr >= ESP_SDIO_SLC0_INT_CLR && addr < ESP_SDIO_SLC0_INT_CLR + 4) {
+        sim->int_raw0 &= ~((uint32_t)value << ((addr - ESP_SDIO_SLC0_INT_CLR) * 8));
+        return;
+    }
+    if (addr >= ESP_SDIO_SLC1_INT_CLR && addr < ESP_SDIO_SLC1_INT_CLR + 4) {
+        sim->int_raw1 &= ~((uint32_t)value << ((addr - ESP_SDIO_SLC1_INT_CLR) * 8));
+        return;
+    }
+    sim->regs[addr] = value;
+    /* The command byte starts the window access, the index and the value are in place by then */
+    if (addr == ESP_SDIO_WIN_CMD + 1) {
+        sim_window(sim);
+    }
+}
+
+static esp_err_t sim_push_locked(sdio_slave_sim_t *sim, uint32_t function, const void *data, size_t len);
+
+/* What the ROM answers to SIP_CMD_BOOTUP once the firmware runs */
+static void sim_boot_event(sdio_slave_sim_t *sim)
+{
+    struct {
+        struct sip_hdr hdr;
+        struct sip_evt_bootup2 evt;
+    } __packed frame = { 0 };
+
+    SIP_HDR_SET_TYPE(frame.hdr.fc[0], SIP_CTRL);
+    frame.hdr.c_evtid = SIP_EVT_BOOTUP;
+    frame.hdr.len = sizeof(frame);
+    frame.evt.tx_blksz = sim_block_size(sim, EXT_CONN_WIFI_SDIO_FUNC);
+    frame.evt.rx_blksz = sim_block_size(sim, EXT_CONN_WIFI_SDIO_FUNC);
+    for (int i = 0; i < EXT_ETH_ALEN; i++) {
+        frame.evt.mac_addr[i] = 0x10 + i;
+    }
+    sim_push_locked(sim, EXT_CONN_WIFI_SDIO_FUNC, &frame, sizeof(frame));
+}
+
+static void sim_tx_done(sdio_slave_sim_t *sim, uint32_t function)
+{
+    const uint8_t *data = sim->tx_asm[function];
+    size_t len = sim->tx_asm_len[function];
+    const struct sip_hdr *hdr = (const struct sip_hdr *)data;
+
+    sim->tx_asm_len[function] = 0;
+    if (function != EXT_CONN_WIFI_SDIO_FUNC) {
+        sim_queue_push(&sim->tx_q[function], data, len);
+        return;
+    }
+
+    uint32_t bufs = sim_tx_bufs(len);
+    if (sim->tx_bufs_used + bufs > SDIO_SLAVE_SIM_TX_BUFS) {
+        sim->tx_overflows++;
+        return;
+    }
+    if (sim->boot_handshake && len >= SIP_CTRL_HDR_LEN && SIP_HDR_IS_CTRL(hdr) &&
+            hdr->c_cmdid == SIP_CMD_BOOTUP) {
+        /* Handled by the ROM at once, the buffers are free again */
+        sim->token += bufs;
+        sim_boot_event(sim);
+        return;
+    }
+    if (sim->target && sim->target(sim, data, len, sim->target_arg)) {
+        sim->token += bufs;
+        return;
+    }
+    if (sim_queue_push(&sim->tx_q[function], data, len)) {
+        sim->tx_bufs_used += bufs;
+    }
+}
+
+/* Function 1 ends a packet by address, function 2 by the length in its first word */
+static void sim_data_write(sdio_slave_sim_t *sim, uint32_t function, uint32_t addr, const uint8_t *src, size_t size)
+{
+    uint8_t *buf = sim->tx_asm[function];
+    size_t *len = &sim->tx_asm_len[function];
+
+    if (function == EXT_CONN_WIFI_SDIO_FUNC) {
+        /* Bytes past the end address are padding, the hardware drops them */
+        size_t n = addr < ESP_SLAVE_CMD53_END_ADDR ? MIN(size, ESP_SLAVE_CMD53_END_ADDR - addr) : 0;
+        n = MIN(n, SDIO_SLAVE_SIM_PKT_MAX - *len);
+        memcpy(buf + *len, src, n);
+        *len += n;
+        if (addr + size >= ESP_SLAVE_CMD53_END_ADDR) {
+            sim_tx_done(sim, function);
+        }
+        return;
+    }
+
+    size_t n = MIN(size, SDIO_SLAVE_SIM_PKT_MAX - *len);
+    memcpy(buf + *len, src, n);
+    *len += n;
+    if (*len >= 4) {
+        uint32_t word;
+        memcpy(&word, buf, sizeof(word));
+        if (*len >= SIM_BT_LEN(word)) {
+            *len = SIM_BT_LEN(word);
+            sim_tx_done(sim, function);
+        }
+    }
+}
+
+static void sim_rx_consume(sdio_slave_sim_t *sim, uint8_t *dst, size_t n)
+{
+    if (dst) {
+        memcpy(dst, sim->rx_stream, n);
+    }
+    memmove(sim->rx_stream, sim->rx_stream + n, sim->rx_pending - n);
+    sim->rx_pending -= n;
+}
+
+static void sim_data_read(sdio_slave_sim_t *sim, uint32_t function, uint32_t addr, uint8_t *dst, size_t size)
+{
+    memset(dst, 0, size);
+
+    if (function == EXT_CONN_WIFI_SDIO_FUNC) {
+        /* Every address before the end takes a byte off the stream, padding reads none */
+        size_t n = addr < ESP_SLAVE_CMD53_END_ADDR ? MIN(size, ESP_SLAVE_CMD53_END_ADDR - addr) : 0;
+        if (sim->rx_read_left == 0) {
+            sim->rx_read_left = MIN(n ? ESP_SLAVE_CMD53_END_ADDR - addr : 0, sim->rx_pending);
+        }
+        n = MIN(n, sim->rx_read_left);
+        sim_rx_consume(sim, dst, n);
+        sim->rx_read_left -= n;
+        return;
+    }
+
+    size_t n = MIN(size, sim_bt_rx_left(sim));
+    if (n) {
+        memcpy(dst, sim->bt_rx_q.pkt[sim->bt_rx_q.head].data + sim->bt_rx_off, n);
+        sim->bt_rx_off += n;
+    }
+    if (sim->bt_rx_q.count && sim_bt_rx_left(sim) == 0) {
+        sim_queue_drop(&sim->bt_rx_q);
+        sim->bt_rx_off = 0;
+    }
+}
+
+/* A command, then size bytes at two clocks each */
+static uint64_t sim_bus_ns(const sdio_slave_sim_t *sim, size_t size)
+{
+    return sim->cmd_ns + (sim->clk_khz ? (uint64_t)size * 2 * 1000000 / sim->clk_khz : 0);
+}
+
+static esp_err_t sim_cmd53(sdio_slave_sim_t *sim, bool write, uint32_t function, uint32_t addr, void *buf, size_t size)
+{
+    esp_err_t err = ESP_OK;
+    uint8_t *p = buf;
+
+    sim->cmd53++;
+    sim->bus_ns += sim_bus_ns(sim, size);
+    if (sim->fail_in >= 0 && sim->fail_in-- == 0) {
+        err = sim->fail_err;
+        /* A write that fails never reaches the slave, a read was clocked out all the same */
+        if (write) {
+            return err;
+        }
+    }
+
+    if (function == EXT_CONN_WIFI_SDIO_FUNC && addr < SDIO_SLAVE_SIM_REG_SPACE) {
+        for (size_t i = 0; i < size && addr + i < SDIO_SLAVE_SIM_REG_SPACE; i++) {
+            if (write) {
+                sim_reg_write(sim, addr + i, p[i]);
+            } else {
+                p[i] = sim_reg_read(sim, addr + i);
+            }
+        }
+        return err;
+    }
+    if ((uintptr_t)p % EXT_CONN_SDIO_DMA_ALIGN || size % EXT_CONN_SDIO_DMA_ALIGN) {
+        sim->data_bounces++;
+    }
+    if (write) {
+        sim_data_write(sim, function, addr, p, size);
+    } else {
+        sim_data_read(sim, function, addr, p, size);
+    }
+    return err;
+}
+
+static esp_err_t sim_go_idle_locked(void *ctx)
+{
+    sdio_slave_sim_t *sim = ctx;
+
+    if (sim->go_idle_fails > 0) {
+        sim->go_idle_fails--;
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t sim_read_byte_locked(void *ctx, uint32_t function, uint32_t addr, uint8_t *out)
+{
+    sdio_slave_sim_t *sim = ctx;
+
+    sim->cmd52++;
+    sim->bus_ns += sim_bus_ns(sim, 0);
+    if (function == 0) {
+        uint32_t fn = addr / 0x100;
+        uint32_t reg = addr % 0x100;
+        if ((fn == EXT_CONN_WIFI_SDIO_FUNC || fn == EXT_CONN_BT_SDIO_FUNC) &&
+                (reg == SD_IO_CCCR_BLKSIZEL || reg == SD_IO_CCCR_BLKSIZEH)) {
+            uint16_t bs = sim_block_size(sim, fn);
+            *out = reg == SD_IO_CCCR_BLKSIZEL ? bs & 0xff : bs >> 8;
+            return ESP_OK;
+        }
+        *out = addr < sizeof(sim->cccr) ? sim->cccr[addr] : 0;
+        return ESP_OK;
+    }
+    *out = addr < SDIO_SLAVE_SIM_REG_SPACE ? sim_reg_read(sim, addr) : 0;
+    return ESP_OK;
+}
+
+static esp_err_t sim_write_byte_locked(void *ctx, uint32_t function, uint32_t addr, uint8_t in, uint8_t *out)
+{
+    sdio_slave_sim_t *sim = ctx;
+
+    sim->cmd52++;
+    sim->bus_ns += sim_bus_ns(sim, 0);
+    if (function == 0) {
+        if (addr == SD_IO_CCCR_CTL) {
+            /* ASx abort: the packet being written on the function is dropped */
+            uint32_t fn = in & 0x7;
+            if (fn <= EXT_CONN_BT_SDIO_FUNC) {
+                sim->tx_asm_len[fn] = 0;
+            }
+            /* So is the rest of the packet an aborted read was taking */
+            if (fn == EXT_CONN_WIFI_SDIO_FUNC) {
+                sim_rx_consume(sim, NULL, sim->rx_read_left);
+                sim->rx_read_left = 0;
+            }
+            sim->aborts++;
+        } else if (addr < sizeof(sim->cccr)) {
+            sim->cccr[addr] = in;
+        }
+    } else if (addr < SDIO_SLAVE_SIM_REG_SPACE) {
+        sim_reg_write(sim, addr, in);
+    }
+    if (out) {
+        sim_read_byte_locked(ctx, function, addr, out);
+        sim->cmd52--;
+        sim->bus_ns -= sim_bus_ns(sim, 0);
+    }
+    return ESP_OK;
+}
+
+static esp_err_t sim_read_bytes_locked(void *ctx, uint32_t function, uint32_t addr, void *dst, size_t size)
+{
+    return sim_cmd53(ctx, false, function, addr, dst, size);
+}
+
+static esp_err_t sim_write_bytes_locked(void *ctx, uint32_t function, uint32_t addr, const void *src, size_t size)
+{
+    return sim_cmd53(ctx, true, function, addr, (void *)src, size);
+}
+
+static esp_err_t sim_read_blocks_locked(void *ctx, uint32_t function, uint32_t addr, void *dst, size_t size, uint16_t block_size)
+{
+    if (block_size != sim_block_size(ctx, function) || size % block_size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return sim_cmd53(ctx, false, function, addr, dst, size);
+}
+
+static esp_err_t sim_write_blocks_locked(void *ctx, uint32_t function, uint32_t addr, const void *src, size_t size, uint16_t block_size)
+{
+    if (block_size != sim_block_size(ctx, function) || size % block_size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return sim_cmd53(ctx, true, function, addr, (void *)src, size);
+}
+
+static bool sim_int_pending(const sdio_slave_sim_t *sim)
+{
+    return sim_reg_word(sim, ESP_SDIO_INT_RAW) || sim_reg_word(sim, ESP_SDIO_INT_RAW1);
+}
+
+/* Level triggered like the DAT1 interrupt, returns at once while a bit is still set */
+static esp_err_t sim_wait_int(void *ctx, uint32_t timeout_ticks)
+{
+    sdio_slave_sim_t *sim = ctx;
+    struct timespec deadline;
+    int rc = 0;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    uint64_t ns = deadline.tv_nsec + (uint64_t)timeout_ticks * 1000000;
+    deadline.tv_sec += ns / 1000000000;
+    deadline.tv_nsec = ns % 1000000000;
+
+    pthread_mutex_lock(&sim->lock);
+    while (!sim_int_pending(sim) && rc == 0) {
+        rc = timeout_ticks == UINT32_MAX ? pthread_cond_wait(&sim->irq, &sim->lock)
+             : pthread_cond_timedwait(&sim->irq, &sim->lock, &deadline);
+    }
+    esp_err_t err = sim_int_pending(sim) ? ESP_OK : ESP_ERR_TIMEOUT;
+    pthread_mutex_unlock(&sim->lock);
+    return err;
+}
+
+static esp_err_t sim_set_clk_locked(void *ctx, uint32_t freq_khz)
+{
+    sdio_slave_sim_t *sim = ctx;
+
+    sim->clk_khz = freq_khz;
+    return ESP_OK;
+}
+
+#define SIM_LOCKED(sim, call) ({                 \
+        pthread_mutex_lock(&(sim)->lock);           \
+        esp_err_t err_ = (call);                    \
+        pthread_mutex_unlock(&(sim)->lock);         \
+        err_;                                       \
+    })
+
+static esp_err_t sim_go_idle(void *ctx)
+{
+    return SIM_LOCKED((sdio_slave_sim_t *)ctx, sim_go_idle_locked(ctx));
+}
+
+static esp_err_t sim_read_byte(void *ctx, uint32_t function, uint32_t addr, uint8_t *out)
+{
+    return SIM_LOCKED((sdio_slave_sim_t *)ctx, sim_read_byte_locked(ctx, function, addr, out));
+}
+
+static esp_err_t sim_write_byte(void *ctx, uint32_t function, uint32_t addr, uint8_t in, uint8_t *out)
+{
+    return SIM_LOCKED((sdio_slave_sim_t *)ctx, sim_write_byte_locked(ctx, function, addr, in, out));
+}
+
+static esp_err_t sim_read_bytes(void *ctx, uint32_t function, uint32_t addr, void *dst, size_t size)
+{
+    sdio_slave_sim_t *sim = ctx;
+    esp_err_t err = SIM_LOCKED(sim, sim_read_bytes_locked(ctx, function, addr, dst, size));
+    sdio_slave_sim_preempt_t preempt = sim->after_reg_read;
+
+    if (preempt != NULL && function == EXT_CONN_WIFI_SDIO_FUNC && addr < SDIO_SLAVE_SIM_REG_SPACE) {
+        sim->after_reg_read = NULL;
+        preempt(sim, sim->after_reg_read_arg);
+        sim->after_reg_read = preempt;
+    }
+    return err;
+}
+
+static esp_err_t sim_write_bytes(void *ctx, uint32_t function, uint32_t addr, const void *src, size_t size)
+{
+    return SIM_LOCKED((sdio_slave_sim_t *)ctx, sim_write_bytes_locked(ctx, function, addr, src, size));
+}
+
+static esp_err_t sim_read_blocks(void *ctx, uint32_t function, uint32_t addr, void *dst, size_t size, uint16_t block_size)
+{
+    return SIM_LOCKED((sdio_slave_sim_t *)ctx, sim_read_blocks_locked(ctx, function, addr, dst, size, block_size));
+}
+
+static esp_err_t sim_write_blocks(void *ctx, uint32_t function, uint32_t addr, const void *src, size_t size, uint16_t block_size)
+{
+    return SIM_LOCKED((sdio_slave_sim_t *)ctx, sim_write_blocks_locked(ctx, function, addr, src, size, block_size));
+}
+
+static esp_err_t sim_set_clk(void *ctx, uint32_t freq_khz)
+{
+    return SIM_LOCKED((sdio_slave_sim_t *)ctx, sim_set_clk_locked(ctx, freq_khz));
+}
+
+/* Same constraint as the P4 SDMMC DMA */
+static esp_err_t sim_get_dma_info(void *ctx, esp_dma_mem_info_t *dma_mem_info)
+{
+    (void)ctx;
+    dma_mem_info->dma_alignment_bytes = EXT_CONN_SDIO_DMA_ALIGN;
+    return ESP_OK;
+}
+
+const esp_extconn_sdio_ops_t sdio_slave_sim_ops = {
+    .go_idle = sim_go_idle,
+    .read_byte = sim_read_byte,
+    .write_byte = sim_write_byte,
+    .read_bytes = sim_read_bytes,
+    .write_bytes = sim_write_bytes,
+    .read_blocks = sim_read_blocks,
+    .write_blocks = sim_write_blocks,
+    .wait_int = sim_wait_int,
+    .set_clk = sim_set_clk,
+    .get_dma_info = sim_get_dma_info,
+};
+
+void sdio_slave_sim_reset(sdio_slave_sim_t *sim)
+{
+    for (int i = 0; i <= EXT_CONN_BT_SDIO_FUNC; i++) {
+        sim_queue_clear(&sim->tx_q[i]);
+    }
+    sim_queue_clear(&sim->bt_rx_q);
+    memset(sim, 0, sizeof(*sim));
+
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&sim->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    pthread_cond_init(&sim->irq, NULL);
+
+    sim->token = SDIO_SLAVE_SIM_TX_BUFS;
+    sim->max_block_size = EXT_CONN_SDIO_DRIVER_BLOCK_SIZE;
+    sim->fail_in = -1;
+    sim->boot_handshake = true;
+}
+
+static esp_err_t sim_push_locked(sdio_slave_sim_t *sim, uint32_t function, const void *data, size_t len)
+{
+    if (function == EXT_CONN_BT_SDIO_FUNC) {
+        if (!sim_queue_push(&sim->bt_rx_q, data, len)) {
+            return ESP_ERR_NO_MEM;
+        }
+    } else {
+        if (len > sizeof(sim->rx_stream) - sim->rx_pending) {
+            return ESP_ERR_NO_MEM;
+        }
+        memcpy(sim->rx_stream + sim->rx_pending, data, len);
+        sim->rx_pending += len;
+        sim->pkt_len = (sim->pkt_len + len) & RX_BYTE_MASK;
+        sim->int_raw0 |= SLCHOST_SLC0_RX_NEW_PACKET_INT_RAW;
+    }
+    pthread_cond_broadcast(&sim->irq);
+    return ESP_OK;
+}
+
+esp_err_t sdio_slave_sim_push(sdio_slave_sim_t *sim, uint32_t function, const void *data, size_t len)
+{
+    return SIM_LOCKED(sim, sim_push_locked(sim, function, data, len));
+}
+
+size_t sdio_slave_sim_pop(sdio_slave_sim_t *sim, uint32_t function, void *buf, size_t size)
+{
+    sdio_slave_sim_queue_t *q = &sim->tx_q[function];
+    size_t len = 0;
+
+    pthread_mutex_lock(&sim->lock);
+    if (q->count) {
+        len = q->pkt[q->head].len;
+        memcpy(buf, q->pkt[q->head].data, MIN(len, size));
+        if (function == EXT_CONN_WIFI_SDIO_FUNC) {
+            uint32_t bufs = sim_tx_bufs(len);
+            sim->tx_bufs_used -= bufs;
+            sim->token += bufs;
+        }
+        sim_queue_drop(q);
+    }
+    pthread_mutex_unlock(&sim->lock);
+    return len;
+}
+
+int sdio_slave_sim_tx_count(sdio_slave_sim_t *sim, uint32_t function)
+{
+    pthread_mutex_lock(&sim->lock);
+    int count = sim->tx_q[function].count;
+    pthread_mutex_unlock(&sim->lock);
+    return count;
+}
+
+void sdio_slave_sim_fail(sdio_slave_sim_t *sim, int n, esp_err_t err)
+{
+    pthread_mutex_lock(&sim->lock);
+    sim->fail_in = n;
+    sim->fail_err = err;
+    pthread_mutex_unlock(&sim->lock);
+}
@@ -0,0 +1,126 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef __SDIO_SLAVE_SIM_H__
+#define __SDIO_SLAVE_SIM_H__
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "ext_sdio_adapter.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Receive buffers of the slave, each one TX credit of EXT_CONN_SDIO_SLAVE_BUF_SIZE bytes */
+#define SDIO_SLAVE_SIM_TX_BUFS      (16)
+/* Largest packet either way, and packets queued per direction and function */
+#define SDIO_SLAVE_SIM_PKT_MAX      (32 * 1024)
+#define SDIO_SLAVE_SIM_QUEUE_LEN    (32)
+/* Function 1 addresses below this are SLCHOST registers, above it packet data */
+#define SDIO_SLAVE_SIM_REG_SPACE    (0x100)
+
+typedef struct {
+    uint8_t *data;
+    size_t len;
+} sdio_slave_sim_pkt_t;
+
+typedef struct {
+    sdio_slave_sim_pkt_t pkt[SDIO_SLAVE_SIM_QUEUE_LEN];
+    int head;
+    int count;
+} sdio_slave_sim_queue_t;
+
+typedef struct sdio_slave_sim sdio_slave_sim_t;
+
+/*
+ * Firmware side of the slave, called with every function 1 packet the host sends.
+ * Returns true if it took the packet, its buffers are then free at once.
+ */
+typedef bool (*sdio_slave_sim_target_t)(sdio_slave_sim_t *sim, const uint8_t *pkt, size_t len, void *arg);
+
+/* Another bus user, run after a register read has finished and before its caller looks at the data */
+typedef void (*sdio_slave_sim_preempt_t)(sdio_slave_sim_t *sim, void *arg);
+
+/*
+ * Software model of the target SDIO slave: CCCR and FBRs, the SLCHOST registers with the
+ * TOKEN_RDATA credit counter, the PKT_LEN byte counter and the new packet interrupts, the
+ * SLC register window, and the ROM side of the SIP bootup handshake.
+ * Tests read the fields directly, only the counters below the model state are for them.
+ * Bus ops and the calls below take the lock, the host tasks and the test may run at once.
+ */
+struct sdio_slave_sim {
+    pthread_mutex_t lock;                       /* Recursive, a target hook may push packets */
+    pthread_cond_t irq;                         /* Signalled when an interrupt is raised */
+
+    uint8_t cccr[0x300];                        /* Function 0, CCCR and the FBR of functions 1 and 2 */
+    uint8_t regs[SDIO_SLAVE_SIM_REG_SPACE];     /* SLCHOST registers as last written */
+    uint32_t slc[0x80];                         /* Registers behind the window, by word index */
+    uint32_t int_raw0;
+    uint32_t int_raw1;
+
+    /* Host to slave */
+    uint8_t tx_asm[EXT_CONN_BT_SDIO_FUNC + 1][SDIO_SLAVE_SIM_PKT_MAX];
+    size_t tx_asm_len[EXT_CONN_BT_SDIO_FUNC + 1];
+    sdio_slave_sim_queue_t tx_q[EXT_CONN_BT_SDIO_FUNC + 1];
+    uint32_t tx_bufs_used;                      /* Slave buffers holding packets not popped yet */
+    uint32_t token;                             /* Buffers ever released, TOKEN_RDATA[27:16] */
+
+    /* Slave to host */
+    uint8_t rx_stream[SDIO_SLAVE_SIM_PKT_MAX * 2];
+    size_t rx_pending;                          /* Function 1 bytes not read yet */
+    size_t rx_read_left;                        /* Bytes the read in progress still takes */
+    uint32_t pkt_len;                           /* Function 1 bytes ever queued, PKT_LEN[19:0] */
+    sdio_slave_sim_queue_t bt_rx_q;
+    size_t bt_rx_off;                           /* Bytes of the head BT packet already read */
+
+    /* Behaviour the test sets up */
+    uint16_t max_block_size;                    /* The FBR clamps the block size to this */
+    int go_idle_fails;                          /* CMD0 answers that are lost before one gets through */
+    int fail_in;                                /* The CMD53 this many commands from now fails, -1 never */
+    esp_err_t fail_err;
+    bool boot_handshake;                        /* Answer SIP_CMD_BOOTUP with SIP_EVT_BOOTUP */
+    sdio_slave_sim_target_t target;             /* Packets are only queued when NULL */
+    void *target_arg;
+    sdio_slave_sim_preempt_t after_reg_read;    /* Not run again from within itself */
+    void *after_reg_read_arg;
+    uint32_t cmd_ns;                            /* Bus time of a command, its response and the driver around it */
+
+    /* Counters */
+    uint32_t cmd52;
+    uint32_t cmd53;
+    uint32_t aborts;
+    uint32_t tx_overflows;                      /* Packets written without a free slave buffer */
+    uint32_t data_bounces;                      /* Packet data CMD53s the SDMMC DMA could not take as is */
+    uint32_t clk_khz;
+    uint64_t bus_ns;                            /* Time the 4-bit bus was busy at clk_khz, not slept */
+};
+
+extern const esp_extconn_sdio_ops_t sdio_slave_sim_ops;
+
+/* Power on state: counters at 0, every buffer free, nothing queued */
+void sdio_slave_sim_reset(sdio_slave_sim_t *sim);
+
+/* Queue a packet for the host, raising the new packet interrupt of the function */
+esp_err_t sdio_slave_sim_push(sdio_slave_sim_t *sim, uint32_t function, const void *data, size_t len);
+
+/* Take the oldest packet the host sent on the function, freeing its buffers. 0 if none */
+size_t sdio_slave_sim_pop(sdio_slave_sim_t *sim, uint32_t function, void *buf, size_t size);
+
+/* Packets the host sent on the function that were not popped yet */
+int sdio_slave_sim_tx_count(sdio_slave_sim_t *sim, uint32_t function);
+
+/* Fail the CMD53 after the next n ones with err, as a bus error would */
+void sdio_slave_sim_fail(sdio_slave_sim_t *sim, int n, esp_err_t err);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SDIO_SLAVE_SIM_H__ */
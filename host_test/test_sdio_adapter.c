@@ -0,0 +1,411 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sd_protocol_defs.h"
+#include "esp_bit_defs.h"
+#include "esp_timer.h"
+#include "esp_extconn.h"
+#include "ext_sdio_adapter.h"
+#include "sdio_host_reg.h"
+#include "sip2_common.h"
+#include "sdio_slave_sim.h"
+#include "test_utils.h"
+
+#define TEST_BUF_LEN    (8 * 1024)
+
+static sdio_slave_sim_t s_sim;
+static uint8_t *s_tx;
+static uint8_t *s_rx;
+static uint8_t s_check[TEST_BUF_LEN];
+
+static void fill(uint8_t *buf, size_t len, uint8_t seed)
+{
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = (uint8_t)(seed + i * 7);
+    }
+}
+
+static int start(void)
+{
+    sdio_slave_sim_reset(&s_sim);
+    TEST_ASSERT_EQ(ESP_OK, esp_extconn_sdio_init_ops(&sdio_slave_sim_ops, &s_sim, false));
+    return 0;
+}
+
+static uint32_t credits(void)
+{
+    uint32_t num = 0;
+
+    if (esp_extconn_sdio_get_buffer_size(&num) != ESP_OK) {
+        return UINT32_MAX;
+    }
+    return num;
+}
+
+static int test_init_sets_up_slave(void)
+{
+    TEST_ASSERT(start() == 0);
+
+    TEST_ASSERT_EQ(BIT(1) | BIT(2), s_sim.cccr[SD_IO_CCCR_FN_ENABLE]);
+    TEST_ASSERT_EQ(BIT(0) | BIT(1) | BIT(2), s_sim.cccr[SD_IO_CCCR_INT_ENABLE]);
+    TEST_ASSERT_EQ(CONFIG_ESP_EXT_CONN_SDIO_BLOCK_SIZE, esp_extconn_sdio_get_block_size(EXT_CONN_WIFI_SDIO_FUNC));
+    TEST_ASSERT_EQ(CONFIG_ESP_EXT_CONN_SDIO_BLOCK_SIZE, esp_extconn_sdio_get_block_size(EXT_CONN_BT_SDIO_FUNC));
+
+    TEST_ASSERT(s_sim.slc[ESP_SLC_CONF1_REG >> 2] & SLC_SLC0_RX_STITCH_EN);
+    TEST_ASSERT(s_sim.slc[ESP_SLC_CONF1_REG >> 2] & SLC_SLC0_TX_STITCH_EN);
+    TEST_ASSERT(s_sim.slc[ESP_SLC_0_LEN_CONF_REG >> 2] & SLC_SLC0_TX_PACKET_LOAD_EN);
+
+    uint32_t int_ena = 0;
+    memcpy(&int_ena, &s_sim.regs[ESP_SDIO_FUNC1_INT_ENA], sizeof(int_ena));
+    TEST_ASSERT(int_ena & SLCHOST_FN1_GPIO_SDIO_INT_ENA);
+
+    TEST_ASSERT_EQ(SDIO_SLAVE_SIM_TX_BUFS, credits());
+    return 0;
+}
+
+static int test_init_waits_for_cmd0(void)
+{
+    sdio_slave_sim_reset(&s_sim);
+    s_sim.go_idle_fails = 3;
+    TEST_ASSERT_EQ(ESP_OK, esp_extconn_sdio_init_ops(&sdio_slave_sim_ops, &s_sim, false));
+    TEST_ASSERT_EQ(0, s_sim.go_idle_fails);
+    return 0;
+}
+
+static int test_block_size_clamped(void)
+{
+    sdio_slave_sim_reset(&s_sim);
+    s_sim.max_block_size = 256;
+    TEST_ASSERT_EQ(ESP_OK, esp_extconn_sdio_init_ops(&sdio_slave_sim_ops, &s_sim, false));
+    TEST_ASSERT_EQ(256, esp_extconn_sdio_get_block_size(EXT_CONN_WIFI_SDIO_FUNC));
+
+    /* Two blocks and a tail at the smaller block size still make one packet */
+    fill(s_tx, 700, 3);
+    TEST_ASSERT_EQ(ESP_OK, esp_extconn_sdio_send_packet(EXT_CONN_WIFI_SDIO_FUNC, s_tx, 700));
+    TEST_ASSERT_EQ(700, sdio_slave_sim_pop(&s_sim, EXT_CONN_WIFI_SDIO_FUNC, s_check, sizeof(s_check)));
+    TEST_ASSERT(memcmp(s_tx, s_check, 700) == 0);
+    return 0;
+}
+
+static int test_send_uses_credits(void)
+{
+    TEST_ASSERT(start() == 0);
+
+    fill(s_tx, 1500, 1);
+    TEST_ASSERT_EQ(ESP_OK, esp_extconn_sdio_send_packet(EXT_CONN_WIFI_SDIO_FUNC, s_tx, 1500));
+    TEST_ASSERT_EQ(1, sdio_slave_sim_tx_count(&s_sim, EXT_CONN_WIFI_SDIO_FUNC));
+    TEST_ASSERT_EQ(SDIO_SLAVE_SIM_TX_BUFS - 3, credits());
+
+    TEST_ASSERT_EQ(1500, sdio_slave_sim_pop(&s_sim, EXT_CONN_WIFI_SDIO_FUNC, s_check, sizeof(s_check)));
+    TEST_ASSERT(memcmp(s_tx, s_check, 1500) == 0);
+    TEST_ASSERT_EQ(SDIO_SLAVE_SIM_TX_BUFS, credits());
+    TEST_ASSERT_EQ(0, s_sim.tx_overflows);
+    return 0;
+}
+
+static int test_send_frags_one_packet(void)
+{
+    TEST_ASSERT(start() == 0);
+
+    fill(s_tx, 1200, 9);
+    esp_extconn_sdio_frag_t frags[] = {
+        { .buf = s_tx, .length = 12, .size = 12 },
+        { .buf = s_tx + 12, .length = 600, .size = 600 },
+        { .buf = s_tx + 612, .length = 588, .size = 588 },
+    };
+    TEST_ASSERT_EQ(ESP_OK, esp_extconn_sdio_send_frags(EXT_CONN_WIFI_SDIO_FUNC, frags, 3));
+    TEST_ASSERT_EQ(1200, sdio_slave_sim_pop(&s_sim, EXT_CONN_WIFI_SDIO_FUNC, s_check, sizeof(s_check)));
+    TEST_ASSERT(memcmp(s_tx, s_check, 1200) == 0);
+    TEST_ASSERT_EQ(0, sdio_slave_sim_tx_count(&s_sim, EXT_CONN_WIFI_SDIO_FUNC));
+    return 0;
+}
+
+static int test_receive_after_snapshot(void)
+{
+    esp_extconn_sdio_snapshot_t snap;
+    size_t len = 0;
+
+    TEST_ASSERT(start() == 0);
+
+    fill(s_check, 700, 5);
+    TEST_ASSERT_EQ(ESP_OK, sdio_slave_sim_push(&s_sim, EXT_CONN_WIFI_SDIO_FUNC, s_check, 700));
+    TEST_ASSERT_EQ(ESP_OK, esp_extconn_sdio_wait_int(0));
+    TEST_ASSERT_EQ(ESP_OK, esp_extconn_sdio_read_snapshot(&snap));
+    TEST_ASSERT(snap.intr_0 & SLCHOST_SLC0_RX_NEW_PACKET_INT_RAW);
+    TEST_ASSERT_EQ(700, snap.rx_len[EXT_CONN_WIFI_SDIO_FUNC]);
+    TEST_ASSERT_EQ(0, snap.rx_len[EXT_CONN_BT_SDIO_FUNC]);
+
+    TEST_ASSERT_EQ(ESP_OK, esp_extconn_sdio_clear_intr(snap.intr_0, 0));
+    TEST_ASSERT_EQ(0, s_sim.int_raw0);
+
+    TEST_ASSERT_EQ(ESP_OK, esp_extconn_sdio_get_packet(EXT_CONN_WIFI_SDIO_FUNC, s_rx, TEST_BUF_LEN, &len, 0));
+    TEST_ASSERT_EQ(700, len);
+    TEST_ASSERT(memcmp(s_rx, s_check, 700) == 0);
+
+    TEST_ASSERT_EQ(ESP_OK, esp_extconn_sdio_read_snapshot(&snap));
+    TEST_ASSERT_EQ(0, snap.rx_len[EXT_CONN_WIFI_SDIO_FUNC]);
+    TEST_ASSERT_EQ(ESP_ERR_TIMEOUT, esp_extconn_sdio_wait_int(0));
+    return 0;
+}
+
+static int test_receive_truncated(void)
+{
+    size_t len = 0;
+
+    TEST_ASSERT(start() == 0);
+
+    fill(s_check, 3000, 11);
+    TEST_ASSERT_EQ(ESP_OK, sdio_slave_sim_push(&s_sim, EXT_CONN_WIFI_SDIO_FUNC, s_check, 3000));
+
+    /* The rest stays with the slave and is the next read */
+    TEST_ASSERT_EQ(ESP_ERR_NOT_FINISHED, esp_extconn_sdio_get_packet(EXT_CONN_WIFI_SDIO_FUNC, s_rx, 1024, &len, 0));
+    TEST_ASSERT_EQ(1024, len);
+    TEST_ASSERT_EQ(ESP_OK, esp_extconn_sdio_get_packet(EXT_CONN_WIFI_SDIO_FUNC, s_rx + 1024, TEST_BUF_LEN - 1024, &len, 0));
+    TEST_ASSERT_EQ(3000 - 1024, len);
+    TEST_ASSERT(memcmp(s_rx, s_check, 3000) == 0);
+    return 0;
+}
+
+static int test_receive_times_out(void)
+{
+    size_t len = 0;
+
+    TEST_ASSERT(start() == 0);
+
+    int64_t start_us = esp_timer_get_time();
+    TEST_ASSERT_EQ(ESP_ERR_TIMEOUT, esp_extconn_sdio_get_packet(EXT_CONN_WIFI_SDIO_FUNC, s_rx, TEST_BUF_LEN, &len, 5));
+    TEST_ASSERT(esp_timer_get_time() - start_us >= 5000);
+    return 0;
+}
+
+static int test_send_retried_after_crc(void)
+{
+    esp_extconn_sdio_stats_t stats;
+
+    TEST_ASSERT(start() == 0);
+
+    /* The tail of the packet fails, the whole packet is sent again after the abort */
+    fill(s_tx, 1100, 13);
+    sdio_slave_sim_fail(&s_sim, 1, ESP_ERR_INVALID_CRC);
+    TEST_ASSERT_EQ(ESP_OK, esp_extconn_sdio_send_packet(EXT_CONN_WIFI_SDIO_FUNC, s_tx, 1100));
+    TEST_ASSERT_EQ(1, s_sim.aborts);
+    TEST_ASSERT_EQ(1, sdio_slave_sim_tx_count(&s_sim, EXT_CONN_WIFI_SDIO_FUNC));
+    TEST_ASSERT_EQ(1100, sdio_slave_sim_pop(&s_sim, EXT_CONN_WIFI_SDIO_FUNC, s_check, sizeof(s_check)));
+    TEST_ASSERT(memcmp(s_tx, s_check, 1100) == 0);
+
+    TEST_ASSERT_EQ(ESP_OK, esp_extconn_get_sdio_stats(&stats));
+    TEST_ASSERT_EQ(1, stats.errors);
+    TEST_ASSERT_EQ(1, stats.retries);
+    TEST_ASSERT_EQ(0, stats.failures);
+    TEST_ASSERT_EQ(SDIO_SLAVE_SIM_TX_BUFS, credits());
+    return 0;
+}
+
+static int test_send_retried_after_lost_response(void)
+{
+    TEST_ASSERT(start() == 0);
+
+    /* The blocks went through, the tail response is lost: the abort still drops them before the resend */
+    fill(s_tx, 1100, 23);
+    sdio_slave_sim_fail(&s_sim, 1, ESP_ERR_INVALID_RESPONSE);
+    TEST_ASSERT_EQ(ESP_OK, esp_extconn_sdio_send_packet(EXT_CONN_WIFI_SDIO_FUNC, s_tx, 1100));
+    TEST_ASSERT_EQ(1, s_sim.aborts);
+    TEST_ASSERT_EQ(1, sdio_slave_sim_tx_count(&s_sim, EXT_CONN_WIFI_SDIO_FUNC));
+    TEST_ASSERT_EQ(1100, sdio_slave_sim_pop(&s_sim, EXT_CONN_WIFI_SDIO_FUNC, s_check, sizeof(s_check)));
+    TEST_ASSERT(memcmp(s_tx, s_check, 1100) == 0);
+    TEST_ASSERT_EQ(SDIO_SLAVE_SIM_TX_BUFS, credits());
+    return 0;
+}
+
+static int test_lost_read_keeps_counters(void)
+{
+    esp_extconn_sdio_stats_t stats;
+    size_t len = 0;
+
+    TEST_ASSERT(start() == 0);
+
+    fill(s_check, 900, 17);
+    TEST_ASSERT_EQ(ESP_OK, sdio_slave_sim_push(&s_sim, EXT_CONN_WIFI_SDIO_FUNC, s_check, 900));
+    /* The length read goes through, the data read does not */
+    sdio_slave_sim_fail(&s_sim, 1, ESP_ERR_INVALID_CRC);
+    TEST_ASSERT_EQ(ESP_ERR_INVALID_CRC, esp_extconn_sdio_get_packet(EXT_CONN_WIFI_SDIO_FUNC, s_rx, TEST_BUF_LEN, &len, 0));
+
+    fill(s_check, 400, 19);
+    TEST_ASSERT_EQ(ESP_OK, sdio_slave_sim_push(&s_sim, EXT_CONN_WIFI_SDIO_FUNC, s_check, 400));
+    TEST_ASSERT_EQ(ESP_OK, esp_extconn_sdio_get_packet(EXT_CONN_WIFI_SDIO_FUNC, s_rx, TEST_BUF_LEN, &len, 0));
+    TEST_ASSERT_EQ(400, len);
+    TEST_ASSERT(memcmp(s_rx, s_check, 400) == 0);
+
+    TEST_ASSERT_EQ(ESP_OK, esp_extconn_get_sdio_stats(&stats));
+    TEST_ASSERT_EQ(1, stats.failures);
+    TEST_ASSERT_EQ(0, stats.resyncs);
+    return 0;
+}
+
+static int test_counters_wrap(void)
+{
+    size_t len = 0;
+
+    TEST_ASSERT(start() == 0);
+
+    /* More than TX_BUFFER_MAX credits and RX_BYTE_MAX bytes, both counters wrap */
+    for (int i = 0; i < TX_BUFFER_MAX + 100; i++) {
+        TEST_ASSERT_EQ(ESP_OK, esp_extconn_sdio_send_packet(EXT_CONN_WIFI_SDIO_FUNC, s_tx, 64));
+        TEST_ASSERT_EQ(SDIO_SLAVE_SIM_TX_BUFS - 1, credits());
+        TEST_ASSERT_EQ(64, sdio_slave_sim_pop(&s_sim, EXT_CONN_WIFI_SDIO_FUNC, s_check, sizeof(s_check)));
+    }
+    for (int i = 0; i < RX_BYTE_MAX / 4096 + 10; i++) {
+        fill(s_check, 4096, i);
+        TEST_ASSERT_EQ(ESP_OK, sdio_slave_sim_push(&s_sim, EXT_CONN_WIFI_SDIO_FUNC, s_check, 4096));
+        TEST_ASSERT_EQ(ESP_OK, esp_extconn_sdio_get_packet(EXT_CONN_WIFI_SDIO_FUNC, s_rx, TEST_BUF_LEN, &len, 0));
+        TEST_ASSERT_EQ(4096, len);
+        TEST_ASSERT(memcmp(s_rx, s_check, 4096) == 0);
+    }
+    return 0;
+}
+
+static int test_warm_init_keeps_counters(void)
+{
+    TEST_ASSERT(start() == 0);
+
+    fill(s_tx, 1024, 23);
+    TEST_ASSERT_EQ(ESP_OK, esp_extconn_sdio_send_packet(EXT_CONN_WIFI_SDIO_FUNC, s_tx, 1024));
+    TEST_ASSERT_EQ(1024, sdio_slave_sim_pop(&s_sim, EXT_CONN_WIFI_SDIO_FUNC, s_check, sizeof(s_check)));
+
+    /* The slave kept running, a warm attach continues from the same credit count */
+    TEST_ASSERT_EQ(ESP_OK, esp_extconn_sdio_init_ops(&sdio_slave_sim_ops, &s_sim, true));
+    TEST_ASSERT_EQ(SDIO_SLAVE_SIM_TX_BUFS, credits());
+    return 0;
+}
+
+static int test_bt_round_trip(void)
+{
+    esp_extconn_sdio_snapshot_t snap;
+    size_t len = 0;
+
+    TEST_ASSERT(start() == 0);
+
+    /* The slave finds the end of a BT packet from the length in its first word */
+    uint32_t word = 600;
+    fill(s_tx, 600, 29);
+    memcpy(s_tx, &word, sizeof(word));
+    TEST_ASSERT_EQ(ESP_OK, esp_extconn_sdio_send_packet(EXT_CONN_BT_SDIO_FUNC, s_tx, 600));
+    TEST_ASSERT_EQ(600, sdio_slave_sim_pop(&s_sim, EXT_CONN_BT_SDIO_FUNC, s_check, sizeof(s_check)));
+    TEST_ASSERT(memcmp(s_tx, s_check, 600) == 0);
+
+    fill(s_check, 258, 31);
+    TEST_ASSERT_EQ(ESP_OK, sdio_slave_sim_push(&s_sim, EXT_CONN_BT_SDIO_FUNC, s_check, 258));
+    TEST_ASSERT_EQ(ESP_OK, esp_extconn_sdio_read_snapshot(&snap));
+    TEST_ASSERT(snap.intr_1 & SLCHOST_SLC1_BT_RX_NEW_PACKET_INT_RAW);
+    TEST_ASSERT_EQ(258, snap.rx_len[EXT_CONN_BT_SDIO_FUNC]);
+    TEST_ASSERT_EQ(ESP_OK, esp_extconn_sdio_get_packet(EXT_CONN_BT_SDIO_FUNC, s_rx, TEST_BUF_LEN, &len, 0));
+    TEST_ASSERT_EQ(258, len);
+    TEST_ASSERT(memcmp(s_rx, s_check, 258) == 0);
+    TEST_ASSERT_EQ(0, s_sim.bt_rx_q.count);
+    return 0;
+}
+
+static int test_sip_bootup_handshake(void)
+{
+    struct {
+        struct sip_hdr hdr;
+        struct sip_cmd_bootup cmd;
+    } __packed *frame = (void *)s_tx;
+    size_t len = 0;
+
+    TEST_ASSERT(start() == 0);
+
+    memset(frame, 0, sizeof(*frame));
+    SIP_HDR_SET_TYPE(frame->hdr.fc[0], SIP_CTRL);
+    frame->hdr.len = sizeof(*frame);
+    frame->hdr.c_cmdid = SIP_CMD_BOOTUP;
+    frame->cmd.boot_addr = 0x40100000;
+    TEST_ASSERT_EQ(ESP_OK, esp_extconn_sdio_send_packet(EXT_CONN_WIFI_SDIO_FUNC, frame, sizeof(*frame)));
+    TEST_ASSERT_EQ(0, sdio_slave_sim_tx_count(&s_sim, EXT_CONN_WIFI_SDIO_FUNC));
+
+    TEST_ASSERT_EQ(ESP_OK, esp_extconn_sdio_wait_int(0));
+    TEST_ASSERT_EQ(ESP_OK, esp_extconn_sdio_get_packet(EXT_CONN_WIFI_SDIO_FUNC, s_rx, TEST_BUF_LEN, &len, 0));
+    const struct sip_hdr *evt = (const struct sip_hdr *)s_rx;
+    TEST_ASSERT_EQ(SIP_CTRL_HDR_LEN + sizeof(struct sip_evt_bootup2), len);
+    TEST_ASSERT(SIP_HDR_IS_CTRL(evt));
+    TEST_ASSERT_EQ(SIP_EVT_BOOTUP, evt->c_evtid);
+    TEST_ASSERT_EQ(len, evt->len);
+
+    const struct sip_evt_bootup2 *bootup = (const struct sip_evt_bootup2 *)(s_rx + SIP_CTRL_HDR_LEN);
+    TEST_ASSERT_EQ(esp_extconn_sdio_get_block_size(EXT_CONN_WIFI_SDIO_FUNC), bootup->tx_blksz);
+    TEST_ASSERT_EQ(SDIO_SLAVE_SIM_TX_BUFS, credits());
+    return 0;
+}
+
+/* Interrupt clears of bits the slave never raised, two bytes each register so one CMD53 takes both */
+static void clear_unraised(sdio_slave_sim_t *sim, void *arg)
+{
+    esp_extconn_sdio_clear_intr(0xaa000000, 0x01000100);
+}
+
+/* Register transfers of callers without the SDIO lock, as on the boot path, do not share a buffer */
+static int test_reg_buffers_per_caller(void)
+{
+    size_t len = 0;
+
+    TEST_ASSERT(start() == 0);
+
+    fill(s_check, 700, 9);
+    TEST_ASSERT_EQ(ESP_OK, sdio_slave_sim_push(&s_sim, EXT_CONN_WIFI_SDIO_FUNC, s_check, 700));
+    /* Between the packet length read and its decode */
+    s_sim.after_reg_read = clear_unraised;
+    TEST_ASSERT_EQ(ESP_OK, esp_extconn_sdio_get_packet(EXT_CONN_WIFI_SDIO_FUNC, s_rx, TEST_BUF_LEN, &len, 0));
+    s_sim.after_reg_read = NULL;
+    TEST_ASSERT_EQ(700, len);
+    TEST_ASSERT(memcmp(s_rx, s_check, 700) == 0);
+    return 0;
+}
+
+static const struct {
+    const char *name;
+    int (*fn)(void);
+} s_tests[] = {
+    { "init_sets_up_slave", test_init_sets_up_slave },
+    { "init_waits_for_cmd0", test_init_waits_for_cmd0 },
+    { "block_size_clamped", test_block_size_clamped },
+    { "send_uses_credits", test_send_uses_credits },
+    { "send_frags_one_packet", test_send_frags_one_packet },
+    { "receive_after_snapshot", test_receive_after_snapshot },
+    { "receive_truncated", test_receive_truncated },
+    { "receive_times_out", test_receive_times_out },
+    { "send_retried_after_crc", test_send_retried_after_crc },
+    { "send_retried_after_lost_response", test_send_retried_after_lost_response },
+    { "lost_read_keeps_counters", test_lost_read_keeps_counters },
+    { "counters_wrap", test_counters_wrap },
+    { "warm_init_keeps_counters", test_warm_init_keeps_counters },
+    { "bt_round_trip", test_bt_round_trip },
+    { "sip_bootup_handshake", test_sip_bootup_handshake },
+    { "reg_buffers_per_caller", test_reg_buffers_per_caller },
+};
+
+int main(void)
+{
+    int failed = 0;
+    size_t n = sizeof(s_tests) / sizeof(s_tests[0]);
+
+    s_tx = esp_extconn_sdio_dma_alloc(TEST_BUF_LEN, NULL);
+    s_rx = esp_extconn_sdio_dma_alloc(TEST_BUF_LEN, NULL);
+    if (s_tx == NULL || s_rx == NULL) {
+        return 1;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        int rc = s_tests[i].fn();
+        printf("%-28s %s\n", s_tests[i].name, rc ? "FAIL" : "ok");
+        failed += rc ? 1 : 0;
+    }
+    printf("%zu tests, %d failed\n", n, failed);
+    return failed ? 1 : 0;
+}
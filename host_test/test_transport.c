@@ -0,0 +1,773 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "esp_extconn.h"
+#include "esp_sip.h"
+#include "esp_timer.h"
+#include "ext_default.h"
+#include "ext_sdio_adapter.h"
+#include "sdio_host_reg.h"
+#include "sip2_common.h"
+#include "host_boot.h"
+#include "host_stack.h"
+#include "sdio_slave_sim.h"
+#include "test_utils.h"
+
+/*
+ * The transport tasks run as threads against the simulated slave. They can not be
+ * stopped, so every test runs in a process of its own: test_transport <name>.
+ */
+
+#define TEST_WAIT_MS        (2000)
+#define TEST_FW_ADDR        (0x40100000)
+#define TEST_FW_LEN         (10 * 1024 + 6)
+#define TEST_FRAME_MAX      (2048)
+
+static sdio_slave_sim_t s_sim;
+
+/* Target side of the download, the memory the frames were written to */
+static struct {
+    uint8_t mem[TEST_FW_LEN + 4];
+    uint32_t frames;
+    uint32_t next_seq;
+    bool bad;
+} s_fw;
+
+static void fill(uint8_t *buf, size_t len, uint8_t seed)
+{
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = (uint8_t)(seed + i * 7);
+    }
+}
+
+static bool target_write_mem(sdio_slave_sim_t *sim, const uint8_t *pkt, size_t len, void *arg)
+{
+    const struct sip_hdr *hdr = (const struct sip_hdr *)pkt;
+    const struct sip_cmd_write_memory *cmd = (const struct sip_cmd_write_memory *)(pkt + SIP_CTRL_HDR_LEN);
+
+    if (!SIP_HDR_IS_CTRL(hdr) || hdr->c_cmdid != SIP_CMD_WRITE_MEMORY) {
+        return false;
+    }
+    /* Block mode pads a frame to whole blocks, the firmware goes by the length in the header */
+    if (hdr->seq != s_fw.next_seq++ || hdr->len > len || hdr->len != SIP_CTRL_HDR_LEN + sizeof(*cmd) + cmd->len ||
+            cmd->addr < TEST_FW_ADDR || cmd->addr - TEST_FW_ADDR + cmd->len > sizeof(s_fw.mem)) {
+        s_fw.bad = true;
+        return true;
+    }
+    memcpy(&s_fw.mem[cmd->addr - TEST_FW_ADDR], pkt + SIP_CTRL_HDR_LEN + sizeof(*cmd), cmd->len);
+    s_fw.frames++;
+    return true;
+}
+
+/* Bus up, SIP state reset, nothing running yet: where the boot path downloads */
+static int start_bus(void)
+{
+    sdio_slave_sim_reset(&s_sim);
+    TEST_ASSERT_EQ(ESP_OK, esp_extconn_sdio_init_ops(&sdio_slave_sim_ops, &s_sim, false));
+    TEST_ASSERT_EQ(ESP_OK, esp_sip_init());
+    return 0;
+}
+
+/* The transport as esp_extconn_fw_init leaves it, booted and with its tasks running */
+static int start(void)
+{
+    esp_extconn_config_t config = ESP_EXTCONN_CONFIG_DEFAULT();
+
+    TEST_ASSERT(start_bus() == 0);
+    TEST_ASSERT_EQ(ESP_OK, esp_extconn_trans_recv_init(&config));
+    TEST_ASSERT_EQ(ESP_OK, esp_extconn_trans_wifi_init(&config));
+    TEST_ASSERT_EQ(ESP_OK, esp_sip_bootup(TEST_FW_ADDR));
+    TEST_ASSERT(esp_sip_is_running());
+    TEST_ASSERT(host_stack.tx_data != NULL);
+    return 0;
+}
+
+/* A data frame of the target, seq and a payload of len bytes after the header */
+static size_t data_frame(uint8_t *buf, uint32_t seq, size_t len)
+{
+    struct sip_hdr *hdr = (struct sip_hdr *)buf;
+
+    memset(hdr, 0, SIP_CTRL_HDR_LEN);
+    SIP_HDR_SET_TYPE(hdr->fc[0], SIP_DATA);
+    hdr->len = SIP_CTRL_HDR_LEN + len;
+    hdr->seq = seq;
+    fill(buf + SIP_CTRL_HDR_LEN, len, seq);
+    return hdr->len;
+}
+
+/* An event of the target with a payload of len bytes */
+static size_t event_frame(uint8_t *buf, uint8_t evtid, uint32_t seq, size_t len)
+{
+    struct sip_hdr *hdr = (struct sip_hdr *)buf;
+
+    memset(buf, 0, SIP_CTRL_HDR_LEN + len);
+    SIP_HDR_SET_TYPE(hdr->fc[0], SIP_CTRL);
+    hdr->c_evtid = evtid;
+    hdr->len = SIP_CTRL_HDR_LEN + len;
+    hdr->seq = seq;
+    return hdr->len;
+}
+
+/* The running firmware of a warm attach: an event it had queued, then the answer to the probe */
+static bool target_running(sdio_slave_sim_t *sim, const uint8_t *pkt, size_t len, void *arg)
+{
+    const struct sip_hdr *hdr = (const struct sip_hdr *)pkt;
+    uint8_t answer = *(const uint8_t *)arg;
+    uint8_t burst[64];
+    size_t n = 0;
+
+    if (!SIP_HDR_IS_CTRL(hdr) || hdr->c_cmdid != SIP_CMD_HB_REQ || hdr->fc[1] != SIP_HDR_F_SYNC || hdr->seq != 0) {
+        return false;
+    }
+    n += event_frame(burst + n, SIP_EVT_DEBUG, 6, 4);
+    n += event_frame(burst + n, answer, 7, 4);
+    sdio_slave_sim_push(sim, EXT_CONN_WIFI_SDIO_FUNC, burst, n);
+    return true;
+}
+
+static int test_sip_bootup(void)
+{
+    struct sip_evt_bootup2 bevt;
+
+    TEST_ASSERT(start() == 0);
+
+    TEST_ASSERT_EQ(ESP_OK, esp_sip_get_boot_info(&bevt));
+    TEST_ASSERT_EQ(esp_extconn_sdio_get_block_size(EXT_CONN_WIFI_SDIO_FUNC), bevt.tx_blksz);
+    TEST_ASSERT_EQ(bevt.tx_blksz, esp_sip_get_tx_blks());
+    TEST_ASSERT_EQ(0x10, esp_extconn_get_mac()[0]);
+    return 0;
+}
+
+static int test_sip_cmd(void)
+{
+    uint8_t frame[64];
+    uint32_t hb = 0x12345678;
+
+    TEST_ASSERT(start() == 0);
+
+    TEST_ASSERT_EQ(ESP_OK, esp_sip_send_cmd(SIP_CMD_HB_REQ, sizeof(hb), &hb));
+    TEST_ASSERT_EQ(SIP_CTRL_HDR_LEN + sizeof(hb), sdio_slave_sim_pop(&s_sim, EXT_CONN_WIFI_SDIO_FUNC, frame, sizeof(frame)));
+    const struct sip_hdr *hdr = (const struct sip_hdr *)frame;
+    TEST_ASSERT(SIP_HDR_IS_CTRL(hdr));
+    TEST_ASSERT_EQ(SIP_CMD_HB_REQ, hdr->c_cmdid);
+    TEST_ASSERT_EQ(SIP_CTRL_HDR_LEN + sizeof(hb), hdr->len);
+    TEST_ASSERT(memcmp(frame + SIP_CTRL_HDR_LEN, &hb, sizeof(hb)) == 0);
+    return 0;
+}
+
+/* Commands of the Wi-Fi stack are queued like data and sent by wifi_send_task */
+static int test_wifi_cmd(void)
+{
+    uint8_t frame[TEST_FRAME_MAX];
+    struct sip_cmd_setkey key = { .alg = 3, .keyidx = 1, .keylen = 16 };
+
+    TEST_ASSERT(start() == 0);
+
+    TEST_ASSERT_EQ(ESP_OK, host_stack.tx_cmd(SIP_CMD_SETKEY, sizeof(key), &key));
+    TEST_ASSERT(host_stack_wait(&host_stack.tx_done, 1, TEST_WAIT_MS));
+    size_t len = sdio_slave_sim_pop(&s_sim, EXT_CONN_WIFI_SDIO_FUNC, frame, sizeof(frame));
+    TEST_ASSERT_EQ(esp_sip_get_tx_blks(), len);
+    const struct sip_hdr *hdr = (const struct sip_hdr *)frame;
+    TEST_ASSERT(SIP_HDR_IS_CTRL(hdr));
+    TEST_ASSERT_EQ(SIP_CMD_SETKEY, hdr->c_cmdid);
+    TEST_ASSERT_EQ(SIP_CTRL_HDR_LEN + sizeof(key), hdr->len);
+    TEST_ASSERT(memcmp(frame + SIP_CTRL_HDR_LEN, &key, sizeof(key)) == 0);
+    return 0;
+}
+
+/* Send a frame of len bytes at offset into a buffer of size, sent_len is what the slave gets */
+static int wifi_tx_check(size_t offset, size_t len, size_t size, size_t sent_len, uint32_t bounces)
+{
+    uint8_t frame[TEST_FRAME_MAX];
+    esf_buf_t *eb = host_stack_tx_alloc(offset, len, size);
+
+    TEST_ASSERT(eb != NULL);
+    fill((uint8_t *)eb->u_data_start, size, 37);
+    TO_TX_DESC(eb)->tid = 5;
+    TO_TX_DESC(eb)->ac = 2;
+
+    uint32_t before = s_sim.data_bounces;
+    uint32_t done = host_stack.tx_done;
+    TEST_ASSERT_EQ(ESP_OK, host_stack.tx_data(eb));
+    TEST_ASSERT(host_stack_wait(&host_stack.tx_done, done + 1, TEST_WAIT_MS));
+
+    TEST_ASSERT_EQ(sent_len, sdio_slave_sim_pop(&s_sim, EXT_CONN_WIFI_SDIO_FUNC, frame, sizeof(frame)));
+    const struct sip_hdr *hdr = (const struct sip_hdr *)frame;
+    TEST_ASSERT(SIP_HDR_IS_DATA(hdr));
+    TEST_ASSERT_EQ(SIP_CTRL_HDR_LEN + len, hdr->len);
+    TEST_ASSERT_EQ(5, hdr->d_tid);
+    TEST_ASSERT_EQ(2, hdr->d_ac);
+    TEST_ASSERT(memcmp(frame + SIP_CTRL_HDR_LEN, (const void *)eb->u_data_start, len) == 0);
+    TEST_ASSERT_EQ(bounces, s_sim.data_bounces - before);
+    host_stack_tx_free(eb);
+    return 0;
+}
+
+static int test_wifi_tx_copy(void)
+{
+    TEST_ASSERT(start() == 0);
+    /* No room to pad the tail to a cache line */
+    TEST_ASSERT(wifi_tx_check(0, 1500, 1500, roundup(SIP_CTRL_HDR_LEN + 1500, esp_sip_get_tx_blks()), 0) == 0);
+    /* Under a block */
+    return wifi_tx_check(0, 300, 2048, roundup(SIP_CTRL_HDR_LEN + 300, esp_sip_get_tx_blks()), 0);
+}
+
+static int test_wifi_tx_zero_copy(void)
+{
+    TEST_ASSERT(start() == 0);
+    /* The payload on a cache line, only the header goes through a bounce buffer */
+    TEST_ASSERT(wifi_tx_check(0, 1500, 1600, SIP_CTRL_HDR_LEN + 1536, 1) == 0);
+    /* The frame on a cache line, the header and the first 52 payload bytes make one */
+    TEST_ASSERT(wifi_tx_check(SIP_CTRL_HDR_LEN, 1500, 1600, SIP_CTRL_HDR_LEN + 52 + 1536, 0) == 0);
+    /* Anywhere else the payload up to its next cache line is copied with the header */
+    TEST_ASSERT(wifi_tx_check(8, 1024, 1600, SIP_CTRL_HDR_LEN + 56 + 1024, 1) == 0);
+    /* No room for whole blocks, the tail is sent padded to a cache line */
+    return wifi_tx_check(0, 1400, 1450, SIP_CTRL_HDR_LEN + 1400, 1);
+}
+
+static int test_recv_burst(void)
+{
+    uint8_t burst[4096];
+    size_t len = 0;
+    esp_extconn_rx_stats_t stats;
+
+    TEST_ASSERT(start() == 0);
+
+    /* The bootup event took seq 0 */
+    for (uint32_t seq = 1; seq <= 4; seq++) {
+        len += data_frame(burst + len, seq, 300 + seq * 4);
+    }
+    TEST_ASSERT_EQ(ESP_OK, sdio_slave_sim_push(&s_sim, EXT_CONN_WIFI_SDIO_FUNC, burst, len));
+    TEST_ASSERT(host_stack_wait(&host_stack.rx_frames, 4, TEST_WAIT_MS));
+    for (uint32_t i = 0; i < 4; i++) {
+        TEST_ASSERT_EQ(i + 1, host_stack.rx_seq[i]);
+    }
+
+    TEST_ASSERT_EQ(ESP_OK, esp_extconn_get_rx_stats(&stats));
+    TEST_ASSERT(stats.irq_wakeups >= 2);
+    TEST_ASSERT_EQ(0, stats.seq_gaps);
+    TEST_ASSERT_EQ(0, stats.bad_frames);
+    return 0;
+}
+
+/* More data than a receive buffer holds: the frame the buffer end cuts leads the next read */
+static int test_recv_split(void)
+{
+    static uint8_t burst[2][20 * 1024];
+    esp_extconn_rx_stats_t stats;
+    uint32_t seq = 1;
+
+    TEST_ASSERT(start() == 0);
+
+    /* Both queued before the host reads, more than the 32 KB the receive buffer takes */
+    pthread_mutex_lock(&s_sim.lock);
+    for (int i = 0; i < 2; i++) {
+        size_t len = 0;
+
+        while (len + SIP_CTRL_HDR_LEN + 1000 <= sizeof(burst[i])) {
+            len += data_frame(burst[i] + len, seq++, 1000);
+        }
+        TEST_ASSERT_EQ(ESP_OK, sdio_slave_sim_push(&s_sim, EXT_CONN_WIFI_SDIO_FUNC, burst[i], len));
+    }
+    pthread_mutex_unlock(&s_sim.lock);
+    TEST_ASSERT(host_stack_wait(&host_stack.rx_frames, seq - 1, TEST_WAIT_MS));
+    for (uint32_t i = 0; i < seq - 1; i++) {
+        TEST_ASSERT_EQ(i + 1, host_stack.rx_seq[i]);
+    }
+
+    TEST_ASSERT_EQ(ESP_OK, esp_extconn_get_rx_stats(&stats));
+    TEST_ASSERT(stats.split_bursts >= 1);
+    TEST_ASSERT_EQ(0, stats.bad_frames);
+    TEST_ASSERT_EQ(0, stats.seq_gaps);
+    return 0;
+}
+
+/* The running firmware answering every sync flagged heartbeat request, with the seq in arg */
+static bool target_resync(sdio_slave_sim_t *sim, const uint8_t *pkt, size_t len, void *arg)
+{
+    const struct sip_hdr *hdr = (const struct sip_hdr *)pkt;
+    uint32_t *seq = arg;
+    uint8_t ack[SIP_CTRL_HDR_LEN + 4];
+
+    if (!SIP_HDR_IS_CTRL(hdr) || hdr->c_cmdid != SIP_CMD_HB_REQ || !SIP_HDR_IS_SYNC(hdr)) {
+        return false;
+    }
+    sdio_slave_sim_push(sim, EXT_CONN_WIFI_SDIO_FUNC, ack, event_frame(ack, SIP_EVT_HB_ACK, (*seq)++, 4));
+    return true;
+}
+
+static int wait_rx_stats(esp_extconn_rx_stats_t *stats, const uint32_t *counter, uint32_t n)
+{
+    for (int i = 0; i < TEST_WAIT_MS; i++) {
+        TEST_ASSERT_EQ(ESP_OK, esp_extconn_get_rx_stats(stats));
+        if (*counter >= n) {
+            return 0;
+        }
+        usleep(1000);
+    }
+    return -1;
+}
+
+#if CONFIG_ESP_EXT_CONN_RECV_POLL_US > 0
+/* A burst right after another is found by polling, and polling sleeps between status reads */
+static int test_recv_poll(void)
+{
+    esp_extconn_rx_stats_t stats;
+    uint8_t burst[256];
+
+    TEST_ASSERT(start() == 0);
+
+    TEST_ASSERT_EQ(ESP_OK, sdio_slave_sim_push(&s_sim, EXT_CONN_WIFI_SDIO_FUNC, burst, data_frame(burst, 1, 100)));
+    TEST_ASSERT(host_stack_wait(&host_stack.rx_frames, 1, TEST_WAIT_MS));
+    TEST_ASSERT_EQ(ESP_OK, sdio_slave_sim_push(&s_sim, EXT_CONN_WIFI_SDIO_FUNC, burst, data_frame(burst, 2, 100)));
+    TEST_ASSERT(host_stack_wait(&host_stack.rx_frames, 2, TEST_WAIT_MS));
+
+    /* Both poll windows over, a spin would have read the status thousands of times */
+    usleep(4 * CONFIG_ESP_EXT_CONN_RECV_POLL_US);
+    TEST_ASSERT_EQ(ESP_OK, esp_extconn_get_rx_stats(&stats));
+    TEST_ASSERT(stats.poll_hits >= 1);
+    TEST_ASSERT(stats.polls <= 3 * CONFIG_ESP_EXT_CONN_RECV_POLL_US / 20);
+    return 0;
+}
+#endif
+
+#if CONFIG_ESP_EXT_CONN_RECV_RING_SLOTS > 1
+/* Bursts read so far, whatever woke the receive task */
+static uint32_t rx_bursts(void)
+{
+    esp_extconn_rx_stats_t stats;
+    uint32_t n = 0;
+
+    esp_extconn_get_rx_stats(&stats);
+    for (int i = 0; i < ESP_EXTCONN_RX_LAT_BUCKETS; i++) {
+        n += stats.irq_latency[i] + stats.poll_latency[i];
+    }
+    return n;
+}
+
+/* With every buffer waiting for the worker, BT is still served and Wi-Fi waits in the slave */
+static int test_recv_ring_full(void)
+{
+    esp_extconn_rx_stats_t stats;
+    uint8_t burst[256];
+    uint8_t pkt[64];
+
+    TEST_ASSERT(start() == 0);
+    host_stack.rx_hold = true;
+
+    /* One burst each, after the one of the bootup event */
+    uint32_t bursts = 1;
+    for (int i = 0; i < TEST_WAIT_MS && rx_bursts() < bursts; i++) {
+        usleep(1000);
+    }
+    for (uint32_t seq = 1; seq <= 3; seq++) {
+        TEST_ASSERT_EQ(ESP_OK, sdio_slave_sim_push(&s_sim, EXT_CONN_WIFI_SDIO_FUNC, burst,
+                                                   data_frame(burst, seq, 100)));
+        if (seq < 3) {
+            for (int i = 0; i < TEST_WAIT_MS && rx_bursts() < bursts + seq; i++) {
+                usleep(1000);
+            }
+        }
+    }
+    TEST_ASSERT(wait_rx_stats(&stats, &stats.slot_waits, 1) == 0);
+
+    fill(pkt, sizeof(pkt), 43);
+    TEST_ASSERT_EQ(ESP_OK, sdio_slave_sim_push(&s_sim, EXT_CONN_BT_SDIO_FUNC, pkt, sizeof(pkt)));
+    TEST_ASSERT(host_stack_wait(&host_stack.bt_rx, 1, TEST_WAIT_MS));
+    TEST_ASSERT_EQ(0, host_stack.rx_frames);
+
+    host_stack.rx_hold = false;
+    TEST_ASSERT(host_stack_wait(&host_stack.rx_frames, 3, TEST_WAIT_MS));
+    for (uint32_t i = 0; i < 3; i++) {
+        TEST_ASSERT_EQ(i + 1, host_stack.rx_seq[i]);
+    }
+    return 0;
+}
+#endif
+
+/* Frames missing from a burst are counted, and the target is told with a sync request */
+static int test_recv_seq_gap(void)
+{
+    static uint32_t target_seq = 6;
+    esp_extconn_rx_stats_t stats;
+    uint8_t burst[1024];
+    size_t len = 0;
+
+    TEST_ASSERT(start() == 0);
+    s_sim.target = target_resync;
+    s_sim.target_arg = &target_seq;
+
+    len += data_frame(burst + len, 1, 100);
+    len += data_frame(burst + len, 2, 100);
+    len += data_frame(burst + len, 5, 100);
+    TEST_ASSERT_EQ(ESP_OK, sdio_slave_sim_push(&s_sim, EXT_CONN_WIFI_SDIO_FUNC, burst, len));
+    TEST_ASSERT(host_stack_wait(&host_stack.rx_frames, 3, TEST_WAIT_MS));
+    TEST_ASSERT_EQ(5, host_stack.rx_seq[2]);
+    /* The answer to the request follows the realigned sequence */
+    TEST_ASSERT(wait_rx_stats(&stats, &stats.resync_reqs, 1) == 0);
+    TEST_ASSERT_EQ(1, stats.seq_gaps);
+    TEST_ASSERT_EQ(2, stats.frames_lost);
+    TEST_ASSERT(host_stack_wait(&target_seq, 7, TEST_WAIT_MS));
+    usleep(10 * 1000);
+    TEST_ASSERT_EQ(7, esp_sip_get_rxseq());
+
+    /* The answer completed the handshake, the next loss sends a new request at once */
+    target_seq = 10;
+    len = data_frame(burst, 9, 100);
+    TEST_ASSERT_EQ(ESP_OK, sdio_slave_sim_push(&s_sim, EXT_CONN_WIFI_SDIO_FUNC, burst, len));
+    TEST_ASSERT(wait_rx_stats(&stats, &stats.resync_reqs, 2) == 0);
+    TEST_ASSERT_EQ(2, stats.seq_gaps);
+    TEST_ASSERT_EQ(4, stats.frames_lost);
+    return 0;
+}
+
+/* A malformed length only loses that frame, the scan finds the next one in the burst */
+static int test_recv_bad_len(void)
+{
+    static uint32_t target_seq = 4;
+    esp_extconn_rx_stats_t stats;
+    uint8_t burst[1024];
+    size_t len = 0;
+
+    TEST_ASSERT(start() == 0);
+    s_sim.target = target_resync;
+    s_sim.target_arg = &target_seq;
+
+    len += data_frame(burst + len, 1, 100);
+    struct sip_hdr *bad = (struct sip_hdr *)(burst + len);
+    len += data_frame(burst + len, 2, 200);
+    bad->len = 6;
+    len += data_frame(burst + len, 3, 100);
+    TEST_ASSERT_EQ(ESP_OK, sdio_slave_sim_push(&s_sim, EXT_CONN_WIFI_SDIO_FUNC, burst, len));
+    TEST_ASSERT(host_stack_wait(&host_stack.rx_frames, 2, TEST_WAIT_MS));
+    TEST_ASSERT_EQ(1, host_stack.rx_seq[0]);
+    TEST_ASSERT_EQ(3, host_stack.rx_seq[1]);
+    TEST_ASSERT(wait_rx_stats(&stats, &stats.resync_reqs, 1) == 0);
+    TEST_ASSERT_EQ(1, stats.bad_frames);
+    TEST_ASSERT_EQ(1, stats.seq_gaps);
+    TEST_ASSERT_EQ(1, stats.frames_lost);
+    return 0;
+}
+
+#ifdef CONFIG_ESP_EXT_CONN_RECV_SEQ_FAULT_INJECT
+/* Built with CONFIG_ESP_EXT_CONN_RECV_SEQ_FAULT_INJECT, every frame dropped is accounted for */
+static int test_recv_seq_fault(void)
+{
+    esp_extconn_rx_stats_t stats;
+    uint8_t burst[4096];
+    uint32_t seq = 1;
+
+    /* The requests go unanswered, an answer would take a sequence number of its own */
+    TEST_ASSERT(start() == 0);
+
+    for (int i = 0; i < 8; i++) {
+        size_t len = 0;
+        for (int j = 0; j < 8; j++) {
+            len += data_frame(burst + len, seq++, 200);
+        }
+        TEST_ASSERT_EQ(ESP_OK, sdio_slave_sim_push(&s_sim, EXT_CONN_WIFI_SDIO_FUNC, burst, len));
+    }
+    /* Events are never dropped, one after the data shows the loss of the last frames too */
+    size_t len = event_frame(burst, SIP_EVT_CREDIT_RPT, seq, 4);
+    TEST_ASSERT_EQ(ESP_OK, sdio_slave_sim_push(&s_sim, EXT_CONN_WIFI_SDIO_FUNC, burst, len));
+
+    for (int i = 0; i < TEST_WAIT_MS && esp_sip_get_rxseq() < seq + 1; i++) {
+        usleep(1000);
+    }
+    TEST_ASSERT_EQ(ESP_OK, esp_extconn_get_rx_stats(&stats));
+    TEST_ASSERT(stats.seq_gaps > 0);
+    TEST_ASSERT(stats.resync_reqs > 0);
+    TEST_ASSERT_EQ(seq - 1, host_stack.rx_frames + stats.frames_lost);
+    return 0;
+}
+#endif
+
+#ifdef CONFIG_ESP_EXT_CONN_HEARTBEAT
+#define TEST_WDT_INTERVAL_US (CONFIG_ESP_EXT_CONN_HEARTBEAT_INTERVAL_MS * 1000LL)
+
+/* Firmware of the recovery test, it answers heartbeats until it hangs */
+static struct {
+    volatile bool hung;
+    uint32_t seq;                   /* Of its next frame, the bootup event took 0 */
+    volatile int64_t link_us[2];    /* When the link went down and came back */
+} s_hang;
+
+static bool target_hangs(sdio_slave_sim_t *sim, const uint8_t *pkt, size_t len, void *arg)
+{
+    const struct sip_hdr *hdr = (const struct sip_hdr *)pkt;
+    uint8_t ack[SIP_CTRL_HDR_LEN + 4];
+
+    if (!s_hang.hung && SIP_HDR_IS_CTRL(hdr) && hdr->c_cmdid == SIP_CMD_HB_REQ) {
+        sdio_slave_sim_push(sim, EXT_CONN_WIFI_SDIO_FUNC, ack, event_frame(ack, SIP_EVT_HB_ACK, s_hang.seq++, 4));
+    }
+    /* Hung or not, it takes the packet, so the slave buffers stay free */
+    return true;
+}
+
+static void target_reset(sdio_slave_sim_t *sim)
+{
+    s_hang.hung = false;
+    s_hang.seq = 1;
+}
+
+static void link_cb(bool up, void *arg)
+{
+    s_hang.link_us[up] = esp_timer_get_time();
+}
+
+/* Send an HCI packet and return the SBP sequence number the slave got it with */
+static int bt_send_seq(uint32_t *seq)
+{
+    uint8_t hci[4] = { 0x01, 0x03, 0x0c, 0x00 };
+    uint8_t pkt[64];
+    size_t len = 0;
+
+    host_stack.bt_send(hci, sizeof(hci));
+    for (int i = 0; i < TEST_WAIT_MS && len == 0; i++) {
+        len = sdio_slave_sim_pop(&s_sim, EXT_CONN_BT_SDIO_FUNC, pkt, sizeof(pkt));
+        usleep(1000);
+    }
+    TEST_ASSERT(len >= 8 + sizeof(hci));
+    memcpy(seq, pkt + 4, sizeof(*seq));
+    return 0;
+}
+
+/* A target that stops answering is found by the watchdog and rebooted, time it all */
+static int test_recover(void)
+{
+    static uint8_t image[TEST_FW_LEN];
+    esp_extconn_config_t config = ESP_EXTCONN_CONFIG_DEFAULT();
+    esp_extconn_boot_timeline_t tl;
+    uint32_t seq = UINT32_MAX;
+
+    sdio_slave_sim_reset(&s_sim);
+    s_sim.target = target_hangs;
+    s_hang.seq = 1;
+    fill(image, sizeof(image), 5);
+    host_boot.sim = &s_sim;
+    host_boot.image = image;
+    host_boot.image_len = sizeof(image);
+    host_boot.entry_addr = TEST_FW_ADDR;
+    host_boot.target_reset = target_reset;
+    TEST_ASSERT_EQ(ESP_OK, esp_extconn_register_link_cb(link_cb, NULL));
+    TEST_ASSERT_EQ(ESP_OK, esp_extconn_init(&config));
+    TEST_ASSERT(host_stack.bt_send != NULL);
+    TEST_ASSERT(bt_send_seq(&seq) == 0);
+    TEST_ASSERT_EQ(0, seq);
+
+    int64_t hang_us = esp_timer_get_time();
+    s_hang.hung = true;
+    for (int i = 0; i < 3000 && s_hang.link_us[1] == 0; i++) {
+        usleep(1000);
+    }
+    TEST_ASSERT(s_hang.link_us[1] != 0);
+    TEST_ASSERT_EQ(1, host_boot.recovers);
+    TEST_ASSERT_EQ(ESP_OK, esp_extconn_get_boot_timeline(&tl));
+    TEST_ASSERT(tl.recover);
+
+    int64_t detect_us = s_hang.link_us[0] - hang_us;
+    int64_t download_us = tl.ts_us[ESP_EXTCONN_BOOT_FW_DOWNLOAD] - tl.ts_us[ESP_EXTCONN_BOOT_START];
+    int64_t reboot_us = tl.ts_us[ESP_EXTCONN_BOOT_DONE] - tl.ts_us[ESP_EXTCONN_BOOT_START];
+    printf("hang detected in %lld ms, rebooted in %lld ms (download %lld ms), link back %lld ms after the hang\n",
+           (long long)detect_us / 1000, (long long)reboot_us / 1000, (long long)download_us / 1000,
+           (long long)(s_hang.link_us[1] - hang_us) / 1000);
+    /* The last heartbeat answer came at most an interval before the hang, the check runs every interval */
+    TEST_ASSERT(detect_us >= TEST_WDT_INTERVAL_US * (CONFIG_ESP_EXT_CONN_HEARTBEAT_MISS_MAX - 1));
+    TEST_ASSERT(detect_us <= TEST_WDT_INTERVAL_US * (CONFIG_ESP_EXT_CONN_HEARTBEAT_MISS_MAX + 1));
+
+    /* The rebooted target counts BT packets from 0 again */
+    TEST_ASSERT(bt_send_seq(&seq) == 0);
+    TEST_ASSERT_EQ(0, seq);
+    return 0;
+}
+#endif
+
+static int test_recv_bt(void)
+{
+    uint8_t pkt[64];
+
+    TEST_ASSERT(start() == 0);
+
+    fill(pkt, sizeof(pkt), 43);
+    TEST_ASSERT_EQ(ESP_OK, sdio_slave_sim_push(&s_sim, EXT_CONN_BT_SDIO_FUNC, pkt, sizeof(pkt)));
+    TEST_ASSERT(host_stack_wait(&host_stack.bt_rx, 1, TEST_WAIT_MS));
+    TEST_ASSERT_EQ(sizeof(pkt), host_stack.bt_rx_len);
+    return 0;
+}
+
+static int test_fw_download(void)
+{
+    static uint8_t image[TEST_FW_LEN];
+
+    TEST_ASSERT(start_bus() == 0);
+    s_sim.target = target_write_mem;
+
+    fill(image, sizeof(image), 47);
+    TEST_ASSERT_EQ(ESP_OK, esp_sip_write_mem(TEST_FW_ADDR, image, sizeof(image)));
+    TEST_ASSERT_EQ(ESP_OK, esp_sip_write_flush());
+    TEST_ASSERT(!s_fw.bad);
+    TEST_ASSERT(s_fw.frames > 1);
+    TEST_ASSERT(memcmp(s_fw.mem, image, sizeof(image)) == 0);
+    TEST_ASSERT_EQ(s_fw.frames, esp_sip_increase_txseq());
+    return 0;
+}
+
+/* Frames as gen_fw_frames.py lays them out, seq from 0, each padded to a word */
+static size_t build_frames(uint8_t *out, const uint8_t *image, size_t len, size_t frame_size)
+{
+    size_t hdrs = SIP_CTRL_HDR_LEN + sizeof(struct sip_cmd_write_memory);
+    size_t n = 0;
+    uint32_t seq = 0;
+
+    for (size_t off = 0; off < len; seq++) {
+        size_t chunk = len - off < frame_size - hdrs ? len - off : frame_size - hdrs;
+        size_t padded = (hdrs + chunk + 3) & ~3;
+        struct sip_hdr hdr = { 0 };
+        struct sip_cmd_write_memory cmd = { .addr = TEST_FW_ADDR + off, .len = chunk };
+
+        SIP_HDR_SET_TYPE(hdr.fc[0], SIP_CTRL);
+        hdr.c_cmdid = SIP_CMD_WRITE_MEMORY;
+        hdr.len = hdrs + chunk;
+        hdr.seq = seq;
+        memset(out + n, 0, padded);
+        memcpy(out + n, &hdr, sizeof(hdr));
+        memcpy(out + n + SIP_CTRL_HDR_LEN, &cmd, sizeof(cmd));
+        memcpy(out + n + hdrs, image + off, chunk);
+        n += padded;
+        off += chunk;
+    }
+    return n;
+}
+
+/* Frames from memory the DMA can not take as is, sent after some other frames went out */
+static int test_fw_frames(void)
+{
+    static uint8_t image[TEST_FW_LEN];
+    static uint8_t frames[TEST_FW_LEN * 2];
+    /* Off every cache line, as an array in flash would be */
+    uint8_t *rodata = frames + 4;
+
+    TEST_ASSERT(start_bus() == 0);
+    s_sim.target = target_write_mem;
+
+    fill(image, sizeof(image), 13);
+    size_t len = build_frames(rodata, image, sizeof(image), SIP_BOOT_BUF_SIZE);
+    for (int i = 0; i < 3; i++) {
+        esp_sip_increase_txseq();
+    }
+    s_fw.next_seq = 3;
+
+    uint32_t bounces = s_sim.data_bounces;
+    TEST_ASSERT_EQ(ESP_OK, esp_sip_write_frames(rodata, len));
+    TEST_ASSERT_EQ(ESP_OK, esp_sip_write_flush());
+    TEST_ASSERT(!s_fw.bad);
+    TEST_ASSERT(memcmp(s_fw.mem, image, sizeof(image)) == 0);
+    TEST_ASSERT_EQ(3 + s_fw.frames, esp_sip_increase_txseq());
+    /* Every frame was staged, only the short last one is not a whole number of cache lines */
+    TEST_ASSERT(s_sim.data_bounces - bounces <= 1);
+
+    /* A frame longer than a download buffer is refused before anything is sent */
+    struct sip_hdr *hdr = (struct sip_hdr *)rodata;
+    hdr->len = 0xfffc;
+    TEST_ASSERT_EQ(ESP_ERR_INVALID_SIZE, esp_sip_write_frames(rodata, len));
+    return 0;
+}
+
+static int test_warm_attach(void)
+{
+    static uint8_t answer = SIP_EVT_HB_ACK;
+    struct sip_evt_bootup2 bevt = { .tx_blksz = 512, .rx_blksz = 512 };
+
+    TEST_ASSERT(start_bus() == 0);
+    s_sim.target = target_running;
+    s_sim.target_arg = &answer;
+
+    TEST_ASSERT_EQ(ESP_OK, esp_sip_warm_attach(&bevt, 100));
+    TEST_ASSERT(esp_sip_is_running());
+    TEST_ASSERT_EQ(512, esp_sip_get_tx_blks());
+    /* The frame after the answer is the next one taken */
+    TEST_ASSERT_EQ(8, esp_sip_increase_rxseq());
+    TEST_ASSERT_EQ(0, sdio_slave_sim_tx_count(&s_sim, EXT_CONN_WIFI_SDIO_FUNC));
+    return 0;
+}
+
+/* Anything but the heartbeat ack is a target that can not be trusted, it is booted cold */
+static int test_warm_attach_no_ack(void)
+{
+    static uint8_t answer = SIP_EVT_BOOTUP;
+    struct sip_evt_bootup2 bevt = { .tx_blksz = 512, .rx_blksz = 512 };
+
+    TEST_ASSERT(start_bus() == 0);
+    s_sim.target = target_running;
+    s_sim.target_arg = &answer;
+
+    TEST_ASSERT_EQ(ESP_ERR_INVALID_RESPONSE, esp_sip_warm_attach(&bevt, 100));
+    TEST_ASSERT(!esp_sip_is_running());
+
+    /* Nothing answers at all */
+    s_sim.target = NULL;
+    TEST_ASSERT(esp_sip_warm_attach(&bevt, 20) != ESP_OK);
+    TEST_ASSERT(!esp_sip_is_running());
+    return 0;
+}
+
+static const struct {
+    const char *name;
+    int (*fn)(void);
+} s_tests[] = {
+    { "sip_bootup", test_sip_bootup },
+    { "sip_cmd", test_sip_cmd },
+    { "wifi_cmd", test_wifi_cmd },
+    { "wifi_tx_copy", test_wifi_tx_copy },
+    { "wifi_tx_zero_copy", test_wifi_tx_zero_copy },
+    { "recv_burst", test_recv_burst },
+    { "recv_split", test_recv_split },
+#if CONFIG_ESP_EXT_CONN_RECV_POLL_US > 0
+    { "recv_poll", test_recv_poll },
+#endif
+#if CONFIG_ESP_EXT_CONN_RECV_RING_SLOTS > 1
+    { "recv_ring_full", test_recv_ring_full },
+#endif
+    { "recv_seq_gap", test_recv_seq_gap },
+    { "recv_bad_len", test_recv_bad_len },
+#ifdef CONFIG_ESP_EXT_CONN_RECV_SEQ_FAULT_INJECT
+    { "recv_seq_fault", test_recv_seq_fault },
+#endif
+#ifdef CONFIG_ESP_EXT_CONN_HEARTBEAT
+    { "recover", test_recover },
+#endif
+    { "recv_bt", test_recv_bt },
+    { "fw_download", test_fw_download },
+    { "fw_frames", test_fw_frames },
+    { "warm_attach", test_warm_attach },
+    { "warm_attach_no_ack", test_warm_attach_no_ack },
+};
+
+int main(int argc, char **argv)
+{
+    size_t n = sizeof(s_tests) / sizeof(s_tests[0]);
+
+    if (argc != 2) {
+        for (size_t i = 0; i < n; i++) {
+            printf("%s\n", s_tests[i].name);
+        }
+        return argc == 1 ? 0 : 1;
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (strcmp(argv[1], s_tests[i].name) == 0) {
+            int rc = s_tests[i].fn();
+            printf("%-28s %s\n", s_tests[i].name, rc ? "FAIL" : "ok");
+            return rc;
+        }
+    }
+    fprintf(stderr, "no test %s\n", argv[1]);
+    return 1;
+}
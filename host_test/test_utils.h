@@ -0,0 +1,28 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef __TEST_UTILS_H__
+#define __TEST_UTILS_H__
+
+#include <stdio.h>
+
+/* A failed check returns 1 from the test function */
+#define TEST_ASSERT(cond) do {                                              \
+        if (!(cond)) {                                                      \
+            fprintf(stderr, "%s:%d: %s failed\n", __FILE__, __LINE__, #cond); \
+            return 1;                                                       \
+        }                                                                   \
+    } while (0)
+
+#define TEST_ASSERT_EQ(expect, actual) do {                                 \
+        long long e_ = (long long)(expect), a_ = (long long)(actual);       \
+        if (e_ != a_) {                                                     \
+            fprintf(stderr, "%s:%d: %s is %lld, expected %lld\n",           \
+                    __FILE__, __LINE__, #actual, a_, e_);                   \
+            return 1;                                                       \
+        }                                                                   \
+    } while (0)
+
+#endif /* __TEST_UTILS_H__ */
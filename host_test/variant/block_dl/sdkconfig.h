@@ -0,0 +1,13 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+/* Firmware download in block mode, with the Kconfig defaults */
+#include_next "sdkconfig.h"
+
+#define CONFIG_ESP_EXT_CONN_FW_DL_BLOCK_MODE       1
+#define CONFIG_ESP_EXT_CONN_FW_DL_BUF_SIZE         4096
+#define CONFIG_ESP_EXT_CONN_FW_DL_READY_TIMEOUT_MS 100
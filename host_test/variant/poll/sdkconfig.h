@@ -0,0 +1,12 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+/* The receive task polls for 2 ms after a burst before waiting for the interrupt again */
+#include_next "sdkconfig.h"
+
+#undef CONFIG_ESP_EXT_CONN_RECV_POLL_US
+#define CONFIG_ESP_EXT_CONN_RECV_POLL_US 2000
@@ -0,0 +1,13 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+/* The heartbeat watchdog, with a short interval so a recovery fits in a test */
+#include_next "sdkconfig.h"
+
+#define CONFIG_ESP_EXT_CONN_HEARTBEAT             1
+#define CONFIG_ESP_EXT_CONN_HEARTBEAT_INTERVAL_MS 100
+#define CONFIG_ESP_EXT_CONN_HEARTBEAT_MISS_MAX    3
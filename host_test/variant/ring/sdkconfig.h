@@ -0,0 +1,12 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+/* Two receive buffers, bursts are parsed by the worker task */
+#include_next "sdkconfig.h"
+
+#undef CONFIG_ESP_EXT_CONN_RECV_RING_SLOTS
+#define CONFIG_ESP_EXT_CONN_RECV_RING_SLOTS 2
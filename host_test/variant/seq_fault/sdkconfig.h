@@ -0,0 +1,12 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+/* Received data frames dropped at random, about one in four */
+#include_next "sdkconfig.h"
+
+#define CONFIG_ESP_EXT_CONN_RECV_SEQ_FAULT_INJECT 1
+#define CONFIG_ESP_EXT_CONN_RECV_SEQ_FAULT_RATE   4
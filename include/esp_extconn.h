@@ -7,6 +7,9 @@
 #ifndef __ESP_EXTCONN_H__
 #define __ESP_EXTCONN_H__
 
+#include <stdbool.h>
+#include <stdint.h>
+
 #include "sdkconfig.h"
 #include "esp_err.h"
 
@@ -40,6 +43,24 @@ extern "C" {
 #define ESP_EXT_CONN_RECV_TASK_CORE 1
 #endif
 
+#ifdef CONFIG_ESP_EXT_CONN_RECV_WORKER_STACK
+#define ESP_EXT_CONN_RECV_WORKER_STACK CONFIG_ESP_EXT_CONN_RECV_WORKER_STACK
+#else
+#define ESP_EXT_CONN_RECV_WORKER_STACK 3072
+#endif
+
+#ifdef CONFIG_ESP_EXT_CONN_RECV_WORKER_PRIO
+#define ESP_EXT_CONN_RECV_WORKER_PRIO CONFIG_ESP_EXT_CONN_RECV_WORKER_PRIO
+#else
+#define ESP_EXT_CONN_RECV_WORKER_PRIO 22
+#endif
+
+#ifdef CONFIG_ESP_EXT_CONN_RECV_WORKER_CORE
+#define ESP_EXT_CONN_RECV_WORKER_CORE CONFIG_ESP_EXT_CONN_RECV_WORKER_CORE
+#else
+#define ESP_EXT_CONN_RECV_WORKER_CORE 0
+#endif
+
 #ifdef COFNIG_ESP_EXT_CONN_WIFI_TASK_STACK
 #define ESP_EXT_CONN_WIFI_TASK_STACK COFNIG_ESP_EXT_CONN_WIFI_TASK_STACK
 #else
@@ -76,33 +97,123 @@ extern "C" {
 #define ESP_EXT_CONN_BT_TASK_CORE 1
 #endif
 
+/* Task field value that selects the Kconfig default, so 0 stays a valid priority and core */
+#define ESP_EXTCONN_TASK_DEFAULT    UINT32_MAX
+
 /*
  * @brief External connectivity configuration parameters passed to esp_extconn_init call.
  */
 typedef struct {
-    uint32_t recv_task_stack; /* Trans recv task stack */
-    uint32_t recv_task_prio;  /* Trans recv task priority */
-    uint32_t recv_task_core;  /* Trans recv task core ID */
-    uint32_t wifi_task_stack; /* Trans WiFi task stack */
-    uint32_t wifi_task_prio;  /* Trans WiFi task priority */
-    uint32_t wifi_task_core;  /* Trans WiFi task core ID */
-    uint32_t bt_task_stack;   /* Trans BT task stack */
-    uint32_t bt_task_prio;    /* Trans BT task priority */
-    uint32_t bt_task_core;    /* Trans BT task core ID */
+    uint32_t recv_task_stack;   /* Trans recv task stack */
+    uint32_t recv_task_prio;    /* Trans recv task priority */
+    uint32_t recv_task_core;    /* Trans recv task core ID */
+    uint32_t wifi_task_stack;   /* Trans WiFi task stack */
+    uint32_t wifi_task_prio;    /* Trans WiFi task priority */
+    uint32_t wifi_task_core;    /* Trans WiFi task core ID */
+    uint32_t bt_task_stack;     /* Trans BT task stack */
+    uint32_t bt_task_prio;      /* Trans BT task priority */
+    uint32_t bt_task_core;      /* Trans BT task core ID */
+    /* ESP_EXTCONN_TASK_DEFAULT selects the Kconfig default, a 0 stack all three of them */
+    uint32_t recv_worker_stack; /* Trans recv parse worker stack */
+    uint32_t recv_worker_prio;  /* Trans recv parse worker priority */
+    uint32_t recv_worker_core;  /* Trans recv parse worker core ID, or tskNO_AFFINITY */
 } esp_extconn_config_t;
 
 #define ESP_EXTCONN_CONFIG_DEFAULT() { \
-    .recv_task_stack = ESP_EXT_CONN_RECV_TASK_STACK, \
-    .recv_task_prio  = ESP_EXT_CONN_RECV_TASK_PRIO,  \
-    .recv_task_core  = ESP_EXT_CONN_RECV_TASK_CORE,  \
-    .wifi_task_stack = ESP_EXT_CONN_WIFI_TASK_STACK, \
-    .wifi_task_prio  = ESP_EXT_CONN_WIFI_TASK_PRIO,  \
-    .wifi_task_core  = ESP_EXT_CONN_WIFI_TASK_CORE,  \
-    .bt_task_stack   = ESP_EXT_CONN_BT_TASK_STACK,   \
-    .bt_task_prio    = ESP_EXT_CONN_BT_TASK_PRIO,    \
-    .bt_task_core    = ESP_EXT_CONN_BT_TASK_CORE     \
+    .recv_task_stack   = ESP_EXT_CONN_RECV_TASK_STACK,   \
+    .recv_task_prio    = ESP_EXT_CONN_RECV_TASK_PRIO,    \
+    .recv_task_core    = ESP_EXT_CONN_RECV_TASK_CORE,    \
+    .wifi_task_stack   = ESP_EXT_CONN_WIFI_TASK_STACK,   \
+    .wifi_task_prio    = ESP_EXT_CONN_WIFI_TASK_PRIO,    \
+    .wifi_task_core    = ESP_EXT_CONN_WIFI_TASK_CORE,    \
+    .bt_task_stack     = ESP_EXT_CONN_BT_TASK_STACK,     \
+    .bt_task_prio      = ESP_EXT_CONN_BT_TASK_PRIO,      \
+    .bt_task_core      = ESP_EXT_CONN_BT_TASK_CORE,      \
+    .recv_worker_stack = ESP_EXT_CONN_RECV_WORKER_STACK, \
+    .recv_worker_prio  = ESP_EXT_CONN_RECV_WORKER_PRIO,  \
+    .recv_worker_core  = ESP_EXT_CONN_RECV_WORKER_CORE   \
 }
 
+/*
+ * @brief Boot phases of the external connectivity, in the order they finish.
+ */
+typedef enum {
+    ESP_EXTCONN_BOOT_START = 0,    /* esp_extconn_init called */
+    ESP_EXTCONN_BOOT_PINS_INIT,    /* reset and boot pins configured */
+    ESP_EXTCONN_BOOT_RESET,        /* reset pulse done */
+    ESP_EXTCONN_BOOT_CARD_INIT,    /* SDIO card enumerated */
+    ESP_EXTCONN_BOOT_SDIO_START,   /* SDIO functions and slave link set up */
+    ESP_EXTCONN_BOOT_FW_DOWNLOAD,  /* firmware downloaded */
+    ESP_EXTCONN_BOOT_TARGET_ON,    /* SIP_EVT_TARGET_ON received */
+    ESP_EXTCONN_BOOT_CHIP_INIT,    /* SIP_CMD_INIT sent */
+    ESP_EXTCONN_BOOT_BOOTUP,       /* SIP_EVT_BOOTUP received, or warm attached */
+    ESP_EXTCONN_BOOT_DONE,         /* esp_extconn_init finished */
+    ESP_EXTCONN_BOOT_PHASE_MAX,
+} esp_extconn_boot_phase_t;
+
+/*
+ * @brief Timestamps of the last boot, from esp_timer_get_time.
+ */
+typedef struct {
+    int64_t ts_us[ESP_EXTCONN_BOOT_PHASE_MAX]; /* Time the phase finished, 0 if not reached */
+    bool warm;                                 /* Target was warm attached, no reset or download */
+    bool recover;                              /* Target was rebooted after it stopped responding */
+} esp_extconn_boot_timeline_t;
+
+/*
+ * @brief SDIO transfer counters, since the last cold boot of the target.
+ */
+typedef struct {
+    uint32_t tx_packets;      /* Packets sent */
+    uint32_t rx_packets;      /* Packets received */
+    uint32_t cmd53;           /* CMD53 commands issued for packet data */
+    uint32_t cmd53_saved;     /* CMD53 commands saved by padding transfers to whole blocks */
+    uint32_t reg_cmd_saved;   /* Register reads and writes saved by status snapshots */
+    uint32_t cmd52;           /* Register bytes accessed with CMD52 instead of CMD53 */
+    uint32_t arena_allocs;    /* Control path buffers served by the DMA arena */
+    uint32_t arena_fallbacks; /* Control path buffers that had to come from the heap */
+    uint32_t arena_peak;      /* Most arena slots in use at the same time */
+    uint32_t bounce;          /* Transfers the SDMMC driver had to copy through a bounce buffer */
+    uint32_t errors;          /* Failed transfers, each one aborted */
+    uint32_t retries;         /* Transfers repeated after an error */
+    uint32_t failures;        /* Transfers given up after the retries, or reads that lost data */
+    uint32_t resyncs;         /* Host counters reset to the slave ones */
+    uint32_t clk_downshifts;  /* Times the bus clock was halved after repeated errors */
+    uint32_t recover_max_us;  /* Longest time from an error to the transfer succeeding */
+} esp_extconn_sdio_stats_t;
+
+#define ESP_EXTCONN_RX_LAT_BUCKETS (8)
+
+/*
+ * @brief Receive path counters. Latency is from the wakeup, or the poll, to the burst
+ *        read off the bus, or for BT to the packet handed to the host stack.
+ *        Bucket n counts bursts under 16 << n us, the last one the rest.
+ */
+typedef struct {
+    uint32_t irq_wakeups;                               /* Wakeups by the slave interrupt */
+    uint32_t polls;                                     /* Status reads made while polling */
+    uint32_t poll_hits;                                 /* Bursts found by polling, without an interrupt */
+    uint32_t irq_latency[ESP_EXTCONN_RX_LAT_BUCKETS];   /* Bursts read after an interrupt, by latency */
+    uint32_t poll_latency[ESP_EXTCONN_RX_LAT_BUCKETS];  /* Bursts read after a poll, by latency */
+    uint32_t bt_latency[ESP_EXTCONN_RX_LAT_BUCKETS];    /* BT packets handed to the host stack, by latency */
+    uint32_t seq_gaps;                                  /* Frames whose sequence did not follow, rxseq realigned */
+    uint32_t frames_lost;                               /* Frames missing from the sequence gaps */
+    uint32_t seq_syncs;                                 /* Sync flags from the target, rxseq realigned */
+    uint32_t bad_frames;                                /* Malformed frames, skipped up to the next header found */
+    uint32_t resync_reqs;                               /* Resync requests sent to the target after lost frames */
+    uint32_t slot_waits;                                /* Bursts left with the slave, every buffer waiting for the worker */
+    uint32_t split_bursts;                              /* Bursts longer than a buffer, read in more than one go */
+} esp_extconn_rx_stats_t;
+
+/**
+ * @brief Callback invoked when the link to the target goes down or comes back
+ *
+ * @param  up  false when the target stopped responding and is being recovered,
+ *             true once it is running again. The target lost all its state.
+ * @param  arg user argument passed to esp_extconn_register_link_cb
+ */
+typedef void (*esp_extconn_link_cb_t)(bool up, void *arg);
+
 /**
  * @brief Initialize the driver for external Wi-Fi/BT
  *
@@ -115,6 +226,90 @@ typedef struct {
  */
 esp_err_t esp_extconn_init(esp_extconn_config_t *config);
 
+/**
+ * @brief Callback invoked when an asynchronous initialization finishes
+ *
+ * @param  ret result of the initialization, same as esp_extconn_init would return
+ * @param  arg user argument passed to esp_extconn_init_async
+ */
+typedef void (*esp_extconn_init_cb_t)(esp_err_t ret, void *arg);
+
+/**
+ * @brief Initialize the driver for external Wi-Fi/BT in the background
+ *
+ * Boots the target in a separate task and returns at once, so the rest of the
+ * application can initialize in parallel. Wi-Fi and BT calls made before the
+ * target is ready wait for it internally.
+ *
+ * @param  config provide esp_extcon init configuration
+ * @param  cb     called from the init task when done, can be NULL
+ * @param  arg    user argument passed to cb
+ *
+ * @return
+ *    - ESP_OK: init task started
+ *    - ESP_ERR_NO_MEM: out of memory
+ *    - ESP_ERR_INVALID_STATE: init already started
+ */
+esp_err_t esp_extconn_init_async(esp_extconn_config_t *config, esp_extconn_init_cb_t cb, void *arg);
+
+/**
+ * @brief Wait for the initialization of the driver to finish
+ *
+ * @param  wait_ms max time to wait in ms, UINT32_MAX to wait forever
+ *
+ * @return
+ *    - ESP_OK: target is ready
+ *    - ESP_FAIL: initialization failed
+ *    - ESP_ERR_TIMEOUT: not finished in time
+ *    - ESP_ERR_INVALID_STATE: initialization not started
+ */
+esp_err_t esp_extconn_wait_ready(uint32_t wait_ms);
+
+/**
+ * @brief Get the timestamps of every phase of the last boot
+ *
+ * @param  timeline filled with the boot timeline
+ *
+ * @return
+ *    - ESP_OK: succeed
+ *    - ESP_ERR_INVALID_ARG: timeline is NULL
+ */
+esp_err_t esp_extconn_get_boot_timeline(esp_extconn_boot_timeline_t *timeline);
+
+/**
+ * @brief Register a callback for target recovery by the heartbeat watchdog
+ *
+ * @param  cb  called from the watchdog task, NULL to unregister
+ * @param  arg user argument passed to cb
+ *
+ * @return
+ *    - ESP_OK: succeed
+ */
+esp_err_t esp_extconn_register_link_cb(esp_extconn_link_cb_t cb, void *arg);
+
+/**
+ * @brief Get the SDIO transfer counters
+ *
+ * @param  stats filled with the counters
+ *
+ * @return
+ *    - ESP_OK: succeed
+ *    - ESP_ERR_INVALID_ARG: stats is NULL
+ *    - ESP_ERR_INVALID_STATE: SDIO not initialized
+ */
+esp_err_t esp_extconn_get_sdio_stats(esp_extconn_sdio_stats_t *stats);
+
+/**
+ * @brief Get the receive path counters, interrupt wakeups vs. polls
+ *
+ * @param  stats filled with the counters
+ *
+ * @return
+ *    - ESP_OK: succeed
+ *    - ESP_ERR_INVALID_ARG: stats is NULL
+ */
+esp_err_t esp_extconn_get_rx_stats(esp_extconn_rx_stats_t *stats);
+
 /**
  * @brief Obtain the MAC address of the target chip.
  */
@@ -7,6 +7,7 @@
 #define __ESP_SIP__
 
 #include <stdio.h>
+#include <stdbool.h>
 
 #include "esp_err.h"
 #include "if_ebuf.h"
@@ -51,15 +52,29 @@ struct esp_sip {
     uint32_t slc_window_end_addr;
     uint8_t  wifi_addr[MAC_ADDR_LEN];
     uint8_t  bt_addr[MAC_ADDR_LEN];
+    struct sip_evt_bootup2 boot_evt;
 };
 
 esp_err_t esp_sip_init(void);
 esp_err_t esp_sip_send_cmd(int cid, uint32_t cmdlen, void *cmd);
 esp_err_t esp_sip_write_mem(uint32_t addr, const uint8_t *buf, uint32_t len);
+esp_err_t esp_sip_write_frames(const uint8_t *frames, uint32_t len);
+esp_err_t esp_sip_write_mem_lz(uint32_t addr, const uint8_t *src, uint16_t src_len, uint16_t raw_len, bool stored);
+esp_err_t esp_sip_write_flush(void);
 esp_err_t esp_sip_bootup(uint32_t entry_addr);
+esp_err_t esp_sip_wait_ready(uint32_t wait_ms);
 esp_err_t esp_sip_parse_events(uint8_t *buf);
+esp_err_t esp_sip_get_boot_info(struct sip_evt_bootup2 *bevt);
+esp_err_t esp_sip_warm_attach(const struct sip_evt_bootup2 *bevt, uint32_t wait_ms);
+esp_err_t esp_sip_send_heartbeat(void);
+bool esp_sip_is_running(void);
+bool esp_sip_is_link_down(void);
+void esp_sip_link_down(void);
 
 uint32_t esp_sip_increase_rxseq(void);
+uint32_t esp_sip_get_rxseq(void);
+/* Realign the expected receive sequence, after a gap or a sync from the target */
+void esp_sip_set_rxseq(uint32_t rxseq);
 uint32_t esp_sip_increase_txseq(void);
 uint32_t esp_sip_get_tx_blks(void);
 
@@ -6,18 +6,72 @@
 #ifndef __ESP_TRANS_H__
 #define __ESP_TRANS_H__
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_rom_sys.h"
 #include "esp_extconn.h"
 
+/*
+ * Wait for one backoff step and double it up to max_us. Steps shorter than a tick
+ * are busy waited, so polling does not depend on the FreeRTOS tick rate.
+ */
+static inline void esp_extconn_backoff(uint32_t *step_us, uint32_t max_us)
+{
+    uint32_t us = *step_us;
+
+    if (us < portTICK_PERIOD_MS * 1000) {
+        esp_rom_delay_us(us);
+    } else {
+        vTaskDelay(pdMS_TO_TICKS(us / 1000));
+    }
+    *step_us = (us * 2 < max_us) ? us * 2 : max_us;
+}
+
+void esp_extconn_boot_mark(esp_extconn_boot_phase_t phase);
+
+void esp_extconn_boot_set_warm(bool warm);
+
 esp_err_t esp_extconn_boot(void);
 
 esp_err_t esp_extconn_fw_init(esp_extconn_config_t *config);
 
+esp_err_t esp_extconn_fw_recover(void);
+
+esp_err_t esp_extconn_recover(void);
+
+#ifdef CONFIG_ESP_EXT_CONN_HEARTBEAT
+esp_err_t esp_extconn_wdt_init(void);
+
+/* Called for every frame received from the target */
+void esp_extconn_wdt_feed(void);
+
+void esp_extconn_wdt_target_reset(void);
+#else
+static inline esp_err_t esp_extconn_wdt_init(void)
+{
+    return ESP_OK;
+}
+
+static inline void esp_extconn_wdt_feed(void) { }
+
+static inline void esp_extconn_wdt_target_reset(void) { }
+#endif
+
 esp_err_t esp_extconn_trans_recv_init(esp_extconn_config_t *config);
 
+esp_err_t esp_extconn_trans_wifi_prepare(void);
+
 esp_err_t esp_extconn_trans_wifi_init(esp_extconn_config_t *config);
 
+void esp_extconn_trans_wifi_reset(void);
+
+esp_err_t esp_extconn_trans_bt_prepare(void);
+
 esp_err_t esp_extconn_trans_bt_init(esp_extconn_config_t *config);
 
+void esp_extconn_trans_bt_reset(void);
+
 void esp_extconn_trans_bt_send_unlock(void);
 
 void esp_extconn_trans_bt_recv(uint8_t *buff, size_t len);
@@ -0,0 +1,56 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef __EXT_FW_LZ_H__
+#define __EXT_FW_LZ_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Compressed firmware image, generated by tools/gen_fw_frames.py --lz.
+ *
+ * The image is a list of records, one per download frame. Each record is a
+ * struct esp_fw_lz_rec followed by comp_len bytes of LZSS data, or raw_len raw
+ * bytes if ESP_FW_LZ_STORED is set. Matches never cross a record, so every
+ * record expands on its own straight into the download buffer.
+ */
+#define ESP_FW_LZ_STORED    (0x8000)
+#define ESP_FW_LZ_LEN_MASK  (0x7fff)
+#define ESP_FW_LZ_MIN_MATCH (3)
+#define ESP_FW_LZ_MAX_DIST  (0x1000)
+
+struct esp_fw_lz_rec {
+    uint32_t load_addr;
+    uint16_t raw_len;
+    uint16_t comp_len;
+} __attribute__((packed));
+
+/**
+ * @brief Expand one LZSS record
+ *
+ * @param src     compressed data
+ * @param src_len length of compressed data
+ * @param dst     output buffer
+ * @param dst_len expected length of the expanded data
+ *
+ * @return
+ *    - ESP_OK: succeed
+ *    - ESP_ERR_INVALID_SIZE: the input ends early or has trailing bytes
+ *    - ESP_ERR_INVALID_STATE: a match points outside the output
+ */
+esp_err_t ext_fw_lz_decode(const uint8_t *src, size_t src_len, uint8_t *dst, size_t dst_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __EXT_FW_LZ_H__ */
@@ -8,6 +8,7 @@
 
 #include "esp_err.h"
 #include "esp_types.h"
+#include "esp_dma_utils.h"
 
 #include "sdmmc_cmd.h"
 
@@ -18,20 +19,112 @@ extern "C" {
 #define EXT_CONN_WIFI_SDIO_FUNC (1)
 #define EXT_CONN_BT_SDIO_FUNC   (2)
 
+/* Block size sdmmc_io_rw_extended uses, also the largest one negotiated */
+#define EXT_CONN_SDIO_DRIVER_BLOCK_SIZE (512)
+/* Size of a slave receive buffer, the unit of the TX credits */
+#define EXT_CONN_SDIO_SLAVE_BUF_SIZE    (512)
+
+/* Alignment of transport buffers, the P4 L2 cache line */
+#define EXT_CONN_SDIO_DMA_ALIGN         (64)
+#define EXT_CONN_SDIO_DMA_ALIGN_UP(len) (((len) + EXT_CONN_SDIO_DMA_ALIGN - 1) & ~(EXT_CONN_SDIO_DMA_ALIGN - 1))
+
+/* Control path DMA arena, slot 0 is kept for the register snapshots */
+#define EXT_CONN_SDIO_ARENA_SLOTS       (CONFIG_ESP_EXT_CONN_SDIO_ARENA_SLOTS + 1)
+#define EXT_CONN_SDIO_ARENA_SLOT_SIZE   (256)
+
+/* One piece of a packet sent with esp_extconn_sdio_send_frags */
+typedef struct {
+    const void *buf;
+    size_t length;
+    size_t size;    /* Bytes readable at buf, only the last fragment is padded up to it */
+} esp_extconn_sdio_frag_t;
+
+/*
+ * Bus access the adapter is built on, ctx is passed back to every call.
+ * Byte accesses are CMD52, bytes/blocks are CMD53 in byte and block mode.
+ */
+typedef struct {
+    esp_err_t (*go_idle)(void *ctx);
+    esp_err_t (*read_byte)(void *ctx, uint32_t function, uint32_t addr, uint8_t *out);
+    esp_err_t (*write_byte)(void *ctx, uint32_t function, uint32_t addr, uint8_t in, uint8_t *out);
+    esp_err_t (*read_bytes)(void *ctx, uint32_t function, uint32_t addr, void *dst, size_t size);
+    esp_err_t (*write_bytes)(void *ctx, uint32_t function, uint32_t addr, const void *src, size_t size);
+    esp_err_t (*read_blocks)(void *ctx, uint32_t function, uint32_t addr, void *dst, size_t size, uint16_t block_size);
+    esp_err_t (*write_blocks)(void *ctx, uint32_t function, uint32_t addr, const void *src, size_t size, uint16_t block_size);
+    esp_err_t (*wait_int)(void *ctx, uint32_t timeout_ticks);
+    esp_err_t (*set_clk)(void *ctx, uint32_t freq_khz);                         /* Optional, for downshifts */
+    esp_err_t (*get_dma_info)(void *ctx, esp_dma_mem_info_t *dma_mem_info);     /* Optional */
+} esp_extconn_sdio_ops_t;
+
+/* Ops over the IDF SDMMC host driver, ctx is the sdmmc_card_t */
+extern const esp_extconn_sdio_ops_t esp_extconn_sdio_sdmmc_ops;
+
+/* Decoded slave status, all fetched with one CMD53 */
+typedef struct {
+    uint32_t intr_0;                                /* SLC0 raw interrupts */
+    uint32_t intr_1;                                /* SLC1 raw interrupts */
+    uint32_t rx_len[EXT_CONN_BT_SDIO_FUNC + 1];     /* Bytes waiting, per function */
+} esp_extconn_sdio_snapshot_t;
+
 void esp_extconn_sdio_lock(void);
 
 void esp_extconn_sdio_unlock(void);
 
-esp_err_t esp_extconn_sdio_init(sdmmc_card_t *card);
+esp_err_t esp_extconn_sdio_init(sdmmc_card_t *card, bool warm);
+
+/* Same as esp_extconn_sdio_init over another bus implementation */
+esp_err_t esp_extconn_sdio_init_ops(const esp_extconn_sdio_ops_t *ops, void *ctx, bool warm);
 
 esp_err_t esp_extconn_sdio_write_bytes(uint32_t function, uint32_t addr, void *src, size_t size);
 
 esp_err_t esp_extconn_sdio_read_bytes(uint32_t function, uint32_t addr, void *src, size_t size);
 
+/* Read slave registers, with CMD52 when only a byte or two are needed */
+esp_err_t esp_extconn_sdio_read_reg(uint32_t addr, void *dst, size_t size);
+
 esp_err_t esp_extconn_sdio_send_packet(uint32_t function, void *start, size_t length);
 
+/* Same as esp_extconn_sdio_send_packet, may pad the transfer up to buf_size bytes */
+esp_err_t esp_extconn_sdio_send_packet_padded(uint32_t function, void *start, size_t length, size_t buf_size);
+
+/* Send one packet gathered from several buffers, no staging copy */
+esp_err_t esp_extconn_sdio_send_frags(uint32_t function, const esp_extconn_sdio_frag_t *frags, int num);
+
+/*
+ * Transport buffer the SDMMC DMA takes without a bounce copy: cache line aligned, with the
+ * length padded to whole cache lines. actual_size, if not NULL, gets the padded length.
+ */
+void *esp_extconn_sdio_dma_alloc(size_t size, size_t *actual_size);
+
+/*
+ * DMA capable, cache line aligned buffer for a control path transfer. Served from the
+ * preallocated arena, from the heap when it is too large or the arena is in use.
+ */
+void *esp_extconn_sdio_arena_alloc(size_t size);
+
+void esp_extconn_sdio_arena_free(void *buf);
+
+/* Block size negotiated for the function */
+uint16_t esp_extconn_sdio_get_block_size(uint32_t function);
+
+/* Buffer size needed for a packet of len bytes to be sent or received padded to whole blocks */
+size_t esp_extconn_sdio_pad_len(uint32_t function, size_t len);
+
+/* Whether the SDMMC DMA can take the buffer as is, instead of through a bounce buffer */
+bool esp_extconn_sdio_dma_capable(const void *buf, size_t length);
+
+/*
+ * Waits up to wait_ms for the slave to report data, ESP_ERR_TIMEOUT if it never does.
+ * ESP_ERR_NOT_FINISHED when more data waits than fits in size, out_length is still set.
+ */
 esp_err_t esp_extconn_sdio_get_packet(uint32_t function, void *out_buf, size_t size, size_t *out_length, uint32_t wait_ms);
 
+/*
+ * Read the interrupt and packet length registers in one transfer. The next
+ * esp_extconn_sdio_get_packet of each function starts from the cached length.
+ */
+esp_err_t esp_extconn_sdio_read_snapshot(esp_extconn_sdio_snapshot_t *snap);
+
 esp_err_t esp_extconn_sdio_get_intr(uint32_t *intr_0, uint32_t *intr_1);
 
 esp_err_t esp_extconn_sdio_clear_intr(uint32_t intr_0, uint32_t intr_1);
@@ -33,6 +33,7 @@
 #define ESP_SDIO_WIN_CMD            (ESP32_SLCHOST_BASE + 0x84)
 #define ESP_SDIO_CONG_W7            (ESP32_SLCHOST_BASE + 0x8c)
 #define ESP_SDIO_SLC0_INT_CLR       (ESP32_SLCHOST_BASE + 0xD4)
+#define SLCHOST_SLC0_RX_NEW_PACKET_INT_CLR     (BIT(23))
 #define ESP_SDIO_SLC1_INT_CLR       (ESP32_SLCHOST_BASE + 0xD8)
 #define SLCHOST_SLC1_TOHOST_BIT0_INT_CLR       (BIT(0))
 #define ESP_SDIO_FUNC1_INT_ENA      (ESP32_SLCHOST_BASE + 0xDC)
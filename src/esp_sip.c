@@ -3,9 +3,12 @@
  *
  * SPDX-License-Identifier: Apache-2.0
  */
+#include <stddef.h>
 #include <string.h>
 
 #include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/queue.h"
 #include "freertos/semphr.h"
 #include "freertos/task.h"
 
@@ -14,19 +17,57 @@
 #include "esp_check.h"
 #include "esp_dma_utils.h"
 #include "esp_heap_caps.h"
+#include "esp_timer.h"
 
 #include "esp_sip.h"
 #include "ext_sdio_adapter.h"
 #include "esp_extconn.h"
+#include "ext_default.h"
 #include "if_ebuf.h"
 #include "sdio_host_reg.h"
 #include "sip2_common.h"
 
 #include "eagle_init_data.h"
+#ifdef CONFIG_ESP_EXT_CONN_FW_COMPRESSED
+#include "ext_fw_lz.h"
+#endif
+
+#ifdef CONFIG_ESP_EXT_CONN_FW_DL_BLOCK_MODE
+#define SIP_DL_BUF_SIZE CONFIG_ESP_EXT_CONN_FW_DL_BUF_SIZE
+#else
+#define SIP_DL_BUF_SIZE SIP_BOOT_BUF_SIZE
+#endif
+/* Pipeline frames start on a cache line each, so none of them needs a bounce copy */
+#define SIP_DL_SLOT_SIZE EXT_CONN_SDIO_DMA_ALIGN_UP(SIP_DL_BUF_SIZE)
+
+#define SIP_DL_PIPE_DEPTH       CONFIG_ESP_EXT_CONN_FW_DL_PIPELINE_DEPTH
+#define SIP_DL_PIPE_WAIT_MS     (5000)
+#define SIP_DL_TASK_STACK       (3072)
+
+#define SIP_WARM_PROBE_BUF_SIZE (2048)
+#define SIP_READY_BIT           (BIT0)
+#define SIP_LINK_DOWN_BIT       (BIT1)
 
 static const char *TAG = "sip";
 static struct esp_sip *sip = NULL;
-static SemaphoreHandle_t boot_sem = NULL;
+static EventGroupHandle_t sip_event = NULL;
+
+#if SIP_DL_PIPE_DEPTH > 1
+typedef struct {
+    uint8_t *frame;
+    uint16_t len;
+} sip_dl_slot_t;
+
+/* Download frames are built by the caller and sent by sip_dl_task */
+static struct {
+    QueueHandle_t free_q;
+    QueueHandle_t send_q;       /* One extra entry for the exit request, a NULL frame */
+    SemaphoreHandle_t done;     /* Given by sip_dl_task right before it exits */
+    TaskHandle_t task;
+    volatile bool stop;
+    volatile esp_err_t err;
+} s_dl_pipe;
+#endif
 
 extern void coex_schm_status_set(uint16_t wifi_st, uint16_t ble_st, uint16_t bt_st);
 
@@ -36,10 +77,10 @@ esp_err_t esp_sip_send_cmd(int cid, uint32_t cmdlen, void *cmd)
     struct sip_hdr *shdr = NULL;
     uint16_t len = cmdlen + SIP_CTRL_HDR_LEN;
 
-    ESP_LOGI(TAG, "sip cmd %d", cid);
+    ESP_LOG_LEVEL_LOCAL(cid == SIP_CMD_HB_REQ ? ESP_LOG_DEBUG : ESP_LOG_INFO, TAG, "sip cmd %d", cid);
 
-    uint8_t *buffer = calloc(1, len);
-    ESP_RETURN_ON_FALSE(buffer != NULL, ESP_ERR_NO_MEM, TAG, "buffer calloc failed");
+    uint8_t *buffer = esp_extconn_sdio_arena_alloc(len);
+    ESP_RETURN_ON_FALSE(buffer != NULL, ESP_ERR_NO_MEM, TAG, "buffer alloc failed");
 
     shdr = (struct sip_hdr *)(buffer);
     memset(shdr, 0x0, SIP_CTRL_HDR_LEN);
@@ -60,12 +101,201 @@ esp_err_t esp_sip_send_cmd(int cid, uint32_t cmdlen, void *cmd)
 
     memcpy(buffer + SIP_CTRL_HDR_LEN, (uint8_t *)cmd, cmdlen);
     esp_extconn_sdio_lock();
-    err = esp_extconn_sdio_send_packet(1, buffer, len);
+    /* Arena slots and heap fallbacks are both padded to whole cache lines */
+    err = esp_extconn_sdio_send_packet_padded(1, buffer, len, EXT_CONN_SDIO_DMA_ALIGN_UP(len));
     esp_extconn_sdio_unlock();
-    free(buffer);
+    esp_extconn_sdio_arena_free(buffer);
     return err;
 }
 
+#ifdef CONFIG_ESP_EXT_CONN_FW_DL_BLOCK_MODE
+static esp_err_t esp_sip_wait_dl_ready(uint32_t len)
+{
+    uint32_t num = 0;
+    int64_t deadline = esp_timer_get_time() + CONFIG_ESP_EXT_CONN_FW_DL_READY_TIMEOUT_MS * 1000;
+
+    /* Every poll is a CMD53 register read, so the bus itself paces this loop */
+    do {
+        ESP_RETURN_ON_ERROR(esp_extconn_sdio_get_buffer_size(&num), TAG, "Read buffer size failed");
+        if (num * EXT_CONN_SDIO_SLAVE_BUF_SIZE >= len) {
+            return ESP_OK;
+        }
+    } while (esp_timer_get_time() < deadline);
+
+    ESP_LOGE(TAG, "slave not ready for %" PRIu32 " bytes, buffer %" PRIu32, len, num);
+    return ESP_ERR_TIMEOUT;
+}
+#endif
+
+/* size is the room in the frame buffer, the transfer may be padded up to it */
+static esp_err_t esp_sip_send_dl_frame(const uint8_t *frame, uint16_t len, uint16_t size)
+{
+    esp_err_t err = ESP_OK;
+
+#ifdef CONFIG_ESP_EXT_CONN_FW_DL_BLOCK_MODE
+    esp_extconn_sdio_lock();
+    err = esp_sip_wait_dl_ready(esp_extconn_sdio_pad_len(EXT_CONN_WIFI_SDIO_FUNC, len));
+    if (err == ESP_OK) {
+        err = esp_extconn_sdio_send_packet_padded(EXT_CONN_WIFI_SDIO_FUNC, (void *)frame, (len + 3) & (~3), size);
+    }
+    esp_extconn_sdio_unlock();
+    ESP_RETURN_ON_FALSE(err == ESP_OK, err, TAG, "Send download frame failed");
+#else
+    vTaskDelay(pdMS_TO_TICKS(1));
+    esp_extconn_sdio_lock();
+    err = esp_extconn_sdio_write_bytes(1, ESP_SLAVE_CMD53_END_ADDR - len, (void *)frame, (len + 3) & (~3));
+    esp_extconn_sdio_unlock();
+#endif
+    return err;
+}
+
+#if SIP_DL_PIPE_DEPTH > 1
+static void sip_dl_task(void *arg)
+{
+    sip_dl_slot_t slot;
+
+    while (1) {
+        xQueueReceive(s_dl_pipe.send_q, &slot, portMAX_DELAY);
+        if (slot.frame == NULL) {
+            break;
+        }
+        /* After a failure or a stop request the remaining frames are only handed back */
+        if (s_dl_pipe.err == ESP_OK && !s_dl_pipe.stop) {
+            s_dl_pipe.err = esp_sip_send_dl_frame(slot.frame, slot.len, SIP_DL_BUF_SIZE);
+        }
+        xQueueSend(s_dl_pipe.free_q, &slot.frame, portMAX_DELAY);
+    }
+
+    xSemaphoreGive(s_dl_pipe.done);
+    vTaskDelete(NULL);
+}
+
+/*
+ * Ask sip_dl_task to exit and wait until it has. A frame it is sending finishes first,
+ * the SDIO transfer has its own timeout, so the lock and the DMA are never left busy.
+ */
+static void esp_sip_dl_stop(void)
+{
+    if (s_dl_pipe.task) {
+        sip_dl_slot_t exit_slot = { 0 };
+
+        s_dl_pipe.stop = true;
+        xQueueSend(s_dl_pipe.send_q, &exit_slot, portMAX_DELAY);
+        xSemaphoreTake(s_dl_pipe.done, portMAX_DELAY);
+    }
+    if (s_dl_pipe.send_q) {
+        vQueueDelete(s_dl_pipe.send_q);
+    }
+    if (s_dl_pipe.free_q) {
+        vQueueDelete(s_dl_pipe.free_q);
+    }
+    if (s_dl_pipe.done) {
+        vSemaphoreDelete(s_dl_pipe.done);
+    }
+    memset(&s_dl_pipe, 0, sizeof(s_dl_pipe));
+}
+#endif
+
+static esp_err_t esp_sip_dl_start(void)
+{
+    if (sip->rawbuf == NULL) {
+        sip->rawbuf = esp_extconn_sdio_dma_alloc(SIP_DL_SLOT_SIZE * SIP_DL_PIPE_DEPTH, NULL);
+        ESP_RETURN_ON_FALSE(sip->rawbuf != NULL, ESP_ERR_NO_MEM, TAG, "No mem for rawbuf");
+    }
+#if SIP_DL_PIPE_DEPTH > 1
+    if (s_dl_pipe.task != NULL) {
+        return ESP_OK;
+    }
+
+    s_dl_pipe.err = ESP_OK;
+    s_dl_pipe.stop = false;
+    s_dl_pipe.free_q = xQueueCreate(SIP_DL_PIPE_DEPTH, sizeof(uint8_t *));
+    s_dl_pipe.send_q = xQueueCreate(SIP_DL_PIPE_DEPTH + 1, sizeof(sip_dl_slot_t));
+    s_dl_pipe.done = xSemaphoreCreateBinary();
+    if (s_dl_pipe.free_q == NULL || s_dl_pipe.send_q == NULL || s_dl_pipe.done == NULL) {
+        esp_sip_dl_stop();
+        ESP_LOGE(TAG, "No mem for download queues");
+        return ESP_ERR_NO_MEM;
+    }
+    for (int i = 0; i < SIP_DL_PIPE_DEPTH; i++) {
+        uint8_t *frame = sip->rawbuf + i * SIP_DL_SLOT_SIZE;
+        xQueueSend(s_dl_pipe.free_q, &frame, 0);
+    }
+
+    /* No affinity, so the sender can run on the other core while the caller copies */
+    if (xTaskCreatePinnedToCore(sip_dl_task, "sip_dl", SIP_DL_TASK_STACK, NULL,
+                                uxTaskPriorityGet(NULL), &s_dl_pipe.task, tskNO_AFFINITY) != pdPASS) {
+        esp_sip_dl_stop();
+        ESP_LOGE(TAG, "Create download task failed");
+        return ESP_ERR_NO_MEM;
+    }
+#endif
+    return ESP_OK;
+}
+
+/* Get a free frame buffer, waiting for an in-flight frame to complete if needed */
+static uint8_t *esp_sip_dl_get_frame(void)
+{
+#if SIP_DL_PIPE_DEPTH > 1
+    uint8_t *frame = NULL;
+
+    if (xQueueReceive(s_dl_pipe.free_q, &frame, pdMS_TO_TICKS(SIP_DL_PIPE_WAIT_MS)) != pdTRUE) {
+        ESP_LOGE(TAG, "No free download frame");
+        return NULL;
+    }
+    if (s_dl_pipe.err != ESP_OK) {
+        xQueueSend(s_dl_pipe.free_q, &frame, 0);
+        return NULL;
+    }
+    return frame;
+#else
+    return sip->rawbuf;
+#endif
+}
+
+static esp_err_t esp_sip_dl_submit(uint8_t *frame, uint16_t len)
+{
+#if SIP_DL_PIPE_DEPTH > 1
+    sip_dl_slot_t slot = {
+        .frame = frame,
+        .len = len,
+    };
+
+    /* send_q has a slot for every buffer, so this never blocks */
+    xQueueSend(s_dl_pipe.send_q, &slot, 0);
+    return ESP_OK;
+#else
+    return esp_sip_send_dl_frame(frame, len, SIP_DL_BUF_SIZE);
+#endif
+}
+
+esp_err_t esp_sip_write_flush(void)
+{
+#if SIP_DL_PIPE_DEPTH > 1
+    esp_err_t err = ESP_OK;
+    uint8_t *frame = NULL;
+
+    if (s_dl_pipe.task == NULL) {
+        return ESP_OK;
+    }
+
+    /* All buffers back in the free queue means every frame has been sent */
+    for (int i = 0; i < SIP_DL_PIPE_DEPTH; i++) {
+        if (xQueueReceive(s_dl_pipe.free_q, &frame, pdMS_TO_TICKS(SIP_DL_PIPE_WAIT_MS)) != pdTRUE) {
+            err = ESP_ERR_TIMEOUT;
+            break;
+        }
+    }
+    if (err == ESP_OK) {
+        err = s_dl_pipe.err;
+    }
+    esp_sip_dl_stop();
+
+    ESP_RETURN_ON_FALSE(err == ESP_OK, err, TAG, "Download pipeline failed 0x%X", err);
+#endif
+    return ESP_OK;
+}
+
 esp_err_t esp_sip_write_mem(uint32_t addr, const uint8_t *buf, uint32_t len)
 {
     struct sip_cmd_write_memory *cmd;
@@ -74,16 +304,10 @@ esp_err_t esp_sip_write_mem(uint32_t addr, const uint8_t *buf, uint32_t len)
     uint16_t hdrs, bufsize;
     uint32_t loadaddr;
     const uint8_t *src;
+    uint8_t *frame;
     esp_err_t err = 0;
 
-    if (sip->rawbuf == NULL) {
-        sip->rawbuf = heap_caps_malloc(SIP_BOOT_BUF_SIZE, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
-        ESP_RETURN_ON_FALSE(sip->rawbuf != NULL, ESP_ERR_NO_MEM, TAG, "No mem for rawbuf");
-    }
-
-    chdr = (struct sip_hdr *)sip->rawbuf;
-    SIP_HDR_SET_TYPE(chdr->fc[0], SIP_CTRL);
-    chdr->c_cmdid = SIP_CMD_WRITE_MEMORY;
+    ESP_RETURN_ON_ERROR(esp_sip_dl_start(), TAG, "Start download failed");
 
     remains = len;
     hdrs = sizeof(struct sip_hdr) + sizeof(struct sip_cmd_write_memory);
@@ -92,34 +316,127 @@ esp_err_t esp_sip_write_mem(uint32_t addr, const uint8_t *buf, uint32_t len)
         src = &buf[len - remains];
         loadaddr = addr + (len - remains);
 
-        if (remains < (SIP_BOOT_BUF_SIZE - hdrs)) {
+        frame = esp_sip_dl_get_frame();
+        ESP_RETURN_ON_FALSE(frame != NULL, ESP_FAIL, TAG, "Send buffer failed");
+
+        if (remains < (SIP_DL_BUF_SIZE - hdrs)) {
             /* aligned with 4 bytes */
             bufsize = roundup(remains, 4);
-            memset(sip->rawbuf + hdrs, 0x0, bufsize);
+            memset(frame + hdrs, 0x0, bufsize);
+            memcpy(frame + hdrs, src, remains);
             remains = 0;
         } else {
-            bufsize = SIP_BOOT_BUF_SIZE - hdrs;
+            bufsize = SIP_DL_BUF_SIZE - hdrs;
+            memcpy(frame + hdrs, src, bufsize);
             remains -= bufsize;
         }
 
+        chdr = (struct sip_hdr *)frame;
+        memset(chdr, 0x0, SIP_CTRL_HDR_LEN);
+        SIP_HDR_SET_TYPE(chdr->fc[0], SIP_CTRL);
+        chdr->c_cmdid = SIP_CMD_WRITE_MEMORY;
         chdr->len = bufsize + hdrs;
         chdr->seq = sip->txseq++;
-        cmd = (struct sip_cmd_write_memory *)(sip->rawbuf + SIP_CTRL_HDR_LEN);
+        cmd = (struct sip_cmd_write_memory *)(frame + SIP_CTRL_HDR_LEN);
         cmd->len = bufsize;
         cmd->addr = loadaddr;
 
-        vTaskDelay(pdMS_TO_TICKS(1));
-        memcpy(sip->rawbuf + hdrs, src, bufsize);
-        err = esp_extconn_sdio_write_bytes(1, ESP_SLAVE_CMD53_END_ADDR - chdr->len, sip->rawbuf, (chdr->len + 3) & (~3));
+        err = esp_sip_dl_submit(frame, chdr->len);
         ESP_RETURN_ON_FALSE(err == ESP_OK, ESP_FAIL, TAG, "Send buffer failed");
     }
     return ESP_OK;
 }
 
-static int esp_sip_post_init(struct sip_evt_bootup2 *bevt)
+#ifdef CONFIG_ESP_EXT_CONN_FW_COMPRESSED
+esp_err_t esp_sip_write_mem_lz(uint32_t addr, const uint8_t *src, uint16_t src_len, uint16_t raw_len, bool stored)
 {
+    struct sip_cmd_write_memory *cmd;
+    struct sip_hdr *chdr;
+    uint8_t *frame;
+    uint16_t hdrs = sizeof(struct sip_hdr) + sizeof(struct sip_cmd_write_memory);
+    esp_err_t err = ESP_OK;
+
+    ESP_RETURN_ON_FALSE(raw_len <= SIP_DL_BUF_SIZE - hdrs && (raw_len & 3) == 0, ESP_ERR_INVALID_SIZE, TAG, "Bad record len %u", raw_len);
+    ESP_RETURN_ON_ERROR(esp_sip_dl_start(), TAG, "Start download failed");
+
+    frame = esp_sip_dl_get_frame();
+    ESP_RETURN_ON_FALSE(frame != NULL, ESP_FAIL, TAG, "Send buffer failed");
+
+    /* Expand straight into the payload of the frame, no intermediate buffer */
+    if (stored) {
+        memcpy(frame + hdrs, src, raw_len);
+    } else {
+        err = ext_fw_lz_decode(src, src_len, frame + hdrs, raw_len);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Decode record at 0x%" PRIx32 " failed", addr);
+#if SIP_DL_PIPE_DEPTH > 1
+            xQueueSend(s_dl_pipe.free_q, &frame, 0);
+#endif
+            return err;
+        }
+    }
+
+    chdr = (struct sip_hdr *)frame;
+    memset(chdr, 0x0, SIP_CTRL_HDR_LEN);
+    SIP_HDR_SET_TYPE(chdr->fc[0], SIP_CTRL);
+    chdr->c_cmdid = SIP_CMD_WRITE_MEMORY;
+    chdr->len = raw_len + hdrs;
+    chdr->seq = sip->txseq++;
+    cmd = (struct sip_cmd_write_memory *)(frame + SIP_CTRL_HDR_LEN);
+    cmd->len = raw_len;
+    cmd->addr = addr;
+
+    err = esp_sip_dl_submit(frame, chdr->len);
+    ESP_RETURN_ON_FALSE(err == ESP_OK, ESP_FAIL, TAG, "Send buffer failed");
+    return ESP_OK;
+}
+#endif
+
+/*
+ * The frames sit in flash, which the SDMMC DMA can not read, so each one is staged into a
+ * pipeline buffer: the copy of a frame overlaps the transfer of the one before it, instead
+ * of the adapter bounce copying it with the bus idle. The sequence number is rewritten.
+ */
+esp_err_t esp_sip_write_frames(const uint8_t *frames, uint32_t len)
+{
+    struct sip_hdr *chdr;
+    uint32_t offset = 0;
+    uint16_t frame_len;
+    uint8_t *frame;
+    esp_err_t err = ESP_OK;
+
+    ESP_RETURN_ON_ERROR(esp_sip_dl_start(), TAG, "Start download failed");
+
+    while (offset < len) {
+        /* The frames are packed back to back, a header may straddle a word */
+        memcpy(&frame_len, &frames[offset] + offsetof(struct sip_hdr, len), sizeof(frame_len));
+        ESP_RETURN_ON_FALSE(frame_len >= SIP_CTRL_HDR_LEN && frame_len <= SIP_DL_BUF_SIZE && offset + frame_len <= len,
+                            ESP_ERR_INVALID_SIZE, TAG, "Bad frame at %" PRIu32, offset);
+
+        frame = esp_sip_dl_get_frame();
+        ESP_RETURN_ON_FALSE(frame != NULL, ESP_FAIL, TAG, "Send buffer failed");
+
+        memcpy(frame, &frames[offset], (frame_len + 3) & (~3));
+        chdr = (struct sip_hdr *)frame;
+        chdr->seq = sip->txseq++;
+
+        err = esp_sip_dl_submit(frame, frame_len);
+        ESP_RETURN_ON_FALSE(err == ESP_OK, ESP_FAIL, TAG, "Send buffer failed");
+        offset += (frame_len + 3) & (~3);
+    }
+    return ESP_OK;
+}
+
+static int esp_sip_post_init(const struct sip_evt_bootup2 *bevt)
+{
+    memcpy(&sip->boot_evt, bevt, sizeof(struct sip_evt_bootup2));
     sip->tx_blksz = bevt->tx_blksz;
     sip->rx_blksz = bevt->rx_blksz;
+    ESP_LOGI(TAG, "blksz tx %u rx %u, sdio block %u", sip->tx_blksz, sip->rx_blksz,
+             esp_extconn_sdio_get_block_size(EXT_CONN_WIFI_SDIO_FUNC));
+    if (sip->tx_blksz == 0 || esp_extconn_sdio_get_block_size(EXT_CONN_WIFI_SDIO_FUNC) % sip->tx_blksz) {
+        ESP_LOGW(TAG, "sdio block is not a multiple of tx_blksz %u", sip->tx_blksz);
+    }
     sip->credit_to_reserve = bevt->credit_to_reserve;
 
     sip->noise_floor = bevt->noise_floor;
@@ -168,9 +485,11 @@ esp_err_t esp_sip_parse_events(uint8_t *buf)
         /* use rx work queue to send... */
         if (sip->state == SIP_PREPARE_BOOT || sip->state == SIP_BOOT) {
             ESP_LOGI(TAG, "target on");
+            esp_extconn_boot_mark(ESP_EXTCONN_BOOT_TARGET_ON);
             sip->state = SIP_SEND_INIT;
             ret = sip_send_chip_init(sip);
             if (ret == ESP_OK) {
+                esp_extconn_boot_mark(ESP_EXTCONN_BOOT_CHIP_INIT);
                 sip->state = SIP_WAIT_BOOTUP;
             }
         } else {
@@ -187,7 +506,9 @@ esp_err_t esp_sip_parse_events(uint8_t *buf)
         ESP_LOGI(TAG, "SIP_EVT_BOOTUP\n");
         esp_sip_post_init(bootup_evt);
         sip->state = SIP_RUN;
-        xSemaphoreGive(boot_sem);
+        esp_extconn_boot_mark(ESP_EXTCONN_BOOT_BOOTUP);
+        xEventGroupClearBits(sip_event, SIP_LINK_DOWN_BIT);
+        xEventGroupSetBits(sip_event, SIP_READY_BIT);
         break;
     }
 #ifdef CONFIG_ESP_EXT_CONN_WIFI_ENABLE
@@ -202,6 +523,13 @@ esp_err_t esp_sip_parse_events(uint8_t *buf)
 #endif
     case SIP_EVT_CREDIT_RPT:
 
+        break;
+    case SIP_EVT_HB_ACK:
+        /* Receiving it already fed the watchdog */
+        break;
+    case SIP_EVT_RESETTING:
+        ESP_LOGW(TAG, "target resetting");
+        esp_extconn_wdt_target_reset();
         break;
     default:
         ESP_LOGW(TAG, "%s default: %u", __func__, hdr->c_evtid);
@@ -220,30 +548,138 @@ esp_err_t esp_sip_bootup(uint32_t entry_addr)
         .discard_link = 1,
     };
 
+    /* Before the send, the receive task may take SIP_EVT_BOOTUP before it returns */
+    sip->state = SIP_PREPARE_BOOT;
     if (esp_sip_send_cmd(SIP_CMD_BOOTUP, sizeof(struct sip_cmd_bootup), &bootcmd) == ESP_OK) {
-        sip->state = SIP_PREPARE_BOOT;
-        boot_sem = xSemaphoreCreateCounting(1, 0);
 #ifdef CONFIG_ESP_EXT_CONN_WIFI_ENABLE
-        if (xSemaphoreTake(boot_sem, pdMS_TO_TICKS(10000)) == pdTRUE) {
-            ret = ESP_OK;
-        } else {
-            ret = ESP_ERR_TIMEOUT;
-        }
+        ret = esp_sip_wait_ready(10000);
 #else
         ret = ESP_OK;
 #endif
     } else {
         ESP_LOGE(TAG, "bootup cmd send failed");
     }
-    vSemaphoreDelete(boot_sem);
     ESP_LOGI(TAG, "boot ret 0x%X", ret);
     return ret;
 }
 
+esp_err_t esp_sip_wait_ready(uint32_t wait_ms)
+{
+    ESP_RETURN_ON_FALSE(sip_event != NULL, ESP_ERR_INVALID_STATE, TAG, "sip not init");
+
+    TickType_t ticks = (wait_ms == UINT32_MAX) ? portMAX_DELAY : pdMS_TO_TICKS(wait_ms);
+    EventBits_t bits = xEventGroupWaitBits(sip_event, SIP_READY_BIT, pdFALSE, pdTRUE, ticks);
+    return (bits & SIP_READY_BIT) ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+bool esp_sip_is_running(void)
+{
+    return sip != NULL && sip->state == SIP_RUN;
+}
+
+bool esp_sip_is_link_down(void)
+{
+    return sip_event != NULL && (xEventGroupGetBits(sip_event) & SIP_LINK_DOWN_BIT);
+}
+
+/* Cleared again by the next bootup, a re-init of sip leaves it set */
+void esp_sip_link_down(void)
+{
+    if (sip != NULL) {
+        sip->state = SIP_STOP;
+    }
+    if (sip_event != NULL) {
+        xEventGroupSetBits(sip_event, SIP_LINK_DOWN_BIT);
+        xEventGroupClearBits(sip_event, SIP_READY_BIT);
+    }
+}
+
+esp_err_t esp_sip_send_heartbeat(void)
+{
+    uint32_t hb = 0;
+
+    ESP_RETURN_ON_FALSE(esp_sip_is_running(), ESP_ERR_INVALID_STATE, TAG, "Not running");
+    return esp_sip_send_cmd(SIP_CMD_HB_REQ, sizeof(hb), &hb);
+}
+
+esp_err_t esp_sip_get_boot_info(struct sip_evt_bootup2 *bevt)
+{
+    ESP_RETURN_ON_FALSE(sip != NULL && sip->state == SIP_RUN, ESP_ERR_INVALID_STATE, TAG, "Not running");
+    memcpy(bevt, &sip->boot_evt, sizeof(struct sip_evt_bootup2));
+    return ESP_OK;
+}
+
+esp_err_t esp_sip_warm_attach(const struct sip_evt_bootup2 *bevt, uint32_t wait_ms)
+{
+    esp_err_t err = ESP_OK;
+    size_t rlen = 0;
+    uint32_t hb = 0;
+    bool acked = false;
+
+    /* A heartbeat, sent like every command with the sync flag and seq 0, which the target takes at any time */
+    ESP_RETURN_ON_ERROR(esp_sip_send_cmd(SIP_CMD_HB_REQ, sizeof(hb), &hb), TAG, "probe send failed");
+
+    /* The receive task is not running yet, read the answer directly */
+    uint8_t *buf = esp_extconn_sdio_dma_alloc(SIP_WARM_PROBE_BUF_SIZE, NULL);
+    ESP_RETURN_ON_FALSE(buf != NULL, ESP_ERR_NO_MEM, TAG, "No mem for probe");
+
+    err = esp_extconn_sdio_get_packet(EXT_CONN_WIFI_SDIO_FUNC, buf, SIP_WARM_PROBE_BUF_SIZE, &rlen, wait_ms);
+    if (err == ESP_ERR_NOT_FINISHED || (err == ESP_OK && rlen < SIP_HDR_LEN)) {
+        err = ESP_ERR_INVALID_RESPONSE;
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "target not responding 0x%X", err);
+        free(buf);
+        return err;
+    }
+
+    /* Frames queued before the answer are dropped, the target sequence is taken from the last one */
+    uint32_t offset = 0;
+    while (offset + SIP_HDR_LEN <= rlen) {
+        struct sip_hdr *hdr = (struct sip_hdr *)(buf + offset);
+        if (hdr->len < SIP_HDR_LEN || (hdr->len & 3) != 0 || offset + hdr->len > rlen) {
+            break;
+        }
+        if (SIP_HDR_IS_CTRL(hdr) && hdr->c_evtid == SIP_EVT_HB_ACK) {
+            acked = true;
+        }
+        sip->rxseq = hdr->seq + 1;
+        offset += hdr->len;
+    }
+    free(buf);
+    if (!acked) {
+        ESP_LOGW(TAG, "no heartbeat ack in %u bytes", (unsigned)rlen);
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+
+    sip->txseq = 0;
+    esp_sip_post_init(bevt);
+    sip->state = SIP_RUN;
+    esp_extconn_boot_mark(ESP_EXTCONN_BOOT_BOOTUP);
+    xEventGroupClearBits(sip_event, SIP_LINK_DOWN_BIT);
+    xEventGroupSetBits(sip_event, SIP_READY_BIT);
+    ESP_LOGI(TAG, "warm attach rxseq=%" PRIu32, sip->rxseq);
+    return ESP_OK;
+}
+
 esp_err_t esp_sip_init(void)
 {
-    sip = calloc(1, sizeof(struct esp_sip));
-    ESP_RETURN_ON_FALSE(sip != NULL, ESP_ERR_NO_MEM, TAG, "No MEM");
+    if (sip == NULL) {
+        sip = calloc(1, sizeof(struct esp_sip));
+        ESP_RETURN_ON_FALSE(sip != NULL, ESP_ERR_NO_MEM, TAG, "No MEM");
+    } else {
+        /* Start over after a failed warm attach */
+#if SIP_DL_PIPE_DEPTH > 1
+        esp_sip_dl_stop();
+#endif
+        free(sip->rawbuf);
+        memset(sip, 0, sizeof(struct esp_sip));
+    }
+    if (sip_event == NULL) {
+        sip_event = xEventGroupCreate();
+        ESP_RETURN_ON_FALSE(sip_event != NULL, ESP_ERR_NO_MEM, TAG, "No MEM");
+    }
+    xEventGroupClearBits(sip_event, SIP_READY_BIT);
     sip->state = SIP_INIT;
 
     return ESP_OK;
@@ -254,6 +690,16 @@ uint32_t esp_sip_increase_rxseq(void)
     return sip->rxseq++;
 }
 
+uint32_t esp_sip_get_rxseq(void)
+{
+    return sip->rxseq;
+}
+
+void esp_sip_set_rxseq(uint32_t rxseq)
+{
+    sip->rxseq = rxseq;
+}
+
 uint32_t esp_sip_increase_txseq(void)
 {
     return sip->txseq++;
@@ -3,7 +3,15 @@
  *
  * SPDX-License-Identifier: Apache-2.0
  */
+#include <stddef.h>
+#include <string.h>
+
+#include "esp_attr.h"
+#include "esp_check.h"
 #include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "esp_system.h"
+#include "esp_timer.h"
 
 #include "driver/sdmmc_host.h"
 #include "driver/sdspi_host.h"
@@ -14,14 +22,57 @@
 #include "esp_extconn.h"
 #include "ext_sdio_adapter.h"
 #include "ext_default.h"
-
+#include "sdio_host_reg.h"
+
+#if CONFIG_ESP_EXT_CONN_FW_PREFRAMED
+#include "eagle_fw_frames.h"
+#elif CONFIG_ESP_EXT_CONN_FW_COMPRESSED
+#include "ext_fw_lz.h"
+#include "eagle_fw_lz.h"
+#elif CONFIG_ESP_EXT_CONN_FW_PARTITION
+#include "esp_partition.h"
+#else
 #include "eagle_fw.h"
+#ifdef CONFIG_ESP_EXT_CONN_WARM_ATTACH
+#include "eagle_fw_hash.h"
+#endif
+#endif
 
 #define FIRMWARE_MAGIC_HEADER (0xE9)
+#define WARM_INFO_MAGIC       (0x4D524157)
+
+#define CARD_PROBE_MIN_STEP_US (500)
+#define CARD_PROBE_MAX_STEP_US (100 * 1000)
+#define CARD_PROBE_TIMEOUT_MS  (5000)
+#define SPI_MAX_TRANSFER_SZ    (4096)
+
+typedef struct {
+    const uint8_t *fw;
+    uint32_t size;
+    uint32_t entry_addr;
+    uint32_t hash;      /* Generated with the image at build time, 0 if it has none */
+#if CONFIG_ESP_EXT_CONN_FW_PARTITION
+    esp_partition_mmap_handle_t handle;
+#endif
+} esp_fw_image_t;
+
+#ifdef CONFIG_ESP_EXT_CONN_WARM_ATTACH
+/* What a warm attach needs to know about the running target, kept across software resets */
+typedef struct {
+    uint32_t magic;
+    uint32_t fw_hash;
+    struct sip_evt_bootup2 boot_evt;
+    uint32_t crc;
+} esp_fw_warm_info_t;
+
+static __NOINIT_ATTR esp_fw_warm_info_t s_warm_info;
+static bool s_warm = false;
+#endif
 
 static const char *TAG = "fw_dl";
+static sdmmc_card_t *s_card = NULL;
 
-static void pins_init(void)
+static void pins_init(bool keep_on)
 {
     int reset_pin = CONFIG_ESP_EXT_CONN_SLAVE_ENABLE_PIN;
     int boot_pin = CONFIG_ESP_EXT_CONN_SLAVE_BOOT_PIN;
@@ -43,22 +94,49 @@ static void pins_init(void)
     if (boot_pin != GPIO_NUM_NC) {
         gpio_set_level(boot_pin, 0);
     }
-    gpio_set_level(reset_pin, !CONFIG_ESP_EXT_CONN_SLAVE_ENABLE_LVL);
+    /* Keep the running target enabled when attaching to it */
+    gpio_set_level(reset_pin, keep_on ? CONFIG_ESP_EXT_CONN_SLAVE_ENABLE_LVL : !CONFIG_ESP_EXT_CONN_SLAVE_ENABLE_LVL);
 }
 
 static void reset_2_dl_mode(void)
 {
     gpio_set_level(CONFIG_ESP_EXT_CONN_SLAVE_ENABLE_PIN, !CONFIG_ESP_EXT_CONN_SLAVE_ENABLE_LVL);
-    vTaskDelay(pdMS_TO_TICKS(30));
+    vTaskDelay(pdMS_TO_TICKS(CONFIG_ESP_EXT_CONN_SLAVE_RESET_HOLD_MS));
     gpio_set_level(CONFIG_ESP_EXT_CONN_SLAVE_ENABLE_PIN, CONFIG_ESP_EXT_CONN_SLAVE_ENABLE_LVL);
-    vTaskDelay(pdMS_TO_TICKS(30));
+    /* No fixed settle time, the card probe polls until the slave answers */
+}
+
+static esp_err_t sdmmc_card_probe(const sdmmc_host_t *config, sdmmc_card_t *card)
+{
+    esp_err_t ret = ESP_FAIL;
+    uint32_t step_us = CARD_PROBE_MIN_STEP_US;
+    int64_t start_us = esp_timer_get_time();
+    int tries = 0;
+
+    while (true) {
+        tries++;
+        ret = sdmmc_card_init(config, card);
+        if (ret == ESP_OK) {
+            ESP_LOGI(TAG, "sdmmc init success after %d tries, %lld us", tries, esp_timer_get_time() - start_us);
+            break;
+        }
+        if (esp_timer_get_time() - start_us >= CARD_PROBE_TIMEOUT_MS * 1000) {
+            ESP_LOGE(TAG, "slave init failed 0x%X after %d tries", ret, tries);
+            break;
+        }
+        ESP_LOGD(TAG, "slave init failed 0x%X, retry in %" PRIu32 " us", ret, step_us);
+        esp_extconn_backoff(&step_us, CARD_PROBE_MAX_STEP_US);
+    }
+
+    sdmmc_card_print_info(stdout, card);
+    return ret;
 }
 
 static sdmmc_card_t *sdmmc_init(void)
 {
+#if CONFIG_ESP_EXT_CONN_VIA_SDIO
     sdmmc_host_t config = SDMMC_HOST_DEFAULT();
 
-#if CONFIG_ESP_EXT_CONN_VIA_SDIO
     config.flags        = SDMMC_HOST_FLAG_4BIT | SDMMC_HOST_FLAG_ALLOC_ALIGNED_BUF;
     config.max_freq_khz = SDMMC_FREQ_HIGHSPEED;
 
@@ -89,6 +167,35 @@ static sdmmc_card_t *sdmmc_init(void)
     err = sdmmc_host_init_slot(CONFIG_ESP_EXT_CONN_SDIO_SLOT, &slot_config);
     ESP_ERROR_CHECK(err);
 
+#elif CONFIG_ESP_EXT_CONN_VIA_SPI
+    sdmmc_host_t config = SDSPI_HOST_DEFAULT();
+
+    config.max_freq_khz = CONFIG_ESP_EXT_CONN_SPI_FREQ_KHZ;
+
+    /* Large enough for a whole block with token and CRC as one DMA transaction */
+    spi_bus_config_t bus_config = {
+        .mosi_io_num = CONFIG_ESP_EXT_CONN_SPI_MOSI_PIN,
+        .miso_io_num = CONFIG_ESP_EXT_CONN_SPI_MISO_PIN,
+        .sclk_io_num = CONFIG_ESP_EXT_CONN_SPI_CLK_PIN,
+        .quadwp_io_num = -1,
+        .quadhd_io_num = -1,
+        .max_transfer_sz = SPI_MAX_TRANSFER_SZ,
+    };
+    esp_err_t err = spi_bus_initialize(CONFIG_ESP_EXT_CONN_SPI_HOST, &bus_config, SPI_DMA_CH_AUTO);
+    ESP_ERROR_CHECK(err);
+
+    err = sdspi_host_init();
+    ESP_ERROR_CHECK(err);
+
+    /* The slave raises its interrupt on D1, sdmmc_io_wait_int waits on that pin */
+    sdspi_device_config_t dev_config = SDSPI_DEVICE_CONFIG_DEFAULT();
+    dev_config.host_id  = CONFIG_ESP_EXT_CONN_SPI_HOST;
+    dev_config.gpio_cs  = CONFIG_ESP_EXT_CONN_SPI_CS_PIN;
+    dev_config.gpio_int = CONFIG_ESP_EXT_CONN_SPI_INT_PIN;
+
+    err = sdspi_host_init_device(&dev_config, &config.slot);
+    ESP_ERROR_CHECK(err);
+
 #else
     // TOD0
     ESP_LOGE(TAG, "ERROR Configuration");
@@ -99,40 +206,128 @@ static sdmmc_card_t *sdmmc_init(void)
     if (card == NULL) {
         return NULL;
     }
-    esp_err_t ret = ESP_FAIL;
-    for (int i = 0; i < 10; i++) {
-        ret = sdmmc_card_init(&config, card);
-        if (ret == ESP_OK) {
-            ESP_LOGI(TAG, "sdmmc init success 0x%X", ret);
-            break;
-        }
-        ESP_LOGW(TAG, "slave init failed 0x%X, retry...", ret);
-        vTaskDelay(pdMS_TO_TICKS(500));
+    sdmmc_card_probe(&config, card);
+
+    return card;
+}
+
+/* Reset the target into download mode again, reusing the host and card already set up */
+static esp_err_t esp_fw_target_reset(sdmmc_card_t *card)
+{
+    sdmmc_host_t config = card->host;
+
+    reset_2_dl_mode();
+    esp_extconn_boot_mark(ESP_EXTCONN_BOOT_RESET);
+    /* On recovery a transfer started before the link went down may still be on the bus */
+    esp_extconn_sdio_lock();
+    esp_err_t ret = sdmmc_card_probe(&config, card);
+    esp_extconn_boot_mark(ESP_EXTCONN_BOOT_CARD_INIT);
+    if (ret == ESP_OK) {
+        ret = esp_extconn_sdio_init(card, false);
+        esp_extconn_boot_mark(ESP_EXTCONN_BOOT_SDIO_START);
     }
+    esp_extconn_sdio_unlock();
+    return ret;
+}
 
-    sdmmc_card_print_info(stdout, card);
+#if CONFIG_ESP_EXT_CONN_FW_PREFRAMED
+static esp_err_t esp_fw_download(const uint8_t *fw, uint32_t size)
+{
+    uint32_t total = size;
+    int64_t start_us = esp_timer_get_time();
 
-    return card;
+    ESP_LOGI(TAG, "frames is %d", EAGLE_FW_FRAMES_NUM);
+
+    esp_err_t ret = esp_sip_write_frames(fw, total);
+    if (ret != ESP_OK) {
+        ESP_LOGI(TAG, "%s|%d, function write failed\n", __func__, __LINE__);
+        return ret;
+    }
+
+    ret = esp_sip_write_flush();
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    int64_t cost_us = esp_timer_get_time() - start_us;
+    ESP_LOGI(TAG, "download %" PRIu32 " bytes in %lld us (%lld KB/s)",
+             total, cost_us, cost_us > 0 ? (int64_t)total * 1000000 / 1024 / cost_us : 0);
+
+    return ret;
 }
+#elif CONFIG_ESP_EXT_CONN_FW_COMPRESSED
+static esp_err_t esp_fw_download(const uint8_t *fw, uint32_t size)
+{
+    esp_err_t ret = ESP_OK;
+    struct esp_fw_lz_rec rec;
+    uint32_t offset = 0;
+    uint32_t total = 0;
+    int64_t start_us = esp_timer_get_time();
+
+    ESP_LOGI(TAG, "records is %d, level %d", EAGLE_FW_LZ_NUM, EAGLE_FW_LZ_LEVEL);
+
+    for (int i = 0; i < EAGLE_FW_LZ_NUM; i++) {
+        /* Records are packed back to back, so they may be unaligned */
+        if (offset + sizeof(rec) > size) {
+            ESP_LOGE(TAG, "Truncated image at %" PRIu32, offset);
+            return ESP_ERR_INVALID_SIZE;
+        }
+        memcpy(&rec, &fw[offset], sizeof(rec));
+        offset += sizeof(rec);
+
+        uint16_t comp_len = rec.comp_len & ESP_FW_LZ_LEN_MASK;
+        if (offset + comp_len > size) {
+            ESP_LOGE(TAG, "Truncated image at %" PRIu32, offset);
+            return ESP_ERR_INVALID_SIZE;
+        }
+
+        ret = esp_sip_write_mem_lz(rec.load_addr, &fw[offset], comp_len, rec.raw_len, rec.comp_len & ESP_FW_LZ_STORED);
+        if (ret != ESP_OK) {
+            ESP_LOGI(TAG, "%s|%d, function write failed\n", __func__, __LINE__);
+            return ret;
+        }
+
+        offset += comp_len;
+        total += rec.raw_len;
+    }
+
+    ret = esp_sip_write_flush();
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    int64_t cost_us = esp_timer_get_time() - start_us;
+    ESP_LOGI(TAG, "download %" PRIu32 " bytes from %" PRIu32 " compressed in %lld us (%lld KB/s)",
+             total, size, cost_us, cost_us > 0 ? (int64_t)total * 1000000 / 1024 / cost_us : 0);
 
-static esp_err_t esp_fw_download(const uint8_t *fw)
+    return ret;
+}
+#else
+static esp_err_t esp_fw_download(const uint8_t *fw, uint32_t size)
 {
     esp_err_t ret = ESP_OK;
     struct esp_fw_hdr *fhdr = (struct esp_fw_hdr *)fw;
     struct esp_fw_blk_hdr *bhdr = NULL;
 
-    if (fhdr->magic != FIRMWARE_MAGIC_HEADER) {
+    if (size < sizeof(struct esp_fw_hdr) + 16 || fhdr->magic != FIRMWARE_MAGIC_HEADER) {
         ESP_LOGE(TAG, "Wrong magic num!");
         return ESP_FAIL;
     }
 
     uint8_t blocks = fhdr->blocks;
     uint32_t offset = sizeof(struct esp_fw_hdr) + 16;
+    uint32_t total = 0;
+    int64_t start_us = esp_timer_get_time();
 
     ESP_LOGI(TAG, "blocks is %u", blocks);
 
     while (blocks) {
         bhdr = (struct esp_fw_blk_hdr *)(&fw[offset]);
+        if (offset + sizeof(struct esp_fw_blk_hdr) > size ||
+                bhdr->data_len > size - offset - sizeof(struct esp_fw_blk_hdr)) {
+            ESP_LOGE(TAG, "Truncated image at %" PRIu32, offset);
+            return ESP_ERR_INVALID_SIZE;
+        }
         offset += sizeof(struct esp_fw_blk_hdr);
 
         ESP_LOGI(TAG, "blocks:%u ->%" PRIx32 " %" PRIu32, blocks, bhdr->load_addr, bhdr->data_len);
@@ -145,44 +340,311 @@ static esp_err_t esp_fw_download(const uint8_t *fw)
 
         blocks--;
         offset += bhdr->data_len;
+        total += bhdr->data_len;
+    }
+
+    ret = esp_sip_write_flush();
+    if (ret != ESP_OK) {
+        return ret;
     }
 
+    int64_t cost_us = esp_timer_get_time() - start_us;
+    ESP_LOGI(TAG, "download %" PRIu32 " bytes in %lld us (%lld KB/s)",
+             total, cost_us, cost_us > 0 ? (int64_t)total * 1000000 / 1024 / cost_us : 0);
+
     return ret;
 }
+#endif
 
-esp_err_t esp_extconn_fw_init(esp_extconn_config_t *config)
+#if CONFIG_ESP_EXT_CONN_FW_PARTITION
+static esp_err_t esp_fw_partition_map(const uint8_t **fw, uint32_t *size, esp_partition_mmap_handle_t *handle)
 {
-    esp_err_t ret = ESP_OK;
-    uint8_t *fw = (uint8_t *)&eagle_fw1[0];
+    const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                                           CONFIG_ESP_EXT_CONN_FW_PARTITION_LABEL);
+    if (part == NULL) {
+        ESP_LOGE(TAG, "No firmware partition \"%s\"", CONFIG_ESP_EXT_CONN_FW_PARTITION_LABEL);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    /* Map the image in place, download reads it frame by frame through the cache */
+    esp_err_t ret = esp_partition_mmap(part, 0, part->size, ESP_PARTITION_MMAP_DATA, (const void **)fw, handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "mmap partition failed 0x%X", ret);
+        return ret;
+    }
+    *size = part->size;
+
+    if ((*fw)[0] != FIRMWARE_MAGIC_HEADER) {
+        ESP_LOGE(TAG, "Wrong magic num!");
+        esp_partition_munmap(*handle);
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "firmware partition at 0x%" PRIx32 ", size %" PRIu32, part->address, part->size);
+    return ESP_OK;
+}
+#endif
+
+static esp_err_t esp_fw_image_open(esp_fw_image_t *img)
+{
+#if CONFIG_ESP_EXT_CONN_FW_PREFRAMED
+    img->fw = &eagle_fw_frames[0];
+    img->size = sizeof(eagle_fw_frames);
+    img->entry_addr = EAGLE_FW_FRAMES_ENTRY_ADDR;
+    img->hash = EAGLE_FW_FRAMES_HASH;
+#elif CONFIG_ESP_EXT_CONN_FW_COMPRESSED
+    img->fw = &eagle_fw_lz[0];
+    img->size = sizeof(eagle_fw_lz);
+    img->entry_addr = EAGLE_FW_LZ_ENTRY_ADDR;
+    img->hash = EAGLE_FW_LZ_HASH;
+#elif CONFIG_ESP_EXT_CONN_FW_PARTITION
+    esp_err_t ret = esp_fw_partition_map(&img->fw, &img->size, &img->handle);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    img->entry_addr = ((struct esp_fw_hdr *)img->fw)->entry_addr;
+    /* gen_fw_frames.py --bin puts it in the first reserved word after the header */
+    memcpy(&img->hash, img->fw + sizeof(struct esp_fw_hdr), sizeof(img->hash));
+#else
+    img->fw = &eagle_fw1[0];
+    img->size = sizeof(eagle_fw1);
+    img->entry_addr = ((struct esp_fw_hdr *)img->fw)->entry_addr;
+#ifdef CONFIG_ESP_EXT_CONN_WARM_ATTACH
+    img->hash = EAGLE_FW_HASH;
+#else
+    img->hash = 0;
+#endif
+#endif
+    return ESP_OK;
+}
+
+static void esp_fw_image_close(esp_fw_image_t *img)
+{
+#if CONFIG_ESP_EXT_CONN_FW_PARTITION
+    esp_partition_munmap(img->handle);
+#endif
+    img->fw = NULL;
+}
+
+#ifdef CONFIG_ESP_EXT_CONN_WARM_ATTACH
+static uint32_t esp_fw_warm_info_crc(void)
+{
+    return esp_rom_crc32_le(0, (const uint8_t *)&s_warm_info, offsetof(esp_fw_warm_info_t, crc));
+}
+
+static bool esp_fw_warm_candidate(void)
+{
+    /*
+     * Only a deliberate esp_restart. After a panic or a watchdog reset the link may be
+     * what failed, and the target state can not be trusted.
+     */
+    if (esp_reset_reason() != ESP_RST_SW) {
+        s_warm_info.magic = 0;
+        return false;
+    }
+    return s_warm_info.magic == WARM_INFO_MAGIC && s_warm_info.crc == esp_fw_warm_info_crc();
+}
+
+/*
+ * The hash of the running firmware is kept in CONG_W7, a scratch register of the SLC host
+ * interface. This assumes the target firmware never writes it, and relies on it reading 0
+ * after any target reset, so a target that reset on its own is never attached to.
+ */
+static esp_err_t esp_fw_target_hash(uint32_t *hash)
+{
+    return esp_extconn_sdio_read_reg(ESP_SDIO_CONG_W7, hash, sizeof(*hash));
+}
+
+static esp_err_t esp_fw_warm_attach(void)
+{
+    esp_fw_image_t img;
+    uint32_t fw_hash = 0;
+    uint32_t target_hash = 0;
+    int64_t start_us = esp_timer_get_time();
+
+    esp_err_t ret = esp_fw_image_open(&img);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    fw_hash = img.hash;
+    esp_fw_image_close(&img);
+
+    if (fw_hash != s_warm_info.fw_hash) {
+        ESP_LOGI(TAG, "firmware changed %08" PRIx32 " -> %08" PRIx32, s_warm_info.fw_hash, fw_hash);
+        return ESP_ERR_INVALID_VERSION;
+    }
+
+    ret = esp_fw_target_hash(&target_hash);
+    if (ret != ESP_OK || target_hash != fw_hash) {
+        ESP_LOGI(TAG, "target firmware %08" PRIx32 " not running", fw_hash);
+        return ret != ESP_OK ? ret : ESP_ERR_INVALID_STATE;
+    }
 
     ret = esp_sip_init();
     if (ret == ESP_OK) {
-        ret = esp_fw_download(fw);
+        ret = esp_sip_warm_attach(&s_warm_info.boot_evt, CONFIG_ESP_EXT_CONN_WARM_ATTACH_TIMEOUT_MS);
+    }
+    /* Still the same firmware once it answered, it did not reset in between */
+    if (ret == ESP_OK) {
+        ret = esp_fw_target_hash(&target_hash);
+        if (ret == ESP_OK && target_hash != fw_hash) {
+            ESP_LOGI(TAG, "target firmware changed to %08" PRIx32 " during attach", target_hash);
+            ret = ESP_ERR_INVALID_VERSION;
+        }
     }
+    if (ret == ESP_OK) {
+        ESP_LOGI(TAG, "warm attach in %lld us", esp_timer_get_time() - start_us);
+    }
+    return ret;
+}
+
+static void esp_fw_warm_save(uint32_t fw_hash)
+{
+    if (fw_hash == 0) {
+        ESP_LOGW(TAG, "firmware image has no hash, no warm attach");
+        return;
+    }
+    if (esp_sip_get_boot_info(&s_warm_info.boot_evt) != ESP_OK) {
+        return;
+    }
+
+    uint8_t *buf = esp_extconn_sdio_arena_alloc(sizeof(fw_hash));
+    if (buf == NULL) {
+        return;
+    }
+    memcpy(buf, &fw_hash, sizeof(fw_hash));
+    esp_extconn_sdio_lock();
+    esp_err_t ret = esp_extconn_sdio_write_bytes(1, ESP_SDIO_CONG_W7, buf, sizeof(fw_hash));
+    esp_extconn_sdio_unlock();
+    esp_extconn_sdio_arena_free(buf);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "save firmware hash failed 0x%X", ret);
+        return;
+    }
+
+    s_warm_info.fw_hash = fw_hash;
+    s_warm_info.magic = WARM_INFO_MAGIC;
+    s_warm_info.crc = esp_fw_warm_info_crc();
+}
+#endif
+
+/* Download the firmware image, the target must be waiting in download mode */
+static esp_err_t esp_fw_load(uint32_t *entry_addr, uint32_t *fw_hash)
+{
+    esp_fw_image_t img;
+
+    esp_err_t ret = esp_fw_image_open(&img);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    *entry_addr = img.entry_addr;
+    *fw_hash = img.hash;
+
+    ret = esp_sip_init();
+    if (ret == ESP_OK) {
+        ret = esp_fw_download(img.fw, img.size);
+        /* Frames may still be in flight on the error paths, drain them before unmapping */
+        esp_sip_write_flush();
+        esp_extconn_boot_mark(ESP_EXTCONN_BOOT_FW_DOWNLOAD);
+    }
+    esp_fw_image_close(&img);
+    return ret;
+}
+
+static esp_err_t esp_fw_bootup(uint32_t entry_addr, uint32_t fw_hash)
+{
+    esp_err_t ret = esp_sip_bootup(entry_addr);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "bootup failed");
+        return ret;
+    }
+#ifdef CONFIG_ESP_EXT_CONN_WARM_ATTACH
+    esp_fw_warm_save(fw_hash);
+#endif
+    return ret;
+}
+
+esp_err_t esp_extconn_fw_init(esp_extconn_config_t *config)
+{
+    esp_err_t ret = ESP_OK;
+    uint32_t entry_addr = 0;
+    uint32_t fw_hash = 0;
+
+#ifdef CONFIG_ESP_EXT_CONN_WARM_ATTACH
+    if (s_warm) {
+        return esp_extconn_trans_recv_init(config);
+    }
+    s_warm_info.magic = 0;
+#endif
+
+    ret = esp_fw_load(&entry_addr, &fw_hash);
     if (ret == ESP_OK) {
         ret = esp_extconn_trans_recv_init(config);
     }
     if (ret == ESP_OK) {
-        struct esp_fw_hdr *fhdr = (struct esp_fw_hdr *)fw;
+        ret = esp_fw_bootup(entry_addr, fw_hash);
+    }
+    return ret;
+}
 
-        ret = esp_sip_bootup(fhdr->entry_addr);
-        if (ret != ESP_OK) {
-            ESP_LOGE(TAG, "bootup failed");
-        }
+esp_err_t esp_extconn_fw_recover(void)
+{
+    esp_err_t ret = ESP_OK;
+    uint32_t entry_addr = 0;
+    uint32_t fw_hash = 0;
+
+    ESP_RETURN_ON_FALSE(s_card != NULL, ESP_ERR_INVALID_STATE, TAG, "target never booted");
+
+#ifdef CONFIG_ESP_EXT_CONN_WARM_ATTACH
+    s_warm_info.magic = 0;
+#endif
+
+    /* The link is down, so the transport tasks stay parked and each transfer takes the lock itself */
+    ret = esp_fw_target_reset(s_card);
+    if (ret == ESP_OK) {
+        ret = esp_fw_load(&entry_addr, &fw_hash);
     }
 
+    if (ret == ESP_OK) {
+        ret = esp_fw_bootup(entry_addr, fw_hash);
+    }
     return ret;
 }
 
 esp_err_t esp_extconn_boot(void)
 {
     esp_err_t ret = ESP_FAIL;
-    pins_init();
-    reset_2_dl_mode();
+    bool warm = false;
+
+#ifdef CONFIG_ESP_EXT_CONN_WARM_ATTACH
+    warm = esp_fw_warm_candidate();
+#endif
+    pins_init(warm);
+    esp_extconn_boot_mark(ESP_EXTCONN_BOOT_PINS_INIT);
+    if (!warm) {
+        reset_2_dl_mode();
+        esp_extconn_boot_mark(ESP_EXTCONN_BOOT_RESET);
+    }
 
     sdmmc_card_t *card = sdmmc_init();
+    esp_extconn_boot_mark(ESP_EXTCONN_BOOT_CARD_INIT);
+    s_card = card;
     if (card != NULL) {
-        ret = esp_extconn_sdio_init(card);
+        ret = esp_extconn_sdio_init(card, warm);
+        esp_extconn_boot_mark(ESP_EXTCONN_BOOT_SDIO_START);
     }
+
+#ifdef CONFIG_ESP_EXT_CONN_WARM_ATTACH
+    if (card != NULL && warm) {
+        if (ret == ESP_OK) {
+            ret = esp_fw_warm_attach();
+        }
+        s_warm = (ret == ESP_OK);
+        if (!s_warm) {
+            ESP_LOGW(TAG, "warm attach failed 0x%X, reset target", ret);
+            ret = esp_fw_target_reset(card);
+        }
+        esp_extconn_boot_set_warm(s_warm);
+    }
+#endif
     return ret;
 }
@@ -0,0 +1,52 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "ext_fw_lz.h"
+
+/*
+ * Every control byte carries 8 flags, LSB first. A set flag is a literal byte, a
+ * cleared flag is a little endian 16 bits match token: low 12 bits are distance
+ * minus 1, high 4 bits are length minus ESP_FW_LZ_MIN_MATCH.
+ */
+esp_err_t ext_fw_lz_decode(const uint8_t *src, size_t src_len, uint8_t *dst, size_t dst_len)
+{
+    size_t in = 0;
+    size_t out = 0;
+
+    while (out < dst_len) {
+        if (in >= src_len) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        uint8_t flags = src[in++];
+
+        for (int bit = 0; bit < 8 && out < dst_len; bit++, flags >>= 1) {
+            if (flags & 1) {
+                if (in >= src_len) {
+                    return ESP_ERR_INVALID_SIZE;
+                }
+                dst[out++] = src[in++];
+                continue;
+            }
+
+            if (in + 2 > src_len) {
+                return ESP_ERR_INVALID_SIZE;
+            }
+            uint16_t token = src[in] | (src[in + 1] << 8);
+            size_t dist = (token & 0xfff) + 1;
+            size_t len = (token >> 12) + ESP_FW_LZ_MIN_MATCH;
+            in += 2;
+
+            if (dist > out || len > dst_len - out) {
+                return ESP_ERR_INVALID_STATE;
+            }
+            while (len--) {
+                dst[out] = dst[out - dist];
+                out++;
+            }
+        }
+    }
+
+    return in == src_len ? ESP_OK : ESP_ERR_INVALID_SIZE;
+}
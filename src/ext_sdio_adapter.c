@@ -4,43 +4,125 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 #include <string.h>
+#include <sys/param.h>
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "esp_attr.h"
 #include "esp_heap_caps.h"
 #include "esp_dma_utils.h"
 
 #include "sd_protocol_defs.h"
 #include "esp_check.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "ext_default.h"
+#include "esp_extconn.h"
 #include "ext_sdio_adapter.h"
 #include "sdio_host_reg.h"
-#include "esp_extconn_sdmmc.h"
+
+#define SDIO_START_MIN_STEP_US (500)
+#define SDIO_START_MAX_STEP_US (100 * 1000)
+#define SDIO_START_TIMEOUT_MS  (10000)
+
+/* Status registers fetched by one snapshot read, TOKEN_RDATA up to PKT_LEN */
+#define SDIO_SNAPSHOT_BASE     ESP_SDIO_TOKEN_RDATA
+#define SDIO_SNAPSHOT_LEN      (ESP_SDIO_PKT_LEN + 4 - SDIO_SNAPSHOT_BASE)
+#define SDIO_SNAPSHOT_WORD(reg) (((reg) - SDIO_SNAPSHOT_BASE) / 4)
+/* Both interrupt clear registers are acknowledged with one write */
+#define SDIO_INT_CLR_LEN       (ESP_SDIO_SLC1_INT_CLR + 4 - ESP_SDIO_SLC0_INT_CLR)
+/* Register accesses up to this many bytes use CMD52, which has no data phase to set up */
+#define SDIO_CMD52_MAX_BYTES   (2)
+#define SDIO_REG_BENCH_ROUNDS  (1000)
+
+#define SDIO_RETRY_MIN_STEP_US (50)
+#define SDIO_RETRY_MAX_STEP_US (10 * 1000)
+/* An error adds this much to the error score, a clean transfer takes 1 off */
+#define SDIO_ERR_WEIGHT        (8)
+#define SDIO_CLK_MIN_KHZ       (SDMMC_FREQ_PROBING * 10)
+
+/* Polling of an empty packet length, a few us to catch a length still being updated */
+#define SDIO_RX_WAIT_MIN_STEP_US (20)
+#define SDIO_RX_WAIT_MAX_STEP_US (1000)
 
 typedef struct {
-    sdmmc_card_t *card;
+    const esp_extconn_sdio_ops_t *ops;
+    void *ctx;
     uint32_t total_tx;
     uint32_t total_rx;
+    uint16_t block_size[EXT_CONN_BT_SDIO_FUNC + 1];   /* Negotiated in esp_extconn_sdio_start */
+    esp_extconn_sdio_snapshot_t snap;
+    uint32_t snap_valid;                              /* BIT(function) while snap.rx_len is unused */
+    uint32_t err_score;                               /* Recent errors, the clock steps down at the limit */
+    uint32_t clk_khz;
+    int64_t recover_start_us;                         /* First error of the transfer being recovered */
+    esp_extconn_sdio_stats_t stats;
 } sdio_host_t;
 
 static const char *TAG = "esp_host";
 static sdio_host_t *host = NULL;
+/* Kept across software resets, so a warm attach continues the slave counters */
+static __NOINIT_ATTR sdio_host_t s_host;
+/*
+ * Register snapshots and acknowledgements take a buffer of the arena slot reserved at init,
+ * one per transfer, so they do not rely on the caller holding the SDIO lock
+ */
+#define SDIO_REG_BUF_SIZE      (EXT_CONN_SDIO_DMA_ALIGN)
+#define SDIO_REG_BUFS          (EXT_CONN_SDIO_ARENA_SLOT_SIZE / SDIO_REG_BUF_SIZE)
+
+/* Preallocated DMA buffers for control path transfers */
+typedef struct {
+    uint8_t *base;
+    uint32_t used;      /* BIT(slot) while handed out */
+    uint32_t reg_used;  /* BIT(n) while register buffer n of slot 0 is handed out */
+    portMUX_TYPE lock;
+} sdio_arena_t;
+
+static sdio_arena_t s_arena = {
+    .lock = portMUX_INITIALIZER_UNLOCKED,
+};
+
+/* One shot timer for sub tick sleeps, taken in turn by the callers under s_wait_lock */
+static esp_timer_handle_t s_wait_timer = NULL;
+static SemaphoreHandle_t s_wait_sem = NULL;
+static SemaphoreHandle_t s_wait_lock = NULL;
 
 static esp_err_t esp_extconn_sdio_init_slave_link(void);
+static uint32_t *extconn_sdio_reg_take(void);
+static void extconn_sdio_reg_give(uint32_t *buf);
 
-static esp_err_t extconn_sdio_read_bytes(sdmmc_card_t* card, uint32_t function,
-                                         uint32_t addr, void* dst, size_t size)
+static esp_err_t extconn_sdio_dma_info(esp_dma_mem_info_t *dma_mem_info)
 {
-    uint8_t *pc_dst = dst;
-    uint32_t arg = SD_ARG_CMD53_READ;
+    if (host == NULL || host->ops->get_dma_info == NULL) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    return host->ops->get_dma_info(host->ctx, dma_mem_info);
+}
 
-    if (function == EXT_CONN_WIFI_SDIO_FUNC) {
-        arg |= SD_ARG_CMD53_INCREMENT;
+/*
+ * The SDMMC driver copies through a bounce buffer whenever a transfer is not DMA capable
+ * as is. Hot path buffers are allocated so that never happens, this counts the misses.
+ */
+static inline void extconn_sdio_check_bounce(const void *buf, size_t size)
+{
+    if (unlikely(!esp_extconn_sdio_dma_capable(buf, size))) {
+        host->stats.bounce++;
+        ESP_LOGD(TAG, "bounce %p len %u", buf, (unsigned)size);
     }
+}
+
+static esp_err_t extconn_sdio_read_bytes(uint32_t function, uint32_t addr, void* dst, size_t size)
+{
+    uint8_t *pc_dst = dst;
 
     while (size > 0) {
-        size_t size_aligned = size & (~3);
+        /* A byte mode transfer can not be longer than the function block size */
+        size_t size_aligned = MIN(size, host->block_size[function]) & (~3);
         size_t will_transfer = size_aligned > 0 ? size_aligned : size;
 
-        esp_err_t err = sdmmc_io_rw_extended(card, function, addr, arg,
-                                             pc_dst, will_transfer);
+        extconn_sdio_check_bounce(pc_dst, will_transfer);
+        esp_err_t err = host->ops->read_bytes(host->ctx, function, addr, pc_dst, will_transfer);
         if (unlikely(err != ESP_OK)) {
             return err;
         }
@@ -51,22 +133,17 @@ static esp_err_t extconn_sdio_read_bytes(sdmmc_card_t* card, uint32_t function,
     return ESP_OK;
 }
 
-static esp_err_t extconn_sdio_write_bytes(sdmmc_card_t* card, uint32_t function,
-                                          uint32_t addr, const void* src, size_t size)
+static esp_err_t extconn_sdio_write_bytes(uint32_t function, uint32_t addr, const void* src, size_t size)
 {
     const uint8_t *pc_src = (const uint8_t*) src;
-    uint32_t arg = SD_ARG_CMD53_WRITE;
-
-    if (function == EXT_CONN_WIFI_SDIO_FUNC) {
-        arg |= SD_ARG_CMD53_INCREMENT;
-    }
 
     while (size > 0) {
-        size_t size_aligned = size & (~3);
+        /* A byte mode transfer can not be longer than the function block size */
+        size_t size_aligned = MIN(size, host->block_size[function]) & (~3);
         size_t will_transfer = size_aligned > 0 ? size_aligned : size;
 
-        esp_err_t err = sdmmc_io_rw_extended(card, function, addr, arg,
-                                             (void*) pc_src, will_transfer);
+        extconn_sdio_check_bounce(pc_src, will_transfer);
+        esp_err_t err = host->ops->write_bytes(host->ctx, function, addr, pc_src, will_transfer);
         if (unlikely(err != ESP_OK)) {
             return err;
         }
@@ -77,44 +154,402 @@ static esp_err_t extconn_sdio_write_bytes(sdmmc_card_t* card, uint32_t function,
     return ESP_OK;
 }
 
-static esp_err_t extconn_sdio_read_blocks(sdmmc_card_t* card, uint32_t function,
-                                          uint32_t addr, void* dst, size_t size)
+void *esp_extconn_sdio_dma_alloc(size_t size, size_t *actual_size)
 {
-    uint32_t arg = SD_ARG_CMD53_READ | SD_ARG_CMD53_BLOCK_MODE;
+    esp_dma_mem_info_t dma_mem_info = {
+        .extra_heap_caps = MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL,
+        .dma_alignment_bytes = EXT_CONN_SDIO_DMA_ALIGN,
+    };
+    void *buf = NULL;
+    size_t size_out = 0;
+
+    extconn_sdio_dma_info(&dma_mem_info);
+    dma_mem_info.dma_alignment_bytes = MAX(dma_mem_info.dma_alignment_bytes, EXT_CONN_SDIO_DMA_ALIGN);
+    if (esp_dma_capable_malloc(size, &dma_mem_info, &buf, &size_out) != ESP_OK) {
+        return NULL;
+    }
+    if (actual_size) {
+        *actual_size = size_out;
+    }
+    return buf;
+}
 
-    if (function == EXT_CONN_WIFI_SDIO_FUNC) {
-        arg |= SD_ARG_CMD53_INCREMENT;
+/* Block mode CMD53 with the negotiated block size of the function */
+static esp_err_t extconn_sdio_read_blocks(uint32_t function, uint32_t addr, void* dst, size_t size)
+{
+    uint16_t block_size = host->block_size[function];
+
+    if (unlikely(size % block_size != 0)) {
+        return ESP_ERR_INVALID_SIZE;
     }
+    extconn_sdio_check_bounce(dst, size);
+    return host->ops->read_blocks(host->ctx, function, addr, dst, size, block_size);
+}
 
-    if (unlikely(size % 4 != 0)) {
+static esp_err_t extconn_sdio_write_blocks(uint32_t function, uint32_t addr, const void* src, size_t size)
+{
+    uint16_t block_size = host->block_size[function];
+
+    if (unlikely(size % block_size != 0)) {
         return ESP_ERR_INVALID_SIZE;
     }
-    return sdmmc_io_rw_extended(card, function, addr, arg, dst, size);
+    extconn_sdio_check_bounce(src, size);
+    return host->ops->write_blocks(host->ctx, function, addr, src, size, block_size);
 }
 
-static esp_err_t extconn_sdio_write_blocks(sdmmc_card_t* card, uint32_t function,
-                                           uint32_t addr, const void* src, size_t size)
+/*
+ * Transfer length for a byte mode tail of len bytes, with room bytes available at the buffer.
+ * Function 1 ends the packet by address, so the tail may run past it: up to whole cache lines
+ * the SDMMC DMA takes without a bounce copy when they fit, else up to whole words.
+ */
+static size_t extconn_sdio_tail_len(uint32_t function, size_t len, size_t room)
 {
-    uint32_t arg = SD_ARG_CMD53_WRITE | SD_ARG_CMD53_BLOCK_MODE;
+    size_t aligned = EXT_CONN_SDIO_DMA_ALIGN_UP(len);
 
-    if (function == EXT_CONN_WIFI_SDIO_FUNC) {
-        arg |= SD_ARG_CMD53_INCREMENT;
+    if (function == EXT_CONN_WIFI_SDIO_FUNC && aligned <= host->block_size[function] && aligned <= room) {
+        return aligned;
     }
+    return (len + 3) & (~3);
+}
 
-    if (unlikely(size % 4 != 0)) {
-        return ESP_ERR_INVALID_SIZE;
+/* Commands extconn_sdio_read/write_bytes issues for size bytes */
+static inline uint32_t extconn_sdio_bytes_cmds(size_t size)
+{
+    return ((size & ~3) ? 1 : 0) + ((size & 3) ? 1 : 0);
+}
+
+/*
+ * Length to transfer for the last len bytes of a packet in a buffer of buf_size bytes.
+ * In padded mode a tail that is not whole blocks is rounded up when the buffer has room,
+ * so the transfer is one block mode command instead of a block and a byte command.
+ */
+static size_t extconn_sdio_pad_len(uint32_t function, size_t len, size_t buf_size)
+{
+#ifdef CONFIG_ESP_EXT_CONN_SDIO_PAD_TO_BLOCK
+    uint16_t block_size = host->block_size[function];
+    size_t padded = esp_extconn_sdio_pad_len(function, len);
+
+    /* Only function 1 finds the packet end by address, function 2 would take the padding as data */
+    if (function != EXT_CONN_WIFI_SDIO_FUNC) {
+        return len;
+    }
+
+    /* Below one block it is a single command anyway, padding would only cost bus time */
+    if (len > block_size && padded != len && padded <= buf_size) {
+        host->stats.cmd53_saved += extconn_sdio_bytes_cmds(len % block_size);
+        return padded;
+    }
+#else
+    (void)function;
+    (void)buf_size;
+#endif
+    return len;
+}
+
+/* Bytes of a register value that are not zero */
+static inline int extconn_sdio_reg_bytes(uint32_t value)
+{
+    int n = 0;
+    for (; value; value >>= 8) {
+        n += (value & 0xff) ? 1 : 0;
+    }
+    return n;
+}
+
+/* Write 1 to clear registers ignore zero bytes, so only the bytes with bits set are written */
+static esp_err_t extconn_sdio_write_clr(uint32_t addr, uint32_t bits)
+{
+    if (extconn_sdio_reg_bytes(bits) > SDIO_CMD52_MAX_BYTES) {
+        uint32_t *reg = extconn_sdio_reg_take();
+        ESP_RETURN_ON_FALSE(reg != NULL, ESP_ERR_NO_MEM, TAG, "no register buffer");
+        reg[0] = bits;
+        esp_err_t err = extconn_sdio_write_bytes(1, addr, reg, 4);
+        extconn_sdio_reg_give(reg);
+        return err;
+    }
+
+    for (int i = 0; bits; i++, bits >>= 8) {
+        if (bits & 0xff) {
+            esp_err_t err = host->ops->write_byte(host->ctx, EXT_CONN_WIFI_SDIO_FUNC, addr + i, bits & 0xff, NULL);
+            if (unlikely(err != ESP_OK)) {
+                return err;
+            }
+            host->stats.cmd52++;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_extconn_sdio_read_reg(uint32_t addr, void *dst, size_t size)
+{
+    uint8_t *p = dst;
+
+    if (size > SDIO_CMD52_MAX_BYTES) {
+        uint8_t *buf = esp_extconn_sdio_arena_alloc(size);
+        ESP_RETURN_ON_FALSE(buf != NULL, ESP_ERR_NO_MEM, TAG, "Fatal: Sufficient memory");
+        esp_err_t err = extconn_sdio_read_bytes(1, addr, buf, size);
+        if (err == ESP_OK) {
+            memcpy(dst, buf, size);
+        }
+        esp_extconn_sdio_arena_free(buf);
+        return err;
+    }
+
+    for (size_t i = 0; i < size; i++) {
+        esp_err_t err = host->ops->read_byte(host->ctx, EXT_CONN_WIFI_SDIO_FUNC, addr + i, &p[i]);
+        if (unlikely(err != ESP_OK)) {
+            return err;
+        }
+        host->stats.cmd52++;
+    }
+    return ESP_OK;
+}
+
+#ifdef CONFIG_ESP_EXT_CONN_SDIO_FAULT_INJECT
+/* Fail one command in CONFIG_ESP_EXT_CONN_SDIO_FAULT_RATE, as if its CRC was bad */
+static inline bool extconn_sdio_fault(void)
+{
+    return esp_random() % CONFIG_ESP_EXT_CONN_SDIO_FAULT_RATE == 0;
+}
+#else
+#define extconn_sdio_fault() (false)
+#endif
+
+/* Terminate the transfer in progress on the function, CCCR ASx selects the function */
+static esp_err_t extconn_sdio_abort(uint32_t function)
+{
+    esp_err_t err = host->ops->write_byte(host->ctx, 0, SD_IO_CCCR_CTL, function & 0x7, NULL);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "abort function %" PRIu32 " failed 0x%X", function, err);
+    }
+    return err;
+}
+
+/* Step the bus clock down to half, once the link keeps failing at the current one */
+static void extconn_sdio_downshift(void)
+{
+    uint32_t khz = host->clk_khz / 2;
+
+    if (khz < SDIO_CLK_MIN_KHZ || host->ops->set_clk == NULL) {
+        return;
+    }
+    if (host->ops->set_clk(host->ctx, khz) == ESP_OK) {
+        ESP_LOGW(TAG, "sdio errors, clock %" PRIu32 " -> %" PRIu32 " kHz", host->clk_khz, khz);
+        host->clk_khz = khz;
+        host->stats.clk_downshifts++;
+    }
+}
+
+/*
+ * A counter that drifted from the slave shows up as more credits or pending bytes than the
+ * slave can ever have. Take the slave value then, the data in between is lost anyway.
+ */
+static void extconn_sdio_resync(void)
+{
+    uint32_t *reg = extconn_sdio_reg_take();
+
+    if (reg == NULL) {
+        return;
+    }
+    if (extconn_sdio_read_bytes(1, ESP_SDIO_TOKEN_RDATA, reg, 4) == ESP_OK) {
+        uint32_t token = (reg[0] >> ESP_SDIO_SEND_OFFSET) & TX_BUFFER_MASK;
+        if ((token + TX_BUFFER_MAX - host->total_tx) % TX_BUFFER_MAX > TX_BUFFER_MAX / 2) {
+            ESP_LOGW(TAG, "resync total_tx %" PRIu32 " -> %" PRIu32, host->total_tx, token);
+            host->total_tx = token;
+            host->stats.resyncs++;
+        }
+    }
+    if (extconn_sdio_read_bytes(1, ESP_SDIO_PKT_LEN, reg, 4) == ESP_OK) {
+        uint32_t pkt_len = reg[0] & RX_BYTE_MASK;
+        if ((pkt_len + RX_BYTE_MAX - host->total_rx) % RX_BYTE_MAX > RX_BYTE_MAX / 2) {
+            ESP_LOGW(TAG, "resync total_rx %" PRIu32 " -> %" PRIu32, host->total_rx, pkt_len);
+            host->total_rx = pkt_len;
+            host->stats.resyncs++;
+        }
+    }
+    extconn_sdio_reg_give(reg);
+}
+
+/*
+ * Abort the failed transfer and account the error, stepping the clock down when they pile up.
+ * A lost response does not tell how far the data phase got, so every error aborts. Returns
+ * whether the abort went through, the slave then holds nothing of the transfer.
+ */
+static bool extconn_sdio_on_error(uint32_t function)
+{
+    host->stats.errors++;
+    if (host->recover_start_us == 0) {
+        host->recover_start_us = esp_timer_get_time();
+    }
+    bool aborted = extconn_sdio_abort(function) == ESP_OK;
+    host->err_score += SDIO_ERR_WEIGHT;
+    if (host->err_score >= SDIO_ERR_WEIGHT * CONFIG_ESP_EXT_CONN_SDIO_DOWNSHIFT_ERRORS) {
+        host->err_score = 0;
+        extconn_sdio_downshift();
+    }
+    return aborted;
+}
+
+static void extconn_sdio_on_success(void)
+{
+    if (host->err_score) {
+        host->err_score--;
+    }
+    if (unlikely(host->recover_start_us)) {
+        uint32_t us = esp_timer_get_time() - host->recover_start_us;
+        host->recover_start_us = 0;
+        if (us > host->stats.recover_max_us) {
+            host->stats.recover_max_us = us;
+        }
+    }
+}
+
+static void extconn_sdio_wait_timer_cb(void *arg)
+{
+    (void)arg;
+    xSemaphoreGive(s_wait_sem);
+}
+
+static esp_err_t extconn_sdio_wait_init(void)
+{
+    if (s_wait_timer != NULL) {
+        return ESP_OK;
+    }
+    s_wait_sem = xSemaphoreCreateBinary();
+    ESP_RETURN_ON_FALSE(s_wait_sem != NULL, ESP_ERR_NO_MEM, TAG, "wait sem create failed");
+    s_wait_lock = xSemaphoreCreateMutex();
+    ESP_RETURN_ON_FALSE(s_wait_lock != NULL, ESP_ERR_NO_MEM, TAG, "wait lock create failed");
+
+    const esp_timer_create_args_t args = {
+        .callback = extconn_sdio_wait_timer_cb,
+        .name = "sdio_wait",
+    };
+    return esp_timer_create(&args, &s_wait_timer);
+}
+
+/*
+ * Block the calling task for us microseconds, independent of the tick rate. Callers may not
+ * hold the SDIO lock, the boot path runs without one, so they take the timer in turn.
+ */
+static void extconn_sdio_sleep_us(uint32_t us)
+{
+    xSemaphoreTake(s_wait_lock, portMAX_DELAY);
+    esp_err_t err = esp_timer_start_once(s_wait_timer, us);
+    if (err == ESP_OK) {
+        xSemaphoreTake(s_wait_sem, portMAX_DELAY);
+    }
+    xSemaphoreGive(s_wait_lock);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "wait timer start failed 0x%x, sleeping a tick", err);
+        vTaskDelay(1);
+    }
+}
+
+/*
+ * Whether a transfer that failed with err is tried again. Only bus errors are, after an
+ * abort and a backoff; once the retries are used up the counters are checked against the slave.
+ */
+static bool extconn_sdio_retry(uint32_t function, esp_err_t err, int attempt, uint32_t *step_us)
+{
+    if (err != ESP_ERR_INVALID_CRC && err != ESP_ERR_TIMEOUT && err != ESP_ERR_INVALID_RESPONSE) {
+        return false;
+    }
+    /* Without the abort part of a packet may still sit in the slave, sent whole it would merge with it */
+    if (!extconn_sdio_on_error(function) || attempt >= CONFIG_ESP_EXT_CONN_SDIO_RETRY_MAX) {
+        host->stats.failures++;
+        host->recover_start_us = 0;
+        extconn_sdio_resync();
+        return false;
+    }
+    host->stats.retries++;
+    /* The caller holds the bus lock, so sleep on the timer rather than spin through the backoff */
+    extconn_sdio_sleep_us(*step_us);
+    *step_us = MIN(*step_us * 2, SDIO_RETRY_MAX_STEP_US);
+    /* The transfer goes again against the slave counters as they are after the abort */
+    extconn_sdio_resync();
+    return true;
+}
+
+/* Read of status registers, which can be repeated as often as needed */
+static esp_err_t extconn_sdio_read_status(uint32_t addr, void *dst, size_t size)
+{
+    uint32_t step_us = SDIO_RETRY_MIN_STEP_US;
+    esp_err_t err = ESP_OK;
+
+    for (int attempt = 0; ; attempt++) {
+        err = extconn_sdio_fault() ? ESP_ERR_INVALID_CRC : extconn_sdio_read_bytes(1, addr, dst, size);
+        if (err == ESP_OK) {
+            extconn_sdio_on_success();
+            return ESP_OK;
+        }
+        if (!extconn_sdio_retry(EXT_CONN_WIFI_SDIO_FUNC, err, attempt, &step_us)) {
+            return err;
+        }
+    }
+}
+
+#ifdef CONFIG_ESP_EXT_CONN_SDIO_REG_BENCH
+/* Average latency of a one byte register read with CMD52 and of a word read with CMD53 */
+static void extconn_sdio_bench_reg(void)
+{
+    uint8_t byte = 0;
+    uint32_t *word = esp_extconn_sdio_arena_alloc(sizeof(uint32_t));
+    if (word == NULL) {
+        return;
     }
-    return sdmmc_io_rw_extended(card, function, addr, arg, (void*) src, size);
+
+    int64_t start_us = esp_timer_get_time();
+    for (int i = 0; i < SDIO_REG_BENCH_ROUNDS; i++) {
+        host->ops->read_byte(host->ctx, EXT_CONN_WIFI_SDIO_FUNC, ESP_SDIO_CONFIG_W1, &byte);
+    }
+    int64_t cmd52_us = esp_timer_get_time() - start_us;
+
+    start_us = esp_timer_get_time();
+    for (int i = 0; i < SDIO_REG_BENCH_ROUNDS; i++) {
+        extconn_sdio_read_bytes(1, ESP_SDIO_CONFIG_W1, word, sizeof(uint32_t));
+    }
+    int64_t cmd53_us = esp_timer_get_time() - start_us;
+    esp_extconn_sdio_arena_free(word);
+
+    ESP_LOGI(TAG, "register read over %d rounds: CMD52 %lld ns, CMD53 %lld ns", SDIO_REG_BENCH_ROUNDS,
+             cmd52_us * 1000 / SDIO_REG_BENCH_ROUNDS, cmd53_us * 1000 / SDIO_REG_BENCH_ROUNDS);
 }
+#endif
 
 esp_err_t esp_extconn_sdio_write_bytes(uint32_t function, uint32_t addr, void *src, size_t size)
 {
-    return extconn_sdio_write_bytes(host->card, function, addr, src, size);
+    return extconn_sdio_write_bytes(function, addr, src, size);
 }
 
 esp_err_t esp_extconn_sdio_read_bytes(uint32_t function, uint32_t addr, void *src, size_t size)
 {
-    return extconn_sdio_read_bytes(host->card, function, addr, src, size);
+    return extconn_sdio_read_bytes(function, addr, src, size);
+}
+
+/*
+ * Program the block size of a function into its FBR and use what the card reads back,
+ * the card may clamp it to the maximum it supports.
+ */
+static esp_err_t extconn_sdio_set_block_size(uint32_t function, uint16_t block_size)
+{
+    size_t offset = function * 0x100;
+    const uint8_t *bs_u8 = (const uint8_t *)&block_size;
+    uint16_t bs_read = 0;
+    uint8_t *bs_read_u8 = (uint8_t *)&bs_read;
+
+    ESP_RETURN_ON_ERROR(host->ops->write_byte(host->ctx, 0, offset + SD_IO_CCCR_BLKSIZEL, bs_u8[0], NULL), TAG, "write BLKSIZEL failed");
+    ESP_RETURN_ON_ERROR(host->ops->write_byte(host->ctx, 0, offset + SD_IO_CCCR_BLKSIZEH, bs_u8[1], NULL), TAG, "write BLKSIZEH failed");
+    ESP_RETURN_ON_ERROR(host->ops->read_byte(host->ctx, 0, offset + SD_IO_CCCR_BLKSIZEL, &bs_read_u8[0]), TAG, "read BLKSIZEL failed");
+    ESP_RETURN_ON_ERROR(host->ops->read_byte(host->ctx, 0, offset + SD_IO_CCCR_BLKSIZEH, &bs_read_u8[1]), TAG, "read BLKSIZEH failed");
+
+    ESP_RETURN_ON_FALSE(bs_read != 0 && bs_read % 4 == 0 && bs_read <= EXT_CONN_SDIO_DRIVER_BLOCK_SIZE,
+                        ESP_ERR_NOT_SUPPORTED, TAG, "Function %" PRIu32 " block size %u unusable", function, bs_read);
+    if (bs_read != block_size) {
+        ESP_LOGW(TAG, "Function %" PRIu32 " block size %u, wanted %u", function, bs_read, block_size);
+    }
+    ESP_LOGI(TAG, "Function %" PRIu32 " BS: %u", function, bs_read);
+    host->block_size[function] = bs_read;
+    return ESP_OK;
 }
 
 static esp_err_t esp_extconn_sdio_start(void)
@@ -122,97 +557,192 @@ static esp_err_t esp_extconn_sdio_start(void)
     esp_err_t err = ESP_FAIL;
     uint8_t ioe = 0, ie = 0;
 
-    err = sdmmc_send_cmd_go_idle_state(host->card);
+    uint32_t step_us = SDIO_START_MIN_STEP_US;
+    int64_t start_us = esp_timer_get_time();
+
+    err = host->ops->go_idle(host->ctx);
     while (err == ESP_ERR_INVALID_RESPONSE) {
-        ESP_LOGE(TAG, "Please restart slave and test again,error code:%d", err);
-        vTaskDelay(pdMS_TO_TICKS(1000));
-        err = sdmmc_send_cmd_go_idle_state(host->card);
+        if (esp_timer_get_time() - start_us >= SDIO_START_TIMEOUT_MS * 1000) {
+            ESP_LOGE(TAG, "Please restart slave and test again,error code:%d", err);
+            break;
+        }
+        esp_extconn_backoff(&step_us, SDIO_START_MAX_STEP_US);
+        err = host->ops->go_idle(host->ctx);
     }
     ESP_RETURN_ON_FALSE(err == ESP_OK, err, TAG, "Send CMD0 error");
-
-#if 0  //TODO IDF-9387
-    if (host_is_spi(host->card)) {
-        /* IO_SEND_OP_COND(CMD5), Determine if the card is an IO card. */
-        err = sdmmc_io_send_op_cond(host->card, MMC_OCR_3_3V_3_4V, NULL);
-        ESP_RETURN_ON_FALSE(err == ESP_OK, err, TAG, "Send CMD5 error");
-
-        /* Disable CRC16 checks for data transfers in SPI mode */
-        err = sdmmc_send_cmd_crc_on_off(host->card, false);
-        ESP_RETURN_ON_FALSE(err == ESP_OK, err, TAG, "Close CRC error");
-    }
-#endif
+    ESP_LOGI(TAG, "CMD0 ready in %lld us", esp_timer_get_time() - start_us);
 
     /* Enable function 1 */
     ioe |= BIT(1) | BIT(2);
-    err = sdmmc_io_write_byte(host->card, 0, SD_IO_CCCR_FN_ENABLE, ioe, &ioe);
+    err = host->ops->write_byte(host->ctx, 0, SD_IO_CCCR_FN_ENABLE, ioe, &ioe);
     ESP_RETURN_ON_FALSE(err == ESP_OK, err, TAG, "Set function 1 failed");
     ESP_LOGI(TAG, "IOE: 0x%02x", ioe);
 
     /* Enable interrupts for function 1&2 and master enable */
     ie |= BIT(0) | BIT(1) | BIT(2);
-    err = sdmmc_io_write_byte(host->card, 0, SD_IO_CCCR_INT_ENABLE, ie, &ie);
+    err = host->ops->write_byte(host->ctx, 0, SD_IO_CCCR_INT_ENABLE, ie, &ie);
     ESP_RETURN_ON_FALSE(err == ESP_OK, err, TAG, "Set interrupts failed");
     ESP_LOGI(TAG, "IE: 0x%02x", ie);
 
     // Get bus width register
     uint8_t bus_width;
-    err = sdmmc_io_read_byte(host->card, 0, SD_IO_CCCR_BUS_WIDTH, &bus_width);
+    err = host->ops->read_byte(host->ctx, 0, SD_IO_CCCR_BUS_WIDTH, &bus_width);
     ESP_RETURN_ON_FALSE(err == ESP_OK, err, TAG, "Get bus width failed");
     ESP_LOGI(TAG, "BUS_WIDTH GET: 0x%02x", bus_width);
 
     // Set bus width register
     bus_width |= CCCR_BUS_WIDTH_ECSI;
-    err = sdmmc_io_write_byte(host->card, 0, SD_IO_CCCR_BUS_WIDTH, bus_width, &bus_width);
+    err = host->ops->write_byte(host->ctx, 0, SD_IO_CCCR_BUS_WIDTH, bus_width, &bus_width);
     ESP_RETURN_ON_FALSE(err == ESP_OK, err, TAG, "Set bus width failed");
     ESP_LOGI(TAG, "BUS_WIDTH SET: 0x%02x", bus_width);
 
-    uint16_t bs = 512;
-    const uint8_t *bs_u8 = (const uint8_t *)&bs;
-    uint16_t bs_read = 0;
-    uint8_t *bs_read_u8 = (uint8_t *)&bs_read;
+    for (uint32_t function = EXT_CONN_WIFI_SDIO_FUNC; function <= EXT_CONN_BT_SDIO_FUNC; function++) {
+        err = extconn_sdio_set_block_size(function, CONFIG_ESP_EXT_CONN_SDIO_BLOCK_SIZE);
+        ESP_RETURN_ON_ERROR(err, TAG, "Set function %" PRIu32 " block size failed", function);
+    }
 
-    // Set block sizes for functions 1 to given value (default value = 512).
-    size_t offset = 0x100;
-    sdmmc_io_read_byte(host->card, 0, 0x100 + SD_IO_CCCR_BLKSIZEL, &bs_read_u8[0]);
-    sdmmc_io_read_byte(host->card, 0, offset + SD_IO_CCCR_BLKSIZEH, &bs_read_u8[1]);
-    ESP_LOGI(TAG, "Function 1 read: %04x", (int)bs_read);
-
-    sdmmc_io_write_byte(host->card, 0, offset + SD_IO_CCCR_BLKSIZEL, bs_u8[0], NULL);
-    sdmmc_io_write_byte(host->card, 0, offset + SD_IO_CCCR_BLKSIZEH, bs_u8[1], NULL);
-    sdmmc_io_read_byte(host->card, 0, offset + SD_IO_CCCR_BLKSIZEL, &bs_read_u8[0]);
-    sdmmc_io_read_byte(host->card, 0, offset + SD_IO_CCCR_BLKSIZEH, &bs_read_u8[1]);
-    ESP_LOGI(TAG, "Function 1  set: %04x", (int)bs_read);
-
-    offset = 0x200;
-    sdmmc_io_read_byte(host->card, 0, offset + SD_IO_CCCR_BLKSIZEL, &bs_read_u8[0]);
-    sdmmc_io_read_byte(host->card, 0, offset + SD_IO_CCCR_BLKSIZEH, &bs_read_u8[1]);
-    ESP_LOGI(TAG, "Function 2 BS: %04x", (int)bs_read);
-    sdmmc_io_write_byte(host->card, 0, offset + SD_IO_CCCR_BLKSIZEL, bs_u8[0], NULL);
-    sdmmc_io_write_byte(host->card, 0, offset + SD_IO_CCCR_BLKSIZEH, bs_u8[1], NULL);
-    sdmmc_io_read_byte(host->card, 0, offset + SD_IO_CCCR_BLKSIZEL, &bs_read_u8[0]);
-    sdmmc_io_read_byte(host->card, 0, offset + SD_IO_CCCR_BLKSIZEH, &bs_read_u8[1]);
-    ESP_LOGI(TAG, "Function 2 BS: %04x", (int)bs_read);
+    return ESP_OK;
+}
 
+static esp_err_t extconn_sdio_arena_init(void)
+{
+    if (s_arena.base != NULL) {
+        return ESP_OK;
+    }
+
+    /* Slot size is a multiple of the cache line, so every slot starts aligned like the base */
+    s_arena.base = esp_extconn_sdio_dma_alloc(EXT_CONN_SDIO_ARENA_SLOT_SIZE * EXT_CONN_SDIO_ARENA_SLOTS, NULL);
+    ESP_RETURN_ON_FALSE(s_arena.base != NULL, ESP_ERR_NO_MEM, TAG, "arena malloc failed");
+
+    /* Slot 0 holds the register buffers */
+    s_arena.used = BIT(0);
     return ESP_OK;
 }
 
-esp_err_t esp_extconn_sdio_init(sdmmc_card_t *card)
+/* A register buffer of slot 0, from the arena when all of them are in use */
+static uint32_t *extconn_sdio_reg_take(void)
+{
+    uint8_t *buf = NULL;
+
+    portENTER_CRITICAL(&s_arena.lock);
+    uint32_t free_bufs = ~s_arena.reg_used & (BIT(SDIO_REG_BUFS) - 1);
+    if (free_bufs) {
+        int n = __builtin_ctz(free_bufs);
+        s_arena.reg_used |= BIT(n);
+        buf = s_arena.base + n * SDIO_REG_BUF_SIZE;
+    }
+    portEXIT_CRITICAL(&s_arena.lock);
+    return buf ? (uint32_t *)buf : esp_extconn_sdio_arena_alloc(SDIO_REG_BUF_SIZE);
+}
+
+static void extconn_sdio_reg_give(uint32_t *buf)
+{
+    uint8_t *p = (uint8_t *)buf;
+
+    if (p >= s_arena.base && p < s_arena.base + EXT_CONN_SDIO_ARENA_SLOT_SIZE) {
+        portENTER_CRITICAL(&s_arena.lock);
+        s_arena.reg_used &= ~BIT((p - s_arena.base) / SDIO_REG_BUF_SIZE);
+        portEXIT_CRITICAL(&s_arena.lock);
+        return;
+    }
+    esp_extconn_sdio_arena_free(buf);
+}
+
+void *esp_extconn_sdio_arena_alloc(size_t size)
+{
+    void *buf = NULL;
+
+    if (size <= EXT_CONN_SDIO_ARENA_SLOT_SIZE && s_arena.base != NULL) {
+        portENTER_CRITICAL(&s_arena.lock);
+        uint32_t free_slots = ~s_arena.used & (BIT(EXT_CONN_SDIO_ARENA_SLOTS) - 1);
+        if (free_slots) {
+            int slot = __builtin_ctz(free_slots);
+            s_arena.used |= BIT(slot);
+            buf = s_arena.base + slot * EXT_CONN_SDIO_ARENA_SLOT_SIZE;
+            uint32_t in_use = __builtin_popcount(s_arena.used) - 1;
+            if (in_use > host->stats.arena_peak) {
+                host->stats.arena_peak = in_use;
+            }
+            host->stats.arena_allocs++;
+        }
+        portEXIT_CRITICAL(&s_arena.lock);
+        if (buf) {
+            return buf;
+        }
+    }
+
+    /* Too large or the arena is exhausted, the heap still serves the request */
+    buf = esp_extconn_sdio_dma_alloc(size, NULL);
+    if (buf && host) {
+        host->stats.arena_fallbacks++;
+    }
+    return buf;
+}
+
+void esp_extconn_sdio_arena_free(void *buf)
+{
+    uint8_t *p = buf;
+
+    if (p == NULL) {
+        return;
+    }
+    if (s_arena.base != NULL && p >= s_arena.base &&
+            p < s_arena.base + EXT_CONN_SDIO_ARENA_SLOT_SIZE * EXT_CONN_SDIO_ARENA_SLOTS) {
+        int slot = (p - s_arena.base) / EXT_CONN_SDIO_ARENA_SLOT_SIZE;
+        portENTER_CRITICAL(&s_arena.lock);
+        s_arena.used &= ~BIT(slot);
+        portEXIT_CRITICAL(&s_arena.lock);
+        return;
+    }
+    free(buf);
+}
+
+static esp_err_t extconn_sdio_init(const esp_extconn_sdio_ops_t *ops, void *ctx, uint32_t clk_khz, bool warm)
 {
-    if (host) {
-        return ESP_ERR_INVALID_STATE;
+    host = &s_host;
+    host->ops = ops;
+    host->ctx = ctx;
+    /* Card default until esp_extconn_sdio_start negotiates the block size */
+    for (int i = 0; i <= EXT_CONN_BT_SDIO_FUNC; i++) {
+        host->block_size[i] = EXT_CONN_SDIO_DRIVER_BLOCK_SIZE;
+    }
+    if (!warm) {
+        host->total_tx = 0;
+        host->total_rx = 0;
+        memset(&host->stats, 0, sizeof(host->stats));
     }
-    host = calloc(1, sizeof(sdio_host_t));
-    ESP_RETURN_ON_FALSE(host != NULL, ESP_ERR_NO_MEM, TAG, "memory exhausted");
-    host->card = card;
+    host->snap_valid = 0;
+    host->err_score = 0;
+    host->recover_start_us = 0;
+    host->clk_khz = clk_khz;
+
+    ESP_RETURN_ON_ERROR(extconn_sdio_arena_init(), TAG, "arena init failed");
+    ESP_RETURN_ON_ERROR(extconn_sdio_wait_init(), TAG, "wait timer init failed");
 
     esp_err_t ret = ESP_FAIL;
     ret = esp_extconn_sdio_start();
     ESP_RETURN_ON_FALSE(ret == ESP_OK, ret, TAG, "esp host start failed");
     ret = esp_extconn_sdio_init_slave_link();
     ESP_RETURN_ON_FALSE(ret == ESP_OK, ret, TAG, "esp host init slave link failed");
+#ifdef CONFIG_ESP_EXT_CONN_SDIO_REG_BENCH
+    extconn_sdio_bench_reg();
+#endif
     return ret;
 }
 
+esp_err_t esp_extconn_sdio_init(sdmmc_card_t *card, bool warm)
+{
+    return extconn_sdio_init(&esp_extconn_sdio_sdmmc_ops, card, card->max_freq_khz, warm);
+}
+
+esp_err_t esp_extconn_sdio_init_ops(const esp_extconn_sdio_ops_t *ops, void *ctx, bool warm)
+{
+    ESP_RETURN_ON_FALSE(ops && ops->go_idle && ops->read_byte && ops->write_byte && ops->read_bytes &&
+                        ops->write_bytes && ops->read_blocks && ops->write_blocks && ops->wait_int,
+                        ESP_ERR_INVALID_ARG, TAG, "incomplete ops");
+    return extconn_sdio_init(ops, ctx, 0, warm);
+}
+
 esp_err_t esp_extconn_sdio_read_reg_window(unsigned int reg_addr, uint8_t *value)
 {
 #define MAX_RETRY (1)
@@ -222,26 +752,26 @@ esp_err_t esp_extconn_sdio_read_reg_window(unsigned int reg_addr, uint8_t *value
     reg_addr >>= 2;
     ESP_RETURN_ON_FALSE(reg_addr <= 0x7f, ESP_ERR_INVALID_ARG, TAG, "Invalid parameters");
 
-    uint8_t *p_tbuf = heap_caps_malloc(sizeof(uint32_t), MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    uint8_t *p_tbuf = esp_extconn_sdio_arena_alloc(sizeof(uint32_t));
     ESP_RETURN_ON_FALSE(p_tbuf != NULL, ESP_ERR_NO_MEM, TAG, "Fatal: Sufficient memory");
 
     p_tbuf[0] = (reg_addr & 0x7f);
     p_tbuf[1] = 0x80;
 
-    ret = extconn_sdio_write_bytes(host->card, 1, ESP_SDIO_WIN_CMD, p_tbuf, 4);
+    ret = extconn_sdio_write_bytes(1, ESP_SDIO_WIN_CMD, p_tbuf, 4);
     if (ret == ESP_OK) {
         do {
             if (retry < MAX_RETRY) {
                 vTaskDelay(pdMS_TO_TICKS(10));
             }
             retry--;
-            ret = extconn_sdio_read_bytes(host->card, 1, ESP_SDIO_STATE_W0, p_tbuf, 4);
+            ret = extconn_sdio_read_bytes(1, ESP_SDIO_STATE_W0, p_tbuf, 4);
         } while (retry > 0 && ret != 0);
     }
     if (ret == ESP_OK) {
         memcpy(value, p_tbuf, 4);
     }
-    free(p_tbuf);
+    esp_extconn_sdio_arena_free(p_tbuf);
 
     return ret;
 }
@@ -253,23 +783,24 @@ static int esp_extconn_sdio_write_reg_window(unsigned int reg_addr, uint8_t *val
     reg_addr >>= 2;
     ESP_RETURN_ON_FALSE(reg_addr <= 0x7f, ESP_ERR_INVALID_ARG, TAG, "Invalid parameters");
 
-    uint8_t *p_tbuf = heap_caps_malloc(sizeof(uint32_t), MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    uint8_t *p_tbuf = esp_extconn_sdio_arena_alloc(2 * sizeof(uint32_t));
     ESP_RETURN_ON_FALSE(p_tbuf != NULL, ESP_ERR_NO_MEM, TAG, "Fatal: Sufficient memory");
 
     memcpy(p_tbuf, value, 4);
     p_tbuf[4] = (reg_addr & 0x7f);
     p_tbuf[5] = 0xc0;
 
-    ret = extconn_sdio_write_bytes(host->card, 1, ESP_SDIO_CONFIG_W5, p_tbuf, 8);
+    ret = extconn_sdio_write_bytes(1, ESP_SDIO_CONFIG_W5, p_tbuf, 8);
 
-    free(p_tbuf);
+    esp_extconn_sdio_arena_free(p_tbuf);
     return ret;
 }
 
 static esp_err_t esp_extconn_sdio_init_slave_link(void)
 {
-    uint32_t *t_buf = heap_caps_malloc(sizeof(uint32_t), MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
-    ESP_RETURN_ON_FALSE(t_buf != NULL, ESP_ERR_NO_MEM, TAG, "Fatal: Sufficient memory");
+    /* The window functions copy through the arena, the value itself needs no DMA */
+    uint32_t reg = 0;
+    uint32_t *t_buf = &reg;
 
     // set stitch en
     esp_err_t err = esp_extconn_sdio_read_reg_window(ESP_SLC_CONF1_REG, (uint8_t *)t_buf);
@@ -298,22 +829,25 @@ static esp_err_t esp_extconn_sdio_init_slave_link(void)
     ESP_LOGI(TAG, "read ESP_SLC_0_LEN_CONF_REG is 0x%" PRIx32, t_buf[0]);
 
     // Enable target interrupt
-    uint32_t *val = heap_caps_malloc(sizeof(uint32_t), MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    uint32_t *val = esp_extconn_sdio_arena_alloc(sizeof(uint32_t));
     ESP_RETURN_ON_FALSE(val != NULL, ESP_ERR_NO_MEM, TAG, "Fatal: Sufficient memory");
 
-    extconn_sdio_read_bytes(host->card, 1, ESP_SDIO_FUNC1_INT_ENA, (uint8_t *)val, sizeof(uint32_t));
+    extconn_sdio_read_bytes(1, ESP_SDIO_FUNC1_INT_ENA, (uint8_t *)val, sizeof(uint32_t));
     *val |= SLCHOST_FN1_GPIO_SDIO_INT_ENA;
-    extconn_sdio_write_bytes(host->card, 1, ESP_SDIO_FUNC1_INT_ENA, (uint8_t *)val, sizeof(uint32_t));
+    extconn_sdio_write_bytes(1, ESP_SDIO_FUNC1_INT_ENA, (uint8_t *)val, sizeof(uint32_t));
 
-    free(t_buf);
-    free(val);
+    esp_extconn_sdio_arena_free(val);
     return ESP_OK;
 }
 
 esp_err_t esp_extconn_sdio_get_buffer_size(uint32_t *buffer_size)
 {
-    uint32_t len = 0;
-    esp_err_t ret = extconn_sdio_read_bytes(host->card, 1, ESP_SDIO_TOKEN_RDATA, &len, 4);
+    uint32_t *token = esp_extconn_sdio_arena_alloc(sizeof(uint32_t));
+    ESP_RETURN_ON_FALSE(token != NULL, ESP_ERR_NO_MEM, TAG, "Fatal: Sufficient memory");
+
+    esp_err_t ret = extconn_sdio_read_status(ESP_SDIO_TOKEN_RDATA, token, 4);
+    uint32_t len = *token;
+    esp_extconn_sdio_arena_free(token);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Read length error, ret=%d", ret);
         return ret;
@@ -325,26 +859,65 @@ esp_err_t esp_extconn_sdio_get_buffer_size(uint32_t *buffer_size)
     return ret;
 }
 
-static esp_err_t esp_extconn_sdio_get_rx_data_size(uint32_t function, uint32_t *rx_size)
+static uint32_t extconn_sdio_decode_rx_len(uint32_t function, uint32_t reg)
 {
-    uint32_t len = 0;
-    uint32_t addr = 0;
     if (function == EXT_CONN_BT_SDIO_FUNC) {
-        addr = ESP_SDIO_SLC1_HOST_PF;
-    } else {
-        addr = ESP_SDIO_PKT_LEN;
+        uint8_t *pf = (uint8_t *)&reg;
+        return (((pf[1] << 16) | (pf[2] << 8) | (pf[3] << 0)) & 0xffffff);
     }
-    esp_err_t err = extconn_sdio_read_bytes(host->card, 1, addr, (uint8_t *)&len, 4);
-    ESP_RETURN_ON_FALSE(err == ESP_OK, err, TAG, "read failed");
+    reg &= RX_BYTE_MASK;
+    return (reg + RX_BYTE_MAX - host->total_rx) % RX_BYTE_MAX;
+}
 
-    if (function == EXT_CONN_BT_SDIO_FUNC) {
-        uint8_t *pf = (uint8_t *)&len;
-        *rx_size = (((pf[1] << 16) | (pf[2] << 8) | (pf[3] << 0)) & 0xffffff);
-    } else {
-        len &= RX_BYTE_MASK;
-        len = (len + RX_BYTE_MAX - host->total_rx) % RX_BYTE_MAX;
-        *rx_size = len;
+esp_err_t esp_extconn_sdio_read_snapshot(esp_extconn_sdio_snapshot_t *snap)
+{
+    ESP_RETURN_ON_FALSE(snap != NULL, ESP_ERR_INVALID_ARG, TAG, "NULL Ptr");
+
+    uint32_t *reg = extconn_sdio_reg_take();
+    ESP_RETURN_ON_FALSE(reg != NULL, ESP_ERR_NO_MEM, TAG, "no register buffer");
+    esp_err_t err = extconn_sdio_read_status(SDIO_SNAPSHOT_BASE, reg, SDIO_SNAPSHOT_LEN);
+    if (err != ESP_OK) {
+        extconn_sdio_reg_give(reg);
+        ESP_LOGE(TAG, "snapshot read failed");
+        return err;
+    }
+
+    host->snap.intr_0 = reg[SDIO_SNAPSHOT_WORD(ESP_SDIO_INT_RAW)];
+    host->snap.intr_1 = reg[SDIO_SNAPSHOT_WORD(ESP_SDIO_INT_RAW1)];
+    host->snap.rx_len[EXT_CONN_WIFI_SDIO_FUNC] =
+        extconn_sdio_decode_rx_len(EXT_CONN_WIFI_SDIO_FUNC, reg[SDIO_SNAPSHOT_WORD(ESP_SDIO_PKT_LEN)]);
+    host->snap.rx_len[EXT_CONN_BT_SDIO_FUNC] =
+        extconn_sdio_decode_rx_len(EXT_CONN_BT_SDIO_FUNC, reg[SDIO_SNAPSHOT_WORD(ESP_SDIO_SLC1_HOST_PF)]);
+    extconn_sdio_reg_give(reg);
+    host->snap_valid = BIT(EXT_CONN_WIFI_SDIO_FUNC) | BIT(EXT_CONN_BT_SDIO_FUNC);
+    /* The interrupt registers alone took two reads */
+    host->stats.reg_cmd_saved++;
+
+    *snap = host->snap;
+    return ESP_OK;
+}
+
+static esp_err_t esp_extconn_sdio_get_rx_data_size(uint32_t function, uint32_t *rx_size)
+{
+    /* The first length after a snapshot comes from it, polling reads the register again */
+    if (host->snap_valid & BIT(function)) {
+        host->snap_valid &= ~BIT(function);
+        if (host->snap.rx_len[function]) {
+            host->stats.reg_cmd_saved++;
+            *rx_size = host->snap.rx_len[function];
+            return ESP_OK;
+        }
     }
+
+    uint32_t addr = (function == EXT_CONN_BT_SDIO_FUNC) ? ESP_SDIO_SLC1_HOST_PF : ESP_SDIO_PKT_LEN;
+    uint32_t *reg = extconn_sdio_reg_take();
+    ESP_RETURN_ON_FALSE(reg != NULL, ESP_ERR_NO_MEM, TAG, "no register buffer");
+    esp_err_t err = extconn_sdio_read_status(addr, reg, 4);
+    if (err == ESP_OK) {
+        *rx_size = extconn_sdio_decode_rx_len(function, reg[0]);
+    }
+    extconn_sdio_reg_give(reg);
+    ESP_RETURN_ON_FALSE(err == ESP_OK, err, TAG, "read failed");
     return ESP_OK;
 }
 
@@ -352,10 +925,11 @@ esp_err_t esp_extconn_sdio_get_packet(uint32_t function, void *out_buf, size_t s
 {
     esp_err_t err = ESP_OK;
     uint32_t len = 0;
-    uint32_t wait_time = 0;
+    uint32_t step_us = SDIO_RX_WAIT_MIN_STEP_US;
 
     ESP_RETURN_ON_FALSE(size > 0, ESP_ERR_INVALID_ARG, TAG, "Invalid size");
 
+    int64_t deadline_us = esp_timer_get_time() + (int64_t)wait_ms * 1000;
     for (;;) {
         err = esp_extconn_sdio_get_rx_data_size(function, &len);
         if (err == ESP_OK && len > 0) {
@@ -365,30 +939,34 @@ esp_err_t esp_extconn_sdio_get_packet(uint32_t function, void *out_buf, size_t s
             return err;
         }
 
-        if (++wait_time >= wait_ms) {
+        int64_t left_us = deadline_us - esp_timer_get_time();
+        if (left_us <= 0) {
             return ESP_ERR_TIMEOUT;
         }
-        vTaskDelay(pdMS_TO_TICKS(1));
+        extconn_sdio_sleep_us(MIN(step_us, left_us));
+        step_us = MIN(step_us * 2, SDIO_RX_WAIT_MAX_STEP_US);
     }
     ESP_LOGV(TAG, "get_packet: slave len=%" PRIu32", max read size=%d", len, size);
 
-    if (len > size) {
+    /* The rest stays with the slave for the next read */
+    bool truncated = len > size;
+    if (truncated) {
         len = size;
-        err = ESP_ERR_NOT_FINISHED;
     }
 
-    uint32_t len_remain = len;
+    uint32_t len_remain = truncated ? len : extconn_sdio_pad_len(function, len, size);
     uint8_t *start_ptr = (uint8_t *)out_buf;
 
     do {
-        const int block_size = 512; // currently our driver don't support block size other than 512
+        const int block_size = host->block_size[function];
         int len_to_send;
         int block_n = len_remain / block_size;
         uint32_t addr = (function == EXT_CONN_WIFI_SDIO_FUNC) ? (ESP_SLAVE_CMD53_END_ADDR - len_remain) : 0;
 
         if (block_n != 0) {
             len_to_send = block_n * block_size;
-            err = extconn_sdio_read_blocks(host->card, function, addr, start_ptr, len_to_send);
+            err = extconn_sdio_read_blocks(function, addr, start_ptr, len_to_send);
+            host->stats.cmd53++;
         } else {
             len_to_send = len_remain;
             /*
@@ -397,10 +975,27 @@ esp_err_t esp_extconn_sdio_get_packet(uint32_t function, void *out_buf, size_t s
              * effeciency. The length is determined by the SDIO address, and the
              * remainning will be ignored by the slave hardware.
              */
-            err = extconn_sdio_read_bytes(host->card, function, addr, start_ptr, (len_to_send + 3) & (~3));
+            size_t tail = extconn_sdio_tail_len(function, len_to_send, size - (start_ptr - (uint8_t *)out_buf));
+            err = extconn_sdio_read_bytes(function, addr, start_ptr, tail);
+            host->stats.cmd53 += extconn_sdio_bytes_cmds(tail);
+        }
+        if (extconn_sdio_fault()) {
+            err = ESP_ERR_INVALID_CRC;
         }
 
         if (err != ESP_OK) {
+            /*
+             * The slave hands data out as it is clocked, a read can not be repeated. The
+             * abort drops the rest of the read, count it all so total_rx stays in step with
+             * PKT_LEN. Without it only what came before the failed command is gone.
+             */
+            bool aborted = extconn_sdio_on_error(function);
+            host->stats.failures++;
+            host->recover_start_us = 0;
+            if (function != EXT_CONN_BT_SDIO_FUNC) {
+                host->total_rx += aborted ? len : (uint32_t)(start_ptr - (uint8_t *)out_buf);
+            }
+            extconn_sdio_resync();
             return err;
         }
 
@@ -408,44 +1003,133 @@ esp_err_t esp_extconn_sdio_get_packet(uint32_t function, void *out_buf, size_t s
         len_remain -= len_to_send;
     } while (len_remain != 0);
 
+    extconn_sdio_on_success();
     *out_length = len;
+    host->stats.rx_packets++;
     if (function != EXT_CONN_BT_SDIO_FUNC) {
         host->total_rx += len;
     }
+    return truncated ? ESP_ERR_NOT_FINISHED : ESP_OK;
+}
+
+uint16_t esp_extconn_sdio_get_block_size(uint32_t function)
+{
+    return host ? host->block_size[function] : EXT_CONN_SDIO_DRIVER_BLOCK_SIZE;
+}
+
+size_t esp_extconn_sdio_pad_len(uint32_t function, size_t len)
+{
+#ifdef CONFIG_ESP_EXT_CONN_SDIO_PAD_TO_BLOCK
+    uint16_t block_size = esp_extconn_sdio_get_block_size(function);
+    return (len + block_size - 1) / block_size * block_size;
+#else
+    (void)function;
+    return len;
+#endif
+}
+
+esp_err_t esp_extconn_get_sdio_stats(esp_extconn_sdio_stats_t *stats)
+{
+    ESP_RETURN_ON_FALSE(stats != NULL, ESP_ERR_INVALID_ARG, TAG, "stats NULL");
+    ESP_RETURN_ON_FALSE(host != NULL, ESP_ERR_INVALID_STATE, TAG, "sdio not init");
+    *stats = host->stats;
     return ESP_OK;
 }
 
-esp_err_t esp_extconn_sdio_send_packet(uint32_t function, void *start, size_t length)
+bool esp_extconn_sdio_dma_capable(const void *buf, size_t length)
+{
+    esp_dma_mem_info_t dma_mem_info = { 0 };
+
+    if (extconn_sdio_dma_info(&dma_mem_info) != ESP_OK) {
+        return false;
+    }
+    return esp_dma_is_buffer_alignment_satisfied(buf, length, dma_mem_info);
+}
+
+/* One attempt at writing a whole packet, length bytes with the last fragment sent as last_len */
+static esp_err_t extconn_sdio_write_packet(uint32_t function, const esp_extconn_sdio_frag_t *frags, int num,
+                                           size_t last_len, size_t length)
 {
     esp_err_t err = ESP_FAIL;
-    uint8_t *start_ptr = (uint8_t *)start;
+    uint32_t block_size = host->block_size[function];
     uint32_t len_remain = length;
-    uint32_t block_size = 512;
-    int buffer_used = (length + block_size - 1) / block_size;
-    uint32_t addr = (function == EXT_CONN_WIFI_SDIO_FUNC) ? (ESP_SLAVE_CMD53_END_ADDR - len_remain) : 0;
 
-    do {
-        /* Though the driver supports to split packet of unaligned size into
-         * length of 4x and 1~3, we still send aligned size of data to get
-         * higher effeciency. The length is determined by the SDIO address, and
-         * the remainning will be discard by the slave hardware.
-         */
-        int block_n = len_remain / block_size;
-        int len_to_send;
+    /*
+     * All fragments go to the same slave packet, each transfer addressed by what is still
+     * to come, so the slave sees the packet end when the last byte reaches the end address.
+     */
+    for (int i = 0; i < num; i++) {
+        const uint8_t *start_ptr = (const uint8_t *)frags[i].buf;
+        bool last = (i == num - 1);
+        uint32_t frag_remain = last ? last_len : frags[i].length;
+
+        while (frag_remain) {
+            uint32_t addr = (function == EXT_CONN_WIFI_SDIO_FUNC) ? (ESP_SLAVE_CMD53_END_ADDR - len_remain) : 0;
+            uint32_t block_n = frag_remain / block_size;
+            uint32_t len_to_send;
+
+            if (extconn_sdio_fault()) {
+                return ESP_ERR_INVALID_CRC;
+            }
+            if (block_n) {
+                len_to_send = block_n * block_size;
+                err = extconn_sdio_write_blocks(function, addr, start_ptr, len_to_send);
+                host->stats.cmd53++;
+            } else {
+                len_to_send = frag_remain;
+                /*
+                 * Though the driver supports to split packet of unaligned size into
+                 * length of 4x and 1~3, the tail is sent aligned to get higher
+                 * effeciency. The length is determined by the SDIO address, and
+                 * the remainning will be discard by the slave hardware.
+                 */
+                size_t size = last ? extconn_sdio_tail_len(function, len_to_send,
+                                                           frags[i].size - (start_ptr - (const uint8_t *)frags[i].buf))
+                               : len_to_send;
+                err = extconn_sdio_write_bytes(function, addr, start_ptr, size);
+                host->stats.cmd53 += extconn_sdio_bytes_cmds(size);
+            }
+            if (err != ESP_OK) {
+                return err;
+            }
 
-        if (block_n) {
-            len_to_send = block_n * block_size;
-            err = extconn_sdio_write_blocks(host->card, function, addr, start_ptr, len_to_send);
-        } else {
-            len_to_send = len_remain;
-            err = extconn_sdio_write_bytes(host->card, function, addr, start_ptr, (len_to_send + 3) & (~3));
+            start_ptr += len_to_send;
+            frag_remain -= len_to_send;
+            len_remain -= len_to_send;
         }
-        ESP_RETURN_ON_FALSE(err == ESP_OK, err, TAG, "write bytes failed");
+    }
+    return ESP_OK;
+}
 
-        start_ptr += len_to_send;
-        len_remain -= len_to_send;
-    } while (len_remain);
+esp_err_t esp_extconn_sdio_send_frags(uint32_t function, const esp_extconn_sdio_frag_t *frags, int num)
+{
+    esp_err_t err = ESP_FAIL;
+    size_t length = 0;
+
+    ESP_RETURN_ON_FALSE(num > 0, ESP_ERR_INVALID_ARG, TAG, "Invalid size");
+    for (int i = 0; i < num - 1; i++) {
+        length += frags[i].length;
+    }
+    /* Only the last fragment can be padded, and only into the room its buffer has */
+    size_t last_len = extconn_sdio_pad_len(function, frags[num - 1].length, frags[num - 1].size);
+    length += last_len;
+    ESP_RETURN_ON_FALSE(length > 0, ESP_ERR_INVALID_ARG, TAG, "Invalid size");
+
+    /* Credits are in slave buffers, whatever the block size on the bus */
+    int buffer_used = (length + EXT_CONN_SDIO_SLAVE_BUF_SIZE - 1) / EXT_CONN_SDIO_SLAVE_BUF_SIZE;
+
+    /* The slave drops a packet that never reached its end address, so a retry sends it whole */
+    uint32_t step_us = SDIO_RETRY_MIN_STEP_US;
+    for (int attempt = 0; ; attempt++) {
+        err = extconn_sdio_write_packet(function, frags, num, last_len, length);
+        if (err == ESP_OK || !extconn_sdio_retry(function, err, attempt, &step_us)) {
+            break;
+        }
+    }
+    ESP_RETURN_ON_FALSE(err == ESP_OK, err, TAG, "write bytes failed");
+    extconn_sdio_on_success();
 
+    host->stats.tx_packets++;
     if (function != EXT_CONN_BT_SDIO_FUNC) {
         host->total_tx += buffer_used;
         if (host->total_tx >= TX_BUFFER_MAX) {
@@ -455,6 +1139,22 @@ esp_err_t esp_extconn_sdio_send_packet(uint32_t function, void *start, size_t le
     return ESP_OK;
 }
 
+esp_err_t esp_extconn_sdio_send_packet_padded(uint32_t function, void *start, size_t length, size_t buf_size)
+{
+    esp_extconn_sdio_frag_t frag = {
+        .buf = start,
+        .length = length,
+        .size = buf_size,
+    };
+
+    return esp_extconn_sdio_send_frags(function, &frag, 1);
+}
+
+esp_err_t esp_extconn_sdio_send_packet(uint32_t function, void *start, size_t length)
+{
+    return esp_extconn_sdio_send_packet_padded(function, start, length, length);
+}
+
 esp_err_t esp_extconn_sdio_clear_intr(uint32_t intr_0, uint32_t intr_1)
 {
     esp_err_t r = ESP_FAIL;
@@ -463,13 +1163,27 @@ esp_err_t esp_extconn_sdio_clear_intr(uint32_t intr_0, uint32_t intr_1)
         return ESP_OK;
     }
 
+    /* Writing 0 to a clear register is a no-op, so both go in one transfer when needed */
+    if (intr_0 != 0 && intr_1 != 0 &&
+            extconn_sdio_reg_bytes(intr_0) + extconn_sdio_reg_bytes(intr_1) > SDIO_CMD52_MAX_BYTES) {
+        uint32_t *reg = extconn_sdio_reg_take();
+        ESP_RETURN_ON_FALSE(reg != NULL, ESP_ERR_NO_MEM, TAG, "no register buffer");
+        reg[0] = intr_0;
+        reg[1] = intr_1;
+        r = extconn_sdio_write_bytes(1, ESP_SDIO_SLC0_INT_CLR, reg, SDIO_INT_CLR_LEN);
+        extconn_sdio_reg_give(reg);
+        ESP_RETURN_ON_FALSE(r == ESP_OK, r, TAG, "clear intr failed");
+        host->stats.reg_cmd_saved++;
+        return ESP_OK;
+    }
+
     if (intr_0 != 0) {
-        r = extconn_sdio_write_bytes(host->card, 1, ESP_SDIO_SLC0_INT_CLR, (uint8_t *)&intr_0, 4);
+        r = extconn_sdio_write_clr(ESP_SDIO_SLC0_INT_CLR, intr_0);
         ESP_RETURN_ON_FALSE(r == ESP_OK, r, TAG, "clear intr_0 failed");
     }
 
     if (intr_1 != 0) {
-        r = extconn_sdio_write_bytes(host->card, 1, ESP_SDIO_SLC1_INT_CLR, (uint8_t *)&intr_1, 4);
+        r = extconn_sdio_write_clr(ESP_SDIO_SLC1_INT_CLR, intr_1);
         ESP_RETURN_ON_FALSE(r == ESP_OK, r, TAG, "clear intr_1 failed");
     }
 
@@ -478,23 +1192,20 @@ esp_err_t esp_extconn_sdio_clear_intr(uint32_t intr_0, uint32_t intr_1)
 
 esp_err_t esp_extconn_sdio_get_intr(uint32_t *intr_raw, uint32_t *intr_st)
 {
-    esp_err_t r = ESP_FAIL;
+    esp_extconn_sdio_snapshot_t snap;
     ESP_RETURN_ON_FALSE((intr_raw != NULL || intr_st != NULL), ESP_ERR_INVALID_ARG, TAG, "NULL Ptr");
 
+    ESP_RETURN_ON_ERROR(esp_extconn_sdio_read_snapshot(&snap), TAG, "intr read failed");
     if (intr_raw != NULL) {
-        r = extconn_sdio_read_bytes(host->card, 1, ESP_SDIO_INT_RAW, (uint8_t *)intr_raw, 4);
-        ESP_RETURN_ON_FALSE(r == ESP_OK, r, TAG, "intr_raw read failed");
+        *intr_raw = snap.intr_0;
     }
-
     if (intr_st != NULL) {
-        r = extconn_sdio_read_bytes(host->card, 1, ESP_SDIO_INT_RAW1, (uint8_t *)intr_st, 4);
-        ESP_RETURN_ON_FALSE(r == ESP_OK, r, TAG, "intr_sr read failed");
+        *intr_st = snap.intr_1;
     }
-
     return ESP_OK;
 }
 
 esp_err_t esp_extconn_sdio_wait_int(uint32_t wait)
 {
-    return sdmmc_io_wait_int(host->card, wait);
+    return host->ops->wait_int(host->ctx, wait);
 }
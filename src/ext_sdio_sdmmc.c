@@ -0,0 +1,177 @@
+/*
+ * SPDX-FileCopyrightText: 2024-2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <string.h>
+
+#include "esp_heap_caps.h"
+#include "esp_dma_utils.h"
+
+#include "sd_protocol_defs.h"
+#include "esp_check.h"
+#include "ext_sdio_adapter.h"
+#include "esp_extconn_sdmmc.h"
+
+static const char *TAG = "sdio_sdmmc";
+
+/* SDMMC host implementation of the adapter bus access, ctx is the sdmmc_card_t */
+
+static uint32_t sdmmc_ops_cmd53_arg(uint32_t function, bool write, bool block_mode)
+{
+    uint32_t arg = write ? SD_ARG_CMD53_WRITE : SD_ARG_CMD53_READ;
+
+    /* Function 1 addresses the packet window, function 2 is a FIFO */
+    if (function == EXT_CONN_WIFI_SDIO_FUNC) {
+        arg |= SD_ARG_CMD53_INCREMENT;
+    }
+    if (block_mode) {
+        arg |= SD_ARG_CMD53_BLOCK_MODE;
+    }
+    return arg;
+}
+
+static esp_err_t sdmmc_ops_go_idle(void *ctx)
+{
+    sdmmc_card_t *card = ctx;
+    esp_err_t err = sdmmc_send_cmd_go_idle_state(card);
+
+    /* SDIO in SPI mode needs CMD5 again after CMD0, data CRC is left off to save the CRC16 */
+    if (err == ESP_OK && (card->host.flags & SDMMC_HOST_FLAG_SPI)) {
+        err = sdmmc_io_send_op_cond(card, MMC_OCR_3_3V_3_4V, NULL);
+        ESP_RETURN_ON_FALSE(err == ESP_OK, err, TAG, "Send CMD5 error");
+
+        err = sdmmc_send_cmd_crc_on_off(card, false);
+        ESP_RETURN_ON_FALSE(err == ESP_OK, err, TAG, "Close CRC error");
+    }
+    return err;
+}
+
+static esp_err_t sdmmc_ops_read_byte(void *ctx, uint32_t function, uint32_t addr, uint8_t *out)
+{
+    return sdmmc_io_read_byte(ctx, function, addr, out);
+}
+
+static esp_err_t sdmmc_ops_write_byte(void *ctx, uint32_t function, uint32_t addr, uint8_t in, uint8_t *out)
+{
+    return sdmmc_io_write_byte(ctx, function, addr, in, out);
+}
+
+static esp_err_t sdmmc_ops_read_bytes(void *ctx, uint32_t function, uint32_t addr, void *dst, size_t size)
+{
+    return sdmmc_io_rw_extended(ctx, function, addr, sdmmc_ops_cmd53_arg(function, false, false), dst, size);
+}
+
+static esp_err_t sdmmc_ops_write_bytes(void *ctx, uint32_t function, uint32_t addr, const void *src, size_t size)
+{
+    return sdmmc_io_rw_extended(ctx, function, addr, sdmmc_ops_cmd53_arg(function, true, false), (void *)src, size);
+}
+
+/*
+ * Block mode CMD53. sdmmc_io_rw_extended always uses 512 byte blocks, other sizes are
+ * issued here the same way, bounce included.
+ */
+static esp_err_t sdmmc_ops_rw_blocks(sdmmc_card_t *card, uint32_t function, uint32_t addr, bool write,
+                                     void *data, size_t size, uint16_t block_size)
+{
+    uint32_t arg = sdmmc_ops_cmd53_arg(function, write, true);
+
+    if (block_size == EXT_CONN_SDIO_DRIVER_BLOCK_SIZE) {
+        return sdmmc_io_rw_extended(card, function, addr, arg, data, size);
+    }
+
+    esp_err_t err = ESP_OK;
+    void *buf = data;
+    size_t buf_size = size;
+    esp_dma_mem_info_t dma_mem_info = {
+        .extra_heap_caps = MALLOC_CAP_DMA,
+        .dma_alignment_bytes = 4,
+    };
+    if (card->host.get_dma_info != NULL) {
+        card->host.get_dma_info(card->host.slot, &dma_mem_info);
+    }
+    if (!esp_dma_is_buffer_alignment_satisfied(data, size, dma_mem_info)) {
+        err = esp_dma_capable_malloc(size, &dma_mem_info, &buf, &buf_size);
+        if (unlikely(err != ESP_OK)) {
+            return err;
+        }
+        if (write) {
+            memcpy(buf, data, size);
+        }
+    }
+
+    sdmmc_command_t cmd = {
+        .flags = SCF_CMD_AC | SCF_RSP_R5,
+        .opcode = SD_IO_RW_EXTENDED,
+        .arg = arg,
+        .data = buf,
+        .datalen = size,
+        .buflen = buf_size,
+        .blklen = block_size,
+    };
+    cmd.arg |= (function & SD_ARG_CMD53_FUNC_MASK) << SD_ARG_CMD53_FUNC_SHIFT;
+    cmd.arg |= (addr & SD_ARG_CMD53_REG_MASK) << SD_ARG_CMD53_REG_SHIFT;
+    cmd.arg |= ((size / block_size) & SD_ARG_CMD53_LENGTH_MASK) << SD_ARG_CMD53_LENGTH_SHIFT;
+    if (!write) {
+        cmd.flags |= SCF_CMD_READ;
+    }
+    err = sdmmc_send_cmd(card, &cmd);
+
+    if (buf != data) {
+        if (err == ESP_OK && !write) {
+            memcpy(data, buf, size);
+        }
+        free(buf);
+    }
+    return err;
+}
+
+static esp_err_t sdmmc_ops_read_blocks(void *ctx, uint32_t function, uint32_t addr, void *dst, size_t size,
+                                       uint16_t block_size)
+{
+    return sdmmc_ops_rw_blocks(ctx, function, addr, false, dst, size, block_size);
+}
+
+static esp_err_t sdmmc_ops_write_blocks(void *ctx, uint32_t function, uint32_t addr, const void *src, size_t size,
+                                        uint16_t block_size)
+{
+    return sdmmc_ops_rw_blocks(ctx, function, addr, true, (void *)src, size, block_size);
+}
+
+static esp_err_t sdmmc_ops_wait_int(void *ctx, uint32_t timeout_ticks)
+{
+    return sdmmc_io_wait_int(ctx, timeout_ticks);
+}
+
+static esp_err_t sdmmc_ops_set_clk(void *ctx, uint32_t freq_khz)
+{
+    sdmmc_card_t *card = ctx;
+
+    if (card->host.set_card_clk == NULL) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    return card->host.set_card_clk(card->host.slot, freq_khz);
+}
+
+static esp_err_t sdmmc_ops_get_dma_info(void *ctx, esp_dma_mem_info_t *dma_mem_info)
+{
+    sdmmc_card_t *card = ctx;
+
+    if (card->host.get_dma_info == NULL) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    return card->host.get_dma_info(card->host.slot, dma_mem_info);
+}
+
+const esp_extconn_sdio_ops_t esp_extconn_sdio_sdmmc_ops = {
+    .go_idle = sdmmc_ops_go_idle,
+    .read_byte = sdmmc_ops_read_byte,
+    .write_byte = sdmmc_ops_write_byte,
+    .read_bytes = sdmmc_ops_read_bytes,
+    .write_bytes = sdmmc_ops_write_bytes,
+    .read_blocks = sdmmc_ops_read_blocks,
+    .write_blocks = sdmmc_ops_write_blocks,
+    .wait_int = sdmmc_ops_wait_int,
+    .set_clk = sdmmc_ops_set_clk,
+    .get_dma_info = sdmmc_ops_get_dma_info,
+};
@@ -0,0 +1,92 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_check.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "esp_sip.h"
+#include "ext_default.h"
+
+#define EXT_CONN_WDT_TASK_STACK  (4096)
+#define EXT_CONN_WDT_TASK_PRIO   (5)
+#define EXT_CONN_WDT_INTERVAL_US (CONFIG_ESP_EXT_CONN_HEARTBEAT_INTERVAL_MS * 1000LL)
+#define EXT_CONN_WDT_DEAD_US     (EXT_CONN_WDT_INTERVAL_US * CONFIG_ESP_EXT_CONN_HEARTBEAT_MISS_MAX)
+
+static const char *TAG = "ext_wdt";
+static TaskHandle_t s_wdt_task = NULL;
+static volatile int64_t s_last_rx_us = 0;
+static volatile bool s_target_reset = false;
+
+void esp_extconn_wdt_feed(void)
+{
+    s_last_rx_us = esp_timer_get_time();
+}
+
+void esp_extconn_wdt_target_reset(void)
+{
+    s_target_reset = true;
+    if (s_wdt_task) {
+        xTaskNotifyGive(s_wdt_task);
+    }
+}
+
+static void extconn_wdt_task(void *args)
+{
+    ESP_LOGI(TAG, "WDT START");
+
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(CONFIG_ESP_EXT_CONN_HEARTBEAT_INTERVAL_MS));
+
+        /* Any frame from the target counts, heartbeats are only sent on a quiet link */
+        int64_t idle_us = esp_timer_get_time() - s_last_rx_us;
+        if (!s_target_reset && idle_us < EXT_CONN_WDT_INTERVAL_US) {
+            continue;
+        }
+        if (!s_target_reset && idle_us < EXT_CONN_WDT_DEAD_US) {
+            esp_sip_send_heartbeat();
+            continue;
+        }
+
+        if (s_target_reset) {
+            ESP_LOGW(TAG, "target resetting, recover");
+        } else {
+            ESP_LOGW(TAG, "target silent for %lld ms, recover", idle_us / 1000);
+        }
+        s_target_reset = false;
+
+        int64_t start_us = esp_timer_get_time();
+        esp_err_t ret = esp_extconn_recover();
+        if (ret == ESP_OK) {
+            ESP_LOGI(TAG, "target recovered in %lld us", esp_timer_get_time() - start_us);
+        } else {
+            ESP_LOGE(TAG, "recover failed 0x%X, retry in %d ms", ret, CONFIG_ESP_EXT_CONN_HEARTBEAT_INTERVAL_MS);
+        }
+        /* On failure the link stays silent, so the next interval tries again */
+        s_last_rx_us = esp_timer_get_time() - (ret == ESP_OK ? 0 : EXT_CONN_WDT_DEAD_US);
+    }
+
+    vTaskDelete(NULL);
+}
+
+esp_err_t esp_extconn_wdt_init(void)
+{
+    if (s_wdt_task) {
+        return ESP_OK;
+    }
+    s_last_rx_us = esp_timer_get_time();
+
+    return xTaskCreatePinnedToCore(extconn_wdt_task, "extconn_wdt",
+                                   EXT_CONN_WDT_TASK_STACK,
+                                   NULL,
+                                   EXT_CONN_WDT_TASK_PRIO,
+                                   &s_wdt_task,
+                                   tskNO_AFFINITY)
+           == pdTRUE ? ESP_OK : ESP_ERR_NO_MEM;
+}
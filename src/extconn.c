@@ -4,20 +4,110 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/event_groups.h"
 
+#include "esp_check.h"
 #include "esp_err.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 
 #include "esp_extconn.h"
 #include "ext_default.h"
+#include "esp_sip.h"
+
+#define EXT_CONN_BT_READY_WAIT_MS (1000)
+#define EXT_CONN_INIT_TASK_STACK  (4096)
+#define EXT_CONN_INIT_TASK_PRIO   (5)
+
+#define EXT_CONN_INIT_STARTED_BIT (BIT0)
+#define EXT_CONN_READY_BIT        (BIT1)
+#define EXT_CONN_FAIL_BIT         (BIT2)
+
+typedef struct {
+    esp_extconn_config_t config;
+    esp_extconn_init_cb_t cb;
+    void *arg;
+} extconn_async_ctx_t;
 
 static char *TAG = "extconn";
+static EventGroupHandle_t s_init_event = NULL;
+static esp_extconn_boot_timeline_t s_timeline;
+static esp_extconn_link_cb_t s_link_cb = NULL;
+static void *s_link_cb_arg = NULL;
 
-esp_err_t esp_extconn_init(esp_extconn_config_t *config)
+static const char *s_phase_names[ESP_EXTCONN_BOOT_PHASE_MAX] = {
+    "start", "pins", "reset", "card", "sdio", "download", "target_on", "chip_init", "bootup", "done",
+};
+
+void esp_extconn_boot_mark(esp_extconn_boot_phase_t phase)
+{
+    if (phase < ESP_EXTCONN_BOOT_PHASE_MAX) {
+        s_timeline.ts_us[phase] = esp_timer_get_time();
+    }
+}
+
+void esp_extconn_boot_set_warm(bool warm)
+{
+    s_timeline.warm = warm;
+}
+
+esp_err_t esp_extconn_get_boot_timeline(esp_extconn_boot_timeline_t *timeline)
+{
+    ESP_RETURN_ON_FALSE(timeline != NULL, ESP_ERR_INVALID_ARG, TAG, "timeline NULL");
+    *timeline = s_timeline;
+    return ESP_OK;
+}
+
+static void extconn_log_timeline(void)
+{
+    int64_t last = s_timeline.ts_us[ESP_EXTCONN_BOOT_START];
+
+    ESP_LOGI(TAG, "boot timeline (%s):", s_timeline.recover ? "recover" : s_timeline.warm ? "warm" : "cold");
+    for (int i = ESP_EXTCONN_BOOT_START + 1; i < ESP_EXTCONN_BOOT_PHASE_MAX; i++) {
+        if (s_timeline.ts_us[i] == 0) {
+            continue;
+        }
+        ESP_LOGI(TAG, "  %-10s +%8lld us  @%8lld us", s_phase_names[i], s_timeline.ts_us[i] - last,
+                 s_timeline.ts_us[i] - s_timeline.ts_us[ESP_EXTCONN_BOOT_START]);
+        last = s_timeline.ts_us[i];
+    }
+}
+
+static esp_err_t extconn_prepare(void)
+{
+    if (s_init_event == NULL) {
+        s_init_event = xEventGroupCreate();
+        ESP_RETURN_ON_FALSE(s_init_event != NULL, ESP_ERR_NO_MEM, TAG, "No MEM");
+    }
+    ESP_RETURN_ON_FALSE(!(xEventGroupGetBits(s_init_event) & EXT_CONN_INIT_STARTED_BIT), ESP_ERR_INVALID_STATE, TAG, "init already started");
+    xEventGroupSetBits(s_init_event, EXT_CONN_INIT_STARTED_BIT);
+
+    esp_err_t ret = ESP_OK;
+    /* Hook into the Wi-Fi and BT stacks first, so their calls queue up until the target is ready */
+#ifdef CONFIG_ESP_EXT_CONN_WIFI_ENABLE
+    ret = esp_extconn_trans_wifi_prepare();
+#endif
+#ifdef CONFIG_ESP_EXT_CONN_BT_ENABLE
+    if (ret == ESP_OK) {
+        ret = esp_extconn_trans_bt_prepare();
+    }
+#endif
+    if (ret != ESP_OK) {
+        xEventGroupClearBits(s_init_event, EXT_CONN_INIT_STARTED_BIT);
+    }
+    return ret;
+}
+
+static esp_err_t extconn_start(esp_extconn_config_t *config)
 {
+    memset(&s_timeline, 0, sizeof(s_timeline));
+    esp_extconn_boot_mark(ESP_EXTCONN_BOOT_START);
+
     esp_err_t ret = esp_extconn_boot();
     if (ret == ESP_OK) {
         ret = esp_extconn_fw_init(config);
@@ -28,13 +118,133 @@ esp_err_t esp_extconn_init(esp_extconn_config_t *config)
     }
 #endif
 #ifdef CONFIG_ESP_EXT_CONN_BT_ENABLE
-    /* BT will send packet immediately afetr initiation, so delay its initiation to wait chip on */
-    vTaskDelay(100);
+    /* BT will send packet immediately afetr initiation, so wait for the chip to report bootup */
     if (ret == ESP_OK) {
+        int64_t start_us = esp_timer_get_time();
+        if (esp_sip_wait_ready(EXT_CONN_BT_READY_WAIT_MS) != ESP_OK) {
+            ESP_LOGW(TAG, "no bootup event, start bt anyway");
+        }
+        ESP_LOGI(TAG, "wait bt ready %lld us", esp_timer_get_time() - start_us);
         ret = esp_extconn_trans_bt_init(config);
     }
 #endif
+    if (ret == ESP_OK) {
+        ret = esp_extconn_wdt_init();
+    }
 
+    esp_extconn_boot_mark(ESP_EXTCONN_BOOT_DONE);
+    extconn_log_timeline();
+    xEventGroupSetBits(s_init_event, ret == ESP_OK ? EXT_CONN_READY_BIT : EXT_CONN_FAIL_BIT);
     ESP_LOGI(TAG, "extconn init ret 0x%X", ret);
     return ret;
 }
+
+static void extconn_notify_link(bool up)
+{
+    esp_extconn_link_cb_t cb = s_link_cb;
+
+    if (cb) {
+        cb(up, s_link_cb_arg);
+    }
+}
+
+esp_err_t esp_extconn_recover(void)
+{
+    memset(&s_timeline, 0, sizeof(s_timeline));
+    s_timeline.recover = true;
+    esp_extconn_boot_mark(ESP_EXTCONN_BOOT_START);
+
+    /* Stop the senders first, then drop what they have queued for the dead target */
+    esp_sip_link_down();
+    extconn_notify_link(false);
+#ifdef CONFIG_ESP_EXT_CONN_WIFI_ENABLE
+    esp_extconn_trans_wifi_reset();
+#endif
+#ifdef CONFIG_ESP_EXT_CONN_BT_ENABLE
+    esp_extconn_trans_bt_reset();
+#endif
+
+    esp_err_t ret = esp_extconn_fw_recover();
+#ifdef CONFIG_ESP_EXT_CONN_BT_ENABLE
+    if (ret == ESP_OK) {
+        ret = esp_sip_wait_ready(EXT_CONN_BT_READY_WAIT_MS);
+    }
+#endif
+
+    esp_extconn_boot_mark(ESP_EXTCONN_BOOT_DONE);
+    extconn_log_timeline();
+    if (ret == ESP_OK) {
+        extconn_notify_link(true);
+    }
+    return ret;
+}
+
+esp_err_t esp_extconn_register_link_cb(esp_extconn_link_cb_t cb, void *arg)
+{
+    s_link_cb_arg = arg;
+    s_link_cb = cb;
+    return ESP_OK;
+}
+
+static void extconn_init_task(void *args)
+{
+    extconn_async_ctx_t *ctx = (extconn_async_ctx_t *)args;
+
+    esp_err_t ret = extconn_start(&ctx->config);
+    if (ctx->cb) {
+        ctx->cb(ret, ctx->arg);
+    }
+    free(ctx);
+    vTaskDelete(NULL);
+}
+
+esp_err_t esp_extconn_init(esp_extconn_config_t *config)
+{
+    esp_err_t ret = extconn_prepare();
+    if (ret == ESP_OK) {
+        ret = extconn_start(config);
+    }
+    return ret;
+}
+
+esp_err_t esp_extconn_init_async(esp_extconn_config_t *config, esp_extconn_init_cb_t cb, void *arg)
+{
+    ESP_RETURN_ON_FALSE(config != NULL, ESP_ERR_INVALID_ARG, TAG, "config NULL");
+
+    extconn_async_ctx_t *ctx = calloc(1, sizeof(extconn_async_ctx_t));
+    ESP_RETURN_ON_FALSE(ctx != NULL, ESP_ERR_NO_MEM, TAG, "No MEM");
+    ctx->config = *config;
+    ctx->cb = cb;
+    ctx->arg = arg;
+
+    esp_err_t ret = extconn_prepare();
+    if (ret == ESP_OK) {
+        ret = xTaskCreatePinnedToCore(extconn_init_task, "extconn_init",
+                                      EXT_CONN_INIT_TASK_STACK,
+                                      ctx,
+                                      EXT_CONN_INIT_TASK_PRIO,
+                                      NULL,
+                                      config->recv_task_core)
+              == pdTRUE ? ESP_OK : ESP_ERR_NO_MEM;
+        if (ret != ESP_OK) {
+            /* Nothing has touched the target yet, so the caller may try again */
+            xEventGroupClearBits(s_init_event, EXT_CONN_INIT_STARTED_BIT);
+        }
+    }
+    if (ret != ESP_OK) {
+        free(ctx);
+    }
+    return ret;
+}
+
+esp_err_t esp_extconn_wait_ready(uint32_t wait_ms)
+{
+    ESP_RETURN_ON_FALSE(s_init_event != NULL, ESP_ERR_INVALID_STATE, TAG, "init not started");
+
+    TickType_t ticks = (wait_ms == UINT32_MAX) ? portMAX_DELAY : pdMS_TO_TICKS(wait_ms);
+    EventBits_t bits = xEventGroupWaitBits(s_init_event, EXT_CONN_READY_BIT | EXT_CONN_FAIL_BIT, pdFALSE, pdFALSE, ticks);
+    if (bits & EXT_CONN_READY_BIT) {
+        return ESP_OK;
+    }
+    return (bits & EXT_CONN_FAIL_BIT) ? ESP_FAIL : ESP_ERR_TIMEOUT;
+}
@@ -15,6 +15,7 @@
 #include "ext_default.h"
 #include "ext_sdio_adapter.h"
 #include "esp_extconn.h"
+#include "esp_sip.h"
 #include "esp_dma_utils.h"
 #include "esp_heap_caps.h"
 
@@ -35,6 +36,7 @@ typedef struct {
     SemaphoreHandle_t tx_sem;
     QueueHandle_t     tx_que;
     TaskHandle_t      task_handle;
+    uint32_t          tx_seq;       /* Taken and reset under the SDIO lock */
 } bt_tx_ctx_t;
 
 static const char *TAG = "trans_bt";
@@ -54,7 +56,6 @@ void esp_extconn_trans_bt_send_unlock()
 static void bt_tx_task(void *arg)
 {
     int ret = 0;
-    uint32_t tx_seq = 0;
     sbp_hdr_t *hdr = NULL;
     tx_msg_t buf;
 
@@ -67,8 +68,15 @@ static void bt_tx_task(void *arg)
             continue;
         }
 
+        if (esp_sip_is_link_down()) {
+            /* Target is being recovered, drop the packet and keep the credit */
+            free(buf.data);
+            esp_extconn_trans_bt_send_unlock();
+            continue;
+        }
+
         if (buf.data && buf.len) {
-            hdr = heap_caps_malloc(sizeof(sbp_hdr_t) + buf.len, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+            hdr = esp_extconn_sdio_dma_alloc(sizeof(sbp_hdr_t) + buf.len, NULL);
             if (!hdr) {
                 ESP_LOGE(TAG, "malloc sbp_hdr_t failed");
                 free(buf.data);
@@ -77,12 +85,19 @@ static void bt_tx_task(void *arg)
             hdr->len = sizeof(sbp_hdr_t) + buf.len;
             hdr->type = 0;
             hdr->subtype = 0;
-            hdr->seq = tx_seq++;
             memcpy(hdr->data, buf.data, buf.len);
             esp_extconn_sdio_lock();
-            ret = esp_extconn_sdio_send_packet(EXT_CONN_BT_SDIO_FUNC, (void *)hdr, (size_t)(hdr->len));
+            /* Checked again under the lock, so no packet for the dead target takes a number past the reset */
+            if (esp_sip_is_link_down()) {
+                ret = ESP_ERR_INVALID_STATE;
+            } else {
+                hdr->seq = bt_tx->tx_seq++;
+                ret = esp_extconn_sdio_send_packet(EXT_CONN_BT_SDIO_FUNC, (void *)hdr, (size_t)(hdr->len));
+            }
             esp_extconn_sdio_unlock();
-            if (ret) {
+            if (ret == ESP_ERR_INVALID_STATE) {
+                esp_extconn_trans_bt_send_unlock();
+            } else if (ret) {
                 ESP_LOGE(TAG, "tx packet err! ret=%d", ret);
             }
 
@@ -112,9 +127,6 @@ static bool esp_extconn_bt_check_receive_available(void)
 
 static void bt_start_up(esp_extconn_config_t *config)
 {
-    bt_tx->tx_sem = xSemaphoreCreateCounting(1, 1);
-    bt_tx->tx_que = xQueueCreate(25, sizeof(tx_msg_t));
-
     xTaskCreatePinnedToCore(bt_tx_task, "bt_tx",
                             config->bt_task_stack,
                             NULL,
@@ -148,16 +160,64 @@ esp_err_t esp_extconn_bt_register_host_callback(const esp_bluedroid_hci_driver_c
     return ESP_OK;
 }
 
-esp_err_t esp_extconn_trans_bt_init(esp_extconn_config_t *config)
+esp_err_t esp_extconn_trans_bt_prepare(void)
 {
-    bt_tx = malloc(sizeof(bt_tx_ctx_t));
+    if (bt_tx) {
+        return ESP_OK;
+    }
+    bt_tx = calloc(1, sizeof(bt_tx_ctx_t));
+    if (!bt_tx) {
+        return ESP_ERR_NO_MEM;
+    }
+    bt_tx->tx_sem = xSemaphoreCreateCounting(1, 1);
+    bt_tx->tx_que = xQueueCreate(25, sizeof(tx_msg_t));
+    if (!bt_tx->tx_sem || !bt_tx->tx_que) {
+        /* Leave nothing half built behind, a later init allocates from scratch */
+        if (bt_tx->tx_sem) {
+            vSemaphoreDelete(bt_tx->tx_sem);
+        }
+        if (bt_tx->tx_que) {
+            vQueueDelete(bt_tx->tx_que);
+        }
+        free(bt_tx);
+        bt_tx = NULL;
+        return ESP_ERR_NO_MEM;
+    }
 
+    /* HCI packets sent before the send task starts wait in the queue */
     esp_bluedroid_hci_driver_operations_t operations = {
         .send = bt_send_data,
         .check_send_available = esp_extconn_bt_check_receive_available,
         .register_host_callback = esp_extconn_bt_register_host_callback,
     };
     esp_bluedroid_attach_hci_driver(&operations);
+    return ESP_OK;
+}
+
+void esp_extconn_trans_bt_reset(void)
+{
+    tx_msg_t msg;
+
+    if (!bt_tx) {
+        return;
+    }
+    while (xQueueReceive(bt_tx->tx_que, &msg, 0) == pdTRUE) {
+        free(msg.data);
+    }
+    /* The rebooted target expects the SBP sequence from 0 */
+    esp_extconn_sdio_lock();
+    bt_tx->tx_seq = 0;
+    esp_extconn_sdio_unlock();
+    /* The rebooted target starts with its receive buffer free */
+    esp_extconn_trans_bt_send_unlock();
+}
+
+esp_err_t esp_extconn_trans_bt_init(esp_extconn_config_t *config)
+{
+    esp_err_t ret = esp_extconn_trans_bt_prepare();
+    if (ret != ESP_OK) {
+        return ret;
+    }
 
     bt_start_up(config);
     return ESP_OK;
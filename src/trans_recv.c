@@ -4,15 +4,21 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include <string.h>
+
 #include "freertos/FreeRTOS.h"
 #include "freertos/event_groups.h"
 #include "freertos/portmacro.h"
 #include "freertos/projdefs.h"
+#include "freertos/queue.h"
 #include "freertos/semphr.h"
+#include "freertos/task.h"
 
 #include "esp_check.h"
 #include "esp_bit_defs.h"
 #include "esp_err.h"
+#include "esp_random.h"
+#include "esp_timer.h"
 #include "ext_sdio_adapter.h"
 #include "esp_sip.h"
 #include "esp_extconn.h"
@@ -23,50 +29,181 @@
 #include "esp_heap_caps.h"
 
 // TODO: 32K!!!
-#define RECV_BUF_LEN (32 * 1024)
-#define RECV_WAIT_MS (50)
+#define RECV_BUF_LEN   (32 * 1024)
+#define RECV_WAIT_MS   (50)
+#define RECV_RING_SLOTS CONFIG_ESP_EXT_CONN_RECV_RING_SLOTS
+#define RECV_POLL_US   CONFIG_ESP_EXT_CONN_RECV_POLL_US
+/* Gap between status reads while polling, the core is free for other tasks meanwhile */
+#define RECV_POLL_STEP_US (20)
+/* A header found by a scan must be this close to the expected sequence */
+#define RECV_SCAN_SEQ_WINDOW (16)
+/* A resync request with no answer after this long is sent again on the next loss */
+#define RECV_RESYNC_MS (100)
+/* Largest frame function 2 delivers, SBP header and HCI packet */
+#define BT_RECV_BUF_LEN (1034)
+/* Longest the receive task waits for the worker to free a slot, before serving BT again */
+#define RECV_SLOT_WAIT_MS (5)
+/* Worker config field, or its Kconfig default when unset */
+#define RECV_WORKER_FIELD(unset, val, def) (((unset) || (val) == ESP_EXTCONN_TASK_DEFAULT) ? (def) : (val))
+
+/* One burst read off the bus */
+typedef struct {
+    uint8_t *buf;
+    size_t len;
+} recv_slot_t;
 
 static char *TAG = "trans_recv";
-static uint8_t *recv_buf = NULL;
+static recv_slot_t recv_slots[RECV_RING_SLOTS];
+#ifdef CONFIG_ESP_EXT_CONN_BT_ENABLE
+/* BT has its own buffer, so HCI traffic never waits for a Wi-Fi slot to be parsed */
+static uint8_t *bt_recv_buf = NULL;
+#endif
+/* Slot indexes: free ones for the receive task, filled ones for the worker, in bus order */
+static QueueHandle_t recv_free_que = NULL;
+static QueueHandle_t recv_ready_que = NULL;
 static  SemaphoreHandle_t sdio_mutex = NULL;
+static esp_extconn_rx_stats_t recv_stats;
+/* When the resync request still unanswered was sent, 0 if none */
+static int64_t recv_resync_us = 0;
+/* Start of a frame the end of the last burst cut, in the slot it was read into */
+static struct {
+    uint8_t idx;
+    size_t off;
+    size_t len;
+} recv_carry;
 
 extern void sip_rx_process(uint8_t *buf, uint32_t len);
 
-/* Function 1 & 2 can not operate at the same time. The global lock is still needed */
+/*
+ * Function 1 & 2 can not operate at the same time. The global lock is still needed.
+ * Until the receive task exists the boot path is the only bus user, so there is no lock yet.
+ */
 void esp_extconn_sdio_lock(void)
 {
-    xSemaphoreTake(sdio_mutex, portMAX_DELAY);
+    if (sdio_mutex) {
+        xSemaphoreTake(sdio_mutex, portMAX_DELAY);
+    }
 }
 
 void esp_extconn_sdio_unlock(void)
 {
-    xSemaphoreGive(sdio_mutex);
+    if (sdio_mutex) {
+        xSemaphoreGive(sdio_mutex);
+    }
 }
 
-static esp_err_t handle_intr0(uint32_t intr, uint32_t wait_ms)
+static bool recv_slot_take(uint8_t *idx, uint32_t wait_ms)
 {
-    size_t rlen = 0;
-    esp_extconn_sdio_lock();
-    esp_extconn_sdio_get_packet(EXT_CONN_WIFI_SDIO_FUNC, recv_buf, RECV_BUF_LEN, &rlen, wait_ms);
-    esp_extconn_sdio_unlock();
-    ESP_RETURN_ON_FALSE(rlen >= sizeof(struct sip_hdr), ESP_FAIL, TAG, "recv error!");
+    return xQueueReceive(recv_free_que, idx, pdMS_TO_TICKS(wait_ms)) == pdTRUE;
+}
+
+static void recv_slot_give(uint8_t idx)
+{
+    xQueueSend(recv_free_que, &idx, portMAX_DELAY);
+}
+
+static bool recv_frame_ok(const struct sip_hdr *hdr, size_t rlen)
+{
+    return hdr->len >= sizeof(struct sip_hdr) && (hdr->len & 3) == 0 && hdr->len <= rlen;
+}
+
+/*
+ * After a malformed length, the next frame is taken to be the first word aligned header
+ * further on that is well formed and whose sequence closely follows. Returns its offset,
+ * or rlen if there is none.
+ */
+static size_t recv_find_frame(const uint8_t *buf, size_t rlen)
+{
+    uint32_t rxseq = esp_sip_get_rxseq();
+
+    for (size_t off = 4; off + sizeof(struct sip_hdr) <= rlen; off += 4) {
+        const struct sip_hdr *hdr = (const struct sip_hdr *)(buf + off);
+        uint8_t type = SIP_HDR_GET_TYPE(hdr->fc[0]);
+
+        if (type <= SIP_DATA_AMPDU && recv_frame_ok(hdr, rlen - off) && hdr->seq - rxseq < RECV_SCAN_SEQ_WINDOW) {
+            return off;
+        }
+    }
+    return rlen;
+}
+
+/*
+ * Frames were lost, tell the target with a sync flagged heartbeat request. Its answer
+ * completes the handshake, until then, or RECV_RESYNC_MS, no other request is sent.
+ */
+static void recv_resync(void)
+{
+    int64_t now = esp_timer_get_time();
+
+    if (recv_resync_us != 0 && now - recv_resync_us < RECV_RESYNC_MS * 1000) {
+        return;
+    }
+    if (esp_sip_send_heartbeat() == ESP_OK) {
+        recv_resync_us = now;
+        recv_stats.resync_reqs++;
+    }
+}
+
+/*
+ * Walk the frames of a burst and hand them to the stack. A sequence gap, or a sync flag
+ * from the target, realigns rxseq to the frame and carries on. A malformed length hides
+ * where the next frame starts, the burst is scanned for it. Lost frames, by a gap or a
+ * skipped part of the burst, send a resync request to the target once the burst is done.
+ */
+static void recv_parse(uint8_t *buf, size_t rlen)
+{
+    bool lost = false;
 
-    uint8_t *buf = recv_buf;
     while (rlen) {
         struct sip_hdr *hdr = (struct sip_hdr *)buf;
+        if (rlen < sizeof(struct sip_hdr)) {
+            recv_stats.bad_frames++;
+            ESP_LOGE(TAG, "short frame %d err!!!", rlen);
+            lost = true;
+            break;
+        }
         ESP_LOGV(TAG, "total len %d FC0 %d len %d recycled_credits %" PRIu32" seq %" PRIu32,
                  rlen, hdr->fc[0], hdr->len, hdr->u.recycled_credits, hdr->seq);
-        if (hdr->len <= 0 || (hdr->len & 3) != 0) {
-            ESP_LOGE(TAG, "hdrlen %d err!!!", hdr->len);
-            return ESP_FAIL;
+        if (!recv_frame_ok(hdr, rlen)) {
+            size_t skip = recv_find_frame(buf, rlen);
+
+            recv_stats.bad_frames++;
+            ESP_LOGE(TAG, "hdrlen %d err!!!, skip %d", hdr->len, skip);
+            lost = true;
+            rlen -= skip;
+            buf += skip;
+            continue;
+        }
+#ifdef CONFIG_ESP_EXT_CONN_RECV_SEQ_FAULT_INJECT
+        /* Lose a data frame as if it never came over the bus */
+        if (!SIP_HDR_IS_CTRL(hdr) && esp_random() % CONFIG_ESP_EXT_CONN_RECV_SEQ_FAULT_RATE == 0) {
+            ESP_LOGD(TAG, "drop seq %" PRIu32, hdr->seq);
+            rlen -= hdr->len;
+            buf += hdr->len;
+            continue;
         }
+#endif
         uint32_t rxseq = esp_sip_increase_rxseq();
-        if (hdr->seq != rxseq) {
-            ESP_LOGE(TAG, "seq err!!! %" PRIu32 "%" PRIu32, hdr->seq, rxseq);
-            return ESP_FAIL;
+        /* Control frames use fc[1] as the event ID, only data frames carry flags */
+        bool sync = !SIP_HDR_IS_CTRL(hdr) && SIP_HDR_IS_SYNC_PKT(hdr);
+        if (hdr->seq != rxseq || sync) {
+            if (sync) {
+                recv_stats.seq_syncs++;
+            } else {
+                recv_stats.seq_gaps++;
+                if ((int32_t)(hdr->seq - rxseq) > 0) {
+                    recv_stats.frames_lost += hdr->seq - rxseq;
+                }
+                ESP_LOGW(TAG, "seq err!!! %" PRIu32 " %" PRIu32 ", resync", hdr->seq, rxseq);
+                lost = true;
+            }
+            esp_sip_set_rxseq(hdr->seq + 1);
         }
         if (SIP_HDR_IS_CTRL(hdr)) {
             ESP_LOGV(TAG, "rx ctrl len %d, seq %" PRIu32, hdr->len, hdr->seq);
+            if (hdr->c_evtid == SIP_EVT_HB_ACK) {
+                recv_resync_us = 0;
+            }
             esp_sip_parse_events(buf);
         }
 #ifdef CONFIG_ESP_EXT_CONN_WIFI_ENABLE
@@ -82,16 +219,113 @@ static esp_err_t handle_intr0(uint32_t intr, uint32_t wait_ms)
             ESP_LOGE(TAG, "%s ERROR!!!", __func__);
         }
 
-        if (hdr->len < rlen) {
-            rlen -= hdr->len;
-        } else {
-            ESP_LOGV(TAG, "rxseq %ld, hdr->sep %ld", rxseq, hdr->seq);
+        rlen -= hdr->len;
+        buf += hdr->len;
+    }
+
+    if (lost) {
+        recv_resync();
+    }
+}
+
+/*
+ * Length of the whole frames at the start of a burst the buffer cut short. The cut frame
+ * leads the next burst. All of it when a length is malformed, recv_parse deals with that.
+ */
+static size_t recv_whole_frames(const uint8_t *buf, size_t rlen)
+{
+    size_t off = 0;
+
+    while (rlen - off >= sizeof(struct sip_hdr)) {
+        const struct sip_hdr *hdr = (const struct sip_hdr *)(buf + off);
+
+        if (hdr->len < sizeof(struct sip_hdr) || (hdr->len & 3) || hdr->len > RECV_BUF_LEN) {
+            return rlen;
+        }
+        if (hdr->len > rlen - off) {
             break;
         }
-        buf += hdr->len;
+        off += hdr->len;
     }
-    return ESP_OK;
+    return off;
+}
+
+/*
+ * Read a burst into a free slot and parse it, or queue it for the worker.
+ * ESP_ERR_NOT_FINISHED when more data waits than the slot holds, ESP_ERR_NO_MEM when no
+ * slot freed up in time. Either way the rest stays with the slave for the next call.
+ */
+static esp_err_t handle_intr0(uint32_t wait_ms)
+{
+    uint8_t idx = 0;
+    size_t rlen = 0;
+
+    /* Bounded, BT interrupts are only served between bursts */
+    if (!recv_slot_take(&idx, RECV_SLOT_WAIT_MS)) {
+        recv_stats.slot_waits++;
+        return ESP_ERR_NO_MEM;
+    }
+    recv_slot_t *slot = &recv_slots[idx];
+    size_t carry = recv_carry.len;
+
+    if (carry) {
+        memmove(slot->buf, recv_slots[recv_carry.idx].buf + recv_carry.off, carry);
+        recv_carry.len = 0;
+    }
+    esp_extconn_sdio_lock();
+    esp_err_t ret = esp_extconn_sdio_get_packet(EXT_CONN_WIFI_SDIO_FUNC, slot->buf + carry, RECV_BUF_LEN - carry,
+                                                &rlen, wait_ms);
+    esp_extconn_sdio_unlock();
+    if (ret != ESP_OK && ret != ESP_ERR_NOT_FINISHED) {
+        recv_slot_give(idx);
+        ESP_LOGE(TAG, "recv error 0x%x, %d carried bytes lost", ret, carry);
+        return ret;
+    }
+    rlen += carry;
+    if (rlen < sizeof(struct sip_hdr)) {
+        recv_slot_give(idx);
+        ESP_LOGE(TAG, "recv error!");
+        return ESP_FAIL;
+    }
+    esp_extconn_wdt_feed();
+    if (ret == ESP_ERR_NOT_FINISHED) {
+        size_t whole = recv_whole_frames(slot->buf, rlen);
+
+        recv_stats.split_bursts++;
+        if (whole > 0 && whole < rlen) {
+            recv_carry.idx = idx;
+            recv_carry.off = whole;
+            recv_carry.len = rlen - whole;
+            rlen = whole;
+        }
+    }
+
+    if (recv_ready_que == NULL) {
+        recv_parse(slot->buf, rlen);
+        recv_slot_give(idx);
+        return ret;
+    }
+    slot->len = rlen;
+    xQueueSend(recv_ready_que, &idx, portMAX_DELAY);
+    return ret;
+}
+
+#if RECV_RING_SLOTS > 1
+static void trans_recv_worker(void *args)
+{
+    ESP_LOGI(TAG, "TRANS RECV WORKER START");
+    while (true) {
+        uint8_t idx = 0;
+        if (xQueueReceive(recv_ready_que, &idx, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        recv_parse(recv_slots[idx].buf, recv_slots[idx].len);
+        recv_slot_give(idx);
+    }
+
+    vTaskDelete(NULL);
 }
+#endif
 
 #ifdef CONFIG_ESP_EXT_CONN_BT_ENABLE
 static esp_err_t handle_intr1(uint32_t intr, uint32_t wait_ms)
@@ -99,33 +333,28 @@ static esp_err_t handle_intr1(uint32_t intr, uint32_t wait_ms)
     esp_err_t ret = ESP_FAIL;
 
     if (intr & SLCHOST_SLC1_BT_RX_NEW_PACKET_INT_RAW) {
-        const size_t wanted = 1034;
         size_t rlen = 0;
 
+        /* Reads the length the slave reports, at most the buffer */
         esp_extconn_sdio_lock();
-        ret = esp_extconn_sdio_get_packet(EXT_CONN_BT_SDIO_FUNC, recv_buf, wanted, &rlen, wait_ms);
+        ret = esp_extconn_sdio_get_packet(EXT_CONN_BT_SDIO_FUNC, bt_recv_buf, BT_RECV_BUF_LEN, &rlen, wait_ms);
         esp_extconn_sdio_unlock();
         if (ret == ESP_OK) {
-            esp_extconn_trans_bt_recv(recv_buf, rlen);
+            esp_extconn_wdt_feed();
+            esp_extconn_trans_bt_recv(bt_recv_buf, rlen);
         }
     }
 
     if (intr & SLCHOST_SLC1_TOHOST_BIT0_INT_RAW) {
-        uint32_t config_w1 = 0;
+        uint8_t config_w1 = 0;
 
+        /* Already acknowledged together with intr_0 by trans_recv_task, only bit 0 matters */
         esp_extconn_sdio_lock();
-        ret = esp_extconn_sdio_clear_intr(0, SLCHOST_SLC1_TOHOST_BIT0_INT_CLR);
-        if (ret != ESP_OK) {
-            esp_extconn_sdio_unlock();
-            ESP_LOGE(TAG, "clear intr failed");
-        }
-
-        ret = esp_extconn_sdio_read_bytes(1, ESP_SDIO_CONFIG_W1, (uint8_t *)&config_w1, 4);
+        ret = esp_extconn_sdio_read_reg(ESP_SDIO_CONFIG_W1, &config_w1, sizeof(config_w1));
+        esp_extconn_sdio_unlock();
         if (ret != ESP_OK) {
-            esp_extconn_sdio_unlock();
-            ESP_LOGE(TAG, "read bytes failed");
+            ESP_LOGE(TAG, "read config_w1 failed");
         }
-        esp_extconn_sdio_unlock();
 
         if (config_w1 & 0x1) {
             esp_extconn_trans_bt_send_unlock();
@@ -136,34 +365,144 @@ static esp_err_t handle_intr1(uint32_t intr, uint32_t wait_ms)
 }
 #endif
 
+static void recv_latency_add(uint32_t *hist, int64_t us)
+{
+    int n = 0;
+
+    for (uint64_t v = us >> 4; v && n < ESP_EXTCONN_RX_LAT_BUCKETS - 1; v >>= 1) {
+        n++;
+    }
+    hist[n]++;
+}
+
+#if RECV_POLL_US > 0
+/*
+ * The packet interrupt is left set while polling, it is cleared on the way back to
+ * interrupt mode. Check nothing arrived just before the clear, it would raise no interrupt.
+ */
+static bool recv_poll_stop(void)
+{
+    esp_extconn_sdio_snapshot_t snap = { 0 };
+
+    esp_extconn_sdio_lock();
+    esp_err_t ret = esp_extconn_sdio_clear_intr(SLCHOST_SLC0_RX_NEW_PACKET_INT_CLR, 0);
+    if (ret == ESP_OK) {
+        ret = esp_extconn_sdio_read_snapshot(&snap);
+    }
+    esp_extconn_sdio_unlock();
+    return ret != ESP_OK || snap.rx_len[EXT_CONN_WIFI_SDIO_FUNC] > 0;
+}
+
+static void recv_poll_wake(void *arg)
+{
+    xTaskNotifyGive((TaskHandle_t)arg);
+}
+
+/* Sleep RECV_POLL_STEP_US on the timer, a tick when there is none */
+static void recv_poll_sleep(esp_timer_handle_t timer)
+{
+    if (timer == NULL || esp_timer_start_once(timer, RECV_POLL_STEP_US) != ESP_OK) {
+        vTaskDelay(1);
+        return;
+    }
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+}
+#endif
+
 static void trans_recv_task(void *args)
 {
+    bool polling = false;
+    /* Data was left with the slave, its interrupt is already cleared */
+    bool rx_backlog = false;
+#if RECV_POLL_US > 0
+    int64_t poll_end_us = 0;
+    esp_timer_handle_t poll_timer = NULL;
+    const esp_timer_create_args_t poll_timer_args = {
+        .callback = recv_poll_wake,
+        .arg = xTaskGetCurrentTaskHandle(),
+        .name = "recv_poll",
+    };
+
+    if (esp_timer_create(&poll_timer_args, &poll_timer) != ESP_OK) {
+        ESP_LOGW(TAG, "poll timer create failed, polling sleeps a tick");
+    }
+#endif
+
     ESP_LOGI(TAG, "TRANS RECV START");
     while (true) {
+        esp_extconn_sdio_snapshot_t snap;
         uint32_t intr_0 = 0;
         uint32_t intr_1 = 0;
+        uint32_t clr_0 = 0;
+        bool rx_ready = false;
+        esp_err_t ret = ESP_OK;
 
-        esp_err_t ret = esp_extconn_sdio_wait_int(portMAX_DELAY);
-        if (ret != ESP_OK) {
-            continue;
+        if (!polling && !rx_backlog) {
+            ret = esp_extconn_sdio_wait_int(portMAX_DELAY);
+            if (ret != ESP_OK) {
+                continue;
+            }
+            recv_stats.irq_wakeups++;
+        } else if (polling) {
+            recv_stats.polls++;
         }
+        int64_t wake_us = esp_timer_get_time();
 
         esp_extconn_sdio_lock();
-        ret = esp_extconn_sdio_get_intr(&intr_0, &intr_1);
+        ret = esp_extconn_sdio_read_snapshot(&snap);
         ESP_RETURN_ON_FALSE(ret == ESP_OK, esp_extconn_sdio_unlock(), TAG, "interrupt read failed");
-        if (intr_0 == 0 && intr_1 == 0) {
+        intr_0 = snap.intr_0;
+        intr_1 = snap.intr_1;
+        clr_0 = intr_0;
+        rx_ready = intr_0 & SLCHOST_SLC0_RX_NEW_PACKET_INT_RAW;
+        if (polling) {
+            /* The length tells if data is waiting, no need to clear the packet interrupt each time */
+            clr_0 &= ~SLCHOST_SLC0_RX_NEW_PACKET_INT_CLR;
+            rx_ready = snap.rx_len[EXT_CONN_WIFI_SDIO_FUNC] > 0;
+        }
+        rx_backlog = rx_backlog && snap.rx_len[EXT_CONN_WIFI_SDIO_FUNC] > 0;
+        rx_ready = rx_ready || rx_backlog;
+        if (!rx_ready && clr_0 == 0 && intr_1 == 0) {
             esp_extconn_sdio_unlock();
+#if RECV_POLL_US > 0
+            if (polling && wake_us >= poll_end_us) {
+                polling = recv_poll_stop();
+            } else if (polling) {
+                recv_poll_sleep(poll_timer);
+            }
+#endif
             continue;
         }
-        ret = esp_extconn_sdio_clear_intr(intr_0, 0);
+        ret = esp_extconn_sdio_clear_intr(clr_0, intr_1 & SLCHOST_SLC1_TOHOST_BIT0_INT_CLR);
         esp_extconn_sdio_unlock();
-        if (intr_0 & SLCHOST_SLC0_RX_NEW_PACKET_INT_RAW) {
-            handle_intr0(intr_0, RECV_WAIT_MS);
-        }
 
 #if CONFIG_ESP_EXT_CONN_BT_ENABLE
+        /* BT first, an HCI event is short and would otherwise wait behind a whole Wi-Fi burst */
         if ((intr_1 & SLCHOST_SLC1_BT_RX_NEW_PACKET_INT_RAW) || (intr_1 & SLCHOST_SLC1_TOHOST_BIT0_INT_RAW)) {
-            handle_intr1(intr_1, RECV_WAIT_MS);
+            if (handle_intr1(intr_1, RECV_WAIT_MS) == ESP_OK && (intr_1 & SLCHOST_SLC1_BT_RX_NEW_PACKET_INT_RAW)) {
+                recv_latency_add(recv_stats.bt_latency, esp_timer_get_time() - wake_us);
+            }
+        }
+#endif
+
+        ret = rx_ready ? handle_intr0(RECV_WAIT_MS) : ESP_FAIL;
+        rx_backlog = ret == ESP_ERR_NOT_FINISHED || ret == ESP_ERR_NO_MEM;
+        if (ret == ESP_OK || ret == ESP_ERR_NOT_FINISHED) {
+            if (polling) {
+                recv_stats.poll_hits++;
+            }
+            recv_latency_add(polling ? recv_stats.poll_latency : recv_stats.irq_latency,
+                             esp_timer_get_time() - wake_us);
+#if RECV_POLL_US > 0
+            /* Traffic is flowing, look for the next burst without waiting for an interrupt */
+            polling = true;
+            poll_end_us = esp_timer_get_time() + RECV_POLL_US;
+#endif
+        }
+#if RECV_POLL_US > 0
+        /* Other interrupt bits do not extend polling, one that never clears would keep it going */
+        if (polling && !rx_ready && wake_us >= poll_end_us) {
+            polling = recv_poll_stop();
         }
 #endif
     }
@@ -171,11 +510,45 @@ static void trans_recv_task(void *args)
     vTaskDelete(NULL);
 }
 
+esp_err_t esp_extconn_get_rx_stats(esp_extconn_rx_stats_t *stats)
+{
+    ESP_RETURN_ON_FALSE(stats != NULL, ESP_ERR_INVALID_ARG, TAG, "stats NULL");
+    *stats = recv_stats;
+    return ESP_OK;
+}
+
 esp_err_t esp_extconn_trans_recv_init(esp_extconn_config_t *config)
 {
     sdio_mutex = xSemaphoreCreateMutex();
-    recv_buf = heap_caps_malloc(RECV_BUF_LEN, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
-    ESP_RETURN_ON_FALSE(recv_buf, ESP_ERR_NO_MEM, TAG, "buffer malloc failed");
+    recv_free_que = xQueueCreate(RECV_RING_SLOTS, sizeof(uint8_t));
+    ESP_RETURN_ON_FALSE(recv_free_que, ESP_ERR_NO_MEM, TAG, "queue create failed");
+    for (uint8_t i = 0; i < RECV_RING_SLOTS; i++) {
+        recv_slots[i].buf = esp_extconn_sdio_dma_alloc(RECV_BUF_LEN, NULL);
+        ESP_RETURN_ON_FALSE(recv_slots[i].buf, ESP_ERR_NO_MEM, TAG, "buffer malloc failed");
+        recv_slot_give(i);
+    }
+#ifdef CONFIG_ESP_EXT_CONN_BT_ENABLE
+    bt_recv_buf = esp_extconn_sdio_dma_alloc(BT_RECV_BUF_LEN, NULL);
+    ESP_RETURN_ON_FALSE(bt_recv_buf, ESP_ERR_NO_MEM, TAG, "bt buffer malloc failed");
+#endif
+
+#if RECV_RING_SLOTS > 1
+    recv_ready_que = xQueueCreate(RECV_RING_SLOTS, sizeof(uint8_t));
+    ESP_RETURN_ON_FALSE(recv_ready_que, ESP_ERR_NO_MEM, TAG, "queue create failed");
+    /* A config that predates the worker fields leaves them 0, a 0 stack is never valid */
+    bool worker_unset = config->recv_worker_stack == 0;
+    uint32_t worker_stack = RECV_WORKER_FIELD(worker_unset, config->recv_worker_stack, ESP_EXT_CONN_RECV_WORKER_STACK);
+    uint32_t worker_prio = RECV_WORKER_FIELD(worker_unset, config->recv_worker_prio, ESP_EXT_CONN_RECV_WORKER_PRIO);
+    uint32_t worker_core = RECV_WORKER_FIELD(worker_unset, config->recv_worker_core, ESP_EXT_CONN_RECV_WORKER_CORE);
+    ESP_RETURN_ON_FALSE(worker_prio < configMAX_PRIORITIES, ESP_ERR_INVALID_ARG, TAG, "worker prio %" PRIu32, worker_prio);
+    ESP_RETURN_ON_FALSE(xTaskCreatePinnedToCore(trans_recv_worker, "trans_recv_wk",
+                                                worker_stack,
+                                                NULL,
+                                                worker_prio,
+                                                NULL,
+                                                worker_core) == pdTRUE,
+                        ESP_FAIL, TAG, "worker create failed");
+#endif
 
     esp_err_t ret = xTaskCreatePinnedToCore(trans_recv_task, "trans_recv",
                                             config->recv_task_stack,
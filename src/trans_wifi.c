@@ -12,6 +12,7 @@
 
 #include "esp_check.h"
 #include "esp_bit_defs.h"
+#include "esp_cpu.h"
 #include "esp_err.h"
 #include "esp_sip.h"
 #include "ext_default.h"
@@ -19,12 +20,14 @@
 #include "esp_dma_utils.h"
 #include "esp_heap_caps.h"
 #include "esp_extconn.h"
+#include "esp_timer.h"
 
 #include "ext_sdio_adapter.h"
 
 #define WIFI_NEED_SEND           (BIT0)
 #define WIFI_SEND_BUFFER_LEN     (2048)
 #define PP_TXCB_SCAN_PROBEREQ_ID (1)
+#define WIFI_TX_STATS_FRAMES     (1024)
 
 typedef struct {
     esf_buf_t *tx_head;
@@ -139,28 +142,105 @@ static void list_clear(void)
     xSemaphoreGive(wifi_tx->list_lock);
 }
 
+/* Hand a frame back to the stack as if it was sent */
+static void wifi_tx_done(esf_buf *eb)
+{
+    if (esp_wifi_is_tx_callback(eb)) {
+        net80211_en_txdq(eb);
+        esp_sip_txd_post();
+    } else {
+        esp_sip_recycle(eb);
+    }
+}
+
+/*
+ * Send a data frame as two fragments: the SIP header and the payload up to the next cache
+ * line, copied into send_buf, then the rest of the payload straight from the descriptor
+ * buffer, padded into the room the buffer has. At most the short first fragment
+ * goes through a bounce buffer, none when the frame starts on a cache line. A frame under
+ * a block is one command when copied, so it is not worth the extra one. Only ds_head is
+ * sent, as the copy path does. Returns the fragments to send, 0 if the frame is copied.
+ */
+static int wifi_tx_borrow(esf_buf *eb, uint8_t *send_buf, esp_extconn_sdio_frag_t *frags)
+{
+#ifdef CONFIG_ESP_EXT_CONN_WIFI_TX_ZERO_COPY
+    lldesc_t *ds = eb->ds_head;
+    const uint8_t *payload = (const uint8_t *)ds->buf;
+    size_t head = (EXT_CONN_SDIO_DMA_ALIGN - (uintptr_t)payload % EXT_CONN_SDIO_DMA_ALIGN) % EXT_CONN_SDIO_DMA_ALIGN;
+    uint16_t block_size = esp_extconn_sdio_get_block_size(EXT_CONN_WIFI_SDIO_FUNC);
+
+    if (ds->length < head + block_size) {
+        return 0;
+    }
+    size_t rest = ds->length - head;
+    /* Whole blocks when the buffer has room, like the copied frames, so the tail takes no command of its own */
+    if (head + roundup(rest, block_size) <= ds->size) {
+        rest = roundup(rest, block_size);
+    }
+    if (head + EXT_CONN_SDIO_DMA_ALIGN_UP(rest) > ds->size ||
+            !esp_extconn_sdio_dma_capable(payload + head, EXT_CONN_SDIO_DMA_ALIGN_UP(rest))) {
+        return 0;
+    }
+
+    memcpy(send_buf + SIP_CTRL_HDR_LEN, payload, head);
+    frags[0].length = SIP_CTRL_HDR_LEN + head;
+    frags[1].buf = payload + head;
+    frags[1].length = rest;
+    frags[1].size = ds->size - head;
+    return 2;
+#else
+    return 0;
+#endif
+}
+
+/* Per path cost of a data frame, framing and copy on the CPU vs. time on the bus */
+static void wifi_tx_stats_add(bool zero_copy, uint32_t prep_cycles, int64_t send_us)
+{
+    static struct {
+        uint32_t frames;
+        uint64_t prep_cycles;
+        int64_t send_us;
+    } stats[2];
+
+    stats[zero_copy].frames++;
+    stats[zero_copy].prep_cycles += prep_cycles;
+    stats[zero_copy].send_us += send_us;
+    if (stats[zero_copy].frames == WIFI_TX_STATS_FRAMES) {
+        ESP_LOGD(TAG, "%s: %" PRIu32 " cycles, %lld us per frame", zero_copy ? "zero copy" : "copy",
+                 (uint32_t)(stats[zero_copy].prep_cycles / WIFI_TX_STATS_FRAMES), stats[zero_copy].send_us / WIFI_TX_STATS_FRAMES);
+        memset(&stats[zero_copy], 0, sizeof(stats[zero_copy]));
+    }
+}
+
 static void wifi_send_task(void *args)
 {
     esp_err_t err = ESP_OK;
-    uint8_t *send_buf = heap_caps_malloc(WIFI_SEND_BUFFER_LEN, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    size_t actual_size = 0;
+    uint8_t *send_buf = esp_extconn_sdio_dma_alloc(WIFI_SEND_BUFFER_LEN, &actual_size);
     if (!send_buf) {
         ESP_LOGE(TAG, "malloc send_buf failed");
         vTaskDelete(NULL);
         return;
     }
-    size_t actual_size = heap_caps_get_allocated_size(send_buf);
 
     ESP_LOGI(TAG, "WiFi Send START");
 
     while (true) {
         list_wait_item();
+        /* Hold the frames while the target is recovered */
+        esp_sip_wait_ready(UINT32_MAX);
 
         esf_buf *eb = list_remove();
         if (eb == NULL) {
             continue;
         }
 
+        uint32_t start_cycles = esp_cpu_get_cycle_count();
         uint32_t send_len = 0;
+        esp_extconn_sdio_frag_t frags[2] = {
+            { .buf = send_buf, .size = actual_size },
+        };
+        int nfrags = 0;
         struct sip_hdr *shdr = (struct sip_hdr *)send_buf;
         memset(shdr, 0x0, SIP_CTRL_HDR_LEN);
 
@@ -187,23 +267,33 @@ static void wifi_send_task(void *args)
             shdr->d_enc_flag = TO_TX_DESC(eb)->crypto_type;
             shdr->d_hw_kid = TO_TX_DESC(eb)->kid;
 
-            memcpy((send_buf + SIP_CTRL_HDR_LEN), (uint8_t *)(eb->u_data_start), eb->ds_head->length);
+            nfrags = wifi_tx_borrow(eb, send_buf, frags);
+            if (nfrags) {
+                send_len = frags[0].length + frags[1].length;
+            } else if (send_len <= actual_size) {
+                memcpy((send_buf + SIP_CTRL_HDR_LEN), (uint8_t *)(eb->u_data_start), eb->ds_head->length);
+            }
         }
 
-        if (send_len > actual_size) {
-            ESP_LOGE(TAG, "wifi buffer overflow %" PRIu16 "-> %" PRIu32, actual_size, send_len);
-            abort();
+        if (nfrags == 0) {
+            if (send_len > actual_size) {
+                ESP_LOGE(TAG, "wifi buffer overflow %" PRIu16 "-> %" PRIu32, actual_size, send_len);
+                abort();
+            }
+            frags[0].length = send_len;
+            nfrags = 1;
         }
+        uint32_t prep_cycles = esp_cpu_get_cycle_count() - start_cycles;
 
-        while (1) {
+        uint32_t cnt = 0;
+        while (!esp_sip_is_link_down()) {
             uint32_t num = 0;
-            uint32_t cnt = 0;
 
             esp_extconn_sdio_lock();
             esp_extconn_sdio_get_buffer_size(&num);
             esp_extconn_sdio_unlock();
             cnt++;
-            if (num * 512 < send_len) {
+            if (num * EXT_CONN_SDIO_SLAVE_BUF_SIZE < send_len) {
                 if (cnt % 1000 == 0) {
                     ESP_LOGI(TAG, "now num %" PRIu32, num);
                 }
@@ -212,22 +302,28 @@ static void wifi_send_task(void *args)
                 break;
             }
         }
+        if (esp_sip_is_link_down()) {
+            /* Target went down while waiting for room, the frame is dropped */
+            wifi_tx_done(eb);
+            continue;
+        }
 
         if (shdr->c_cmdid != SIP_CMD_WRITE_MEMORY || shdr->c_cmdid != SIP_CMD_BOOTUP || shdr->c_cmdid != SIP_CMD_WRITE_REG || shdr->c_cmdid != SIP_CMD_LOOPBACK) {
             shdr->seq = esp_sip_increase_txseq();
         }
 
+        int64_t send_us = esp_timer_get_time();
         esp_extconn_sdio_lock();
-        err = esp_extconn_sdio_send_packet(EXT_CONN_WIFI_SDIO_FUNC, send_buf, send_len);
+        err = esp_extconn_sdio_send_frags(EXT_CONN_WIFI_SDIO_FUNC, frags, nfrags);
         esp_extconn_sdio_unlock();
-        ESP_RETURN_ON_FALSE(err == ESP_OK,, TAG, "WiFi send error");
-
-        if (esp_wifi_is_tx_callback(eb)) {
-            net80211_en_txdq(eb);
-            esp_sip_txd_post();
-        } else {
-            esp_sip_recycle(eb);
+        send_us = esp_timer_get_time() - send_us;
+        if (err != ESP_OK) {
+            /* Keep the task alive, the watchdog recovers the target if it is gone */
+            ESP_LOGE(TAG, "WiFi send error 0x%X", err);
         }
+        wifi_tx_stats_add(nfrags > 1, prep_cycles, send_us);
+
+        wifi_tx_done(eb);
     }
     vTaskDelete(NULL);
 }
@@ -292,33 +388,64 @@ int get_coex_status_cb(void)
     return EXT_CONN_FUNCTIONS_ENABLE;
 }
 
-esp_err_t esp_extconn_trans_wifi_init(esp_extconn_config_t *config)
+esp_err_t esp_extconn_trans_wifi_prepare(void)
 {
+    if (wifi_tx) {
+        return ESP_OK;
+    }
     wifi_tx = calloc(1, sizeof(wifi_tx_ctx_t));
     if (!wifi_tx) {
         return ESP_ERR_NO_MEM;
     }
     wifi_tx->list_lock = xSemaphoreCreateMutex();
-    if (!wifi_tx->list_lock) {
-        return ESP_ERR_NO_MEM;
-    }
     wifi_tx->list_event = xEventGroupCreate();
-    if (!wifi_tx->list_event) {
+    if (!wifi_tx->list_lock || !wifi_tx->list_event) {
+        /* Leave nothing half built behind, a later init allocates from scratch */
+        if (wifi_tx->list_lock) {
+            vSemaphoreDelete(wifi_tx->list_lock);
+        }
+        if (wifi_tx->list_event) {
+            vEventGroupDelete(wifi_tx->list_event);
+        }
+        free(wifi_tx);
+        wifi_tx = NULL;
         return ESP_ERR_NO_MEM;
     }
 
+    /* Frames queued before the send task starts go out once the target is ready */
     sip_register_tx_cmd_cb(wifi_send_cmd);
     sip_register_tx_data_cb(wifi_send_data);
     sip_register_get_coex_status_cb(get_coex_status_cb);
+    return ESP_OK;
+}
+
+void esp_extconn_trans_wifi_reset(void)
+{
+    esf_buf *eb = NULL;
+
+    if (!wifi_tx) {
+        return;
+    }
+    while ((eb = list_remove()) != NULL) {
+        wifi_tx_done(eb);
+    }
+}
+
+esp_err_t esp_extconn_trans_wifi_init(esp_extconn_config_t *config)
+{
+    esp_err_t ret = esp_extconn_trans_wifi_prepare();
+    if (ret != ESP_OK) {
+        return ret;
+    }
 
-    esp_err_t ret = xTaskCreatePinnedToCore(wifi_send_task,
-                                            "wifi_send",
-                                            config->wifi_task_stack,
-                                            NULL,
-                                            config->wifi_task_prio,
-                                            NULL,
-                                            config->wifi_task_core)
-                    == pdTRUE ? ESP_OK : ESP_ERR_NO_MEM;
+    ret = xTaskCreatePinnedToCore(wifi_send_task,
+                                  "wifi_send",
+                                  config->wifi_task_stack,
+                                  NULL,
+                                  config->wifi_task_prio,
+                                  NULL,
+                                  config->wifi_task_core)
+          == pdTRUE ? ESP_OK : ESP_ERR_NO_MEM;
 
     return ret;
 }
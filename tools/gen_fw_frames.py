@@ -0,0 +1,310 @@
+#!/usr/bin/env python
+#
+# SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+#
+# SPDX-License-Identifier: Apache-2.0
+#
+# Convert the target firmware array in eagle_fw.h into either a stream of ready to
+# send SIP_CMD_WRITE_MEMORY frames, so the host only has to push them over the bus,
+# a compressed image which the host expands frame by frame during download, or a
+# raw binary to be flashed into the target firmware partition. Every output carries
+# the firmware hash a warm attach compares with the one the running target keeps.
+
+import argparse
+import re
+import struct
+import zlib
+
+FIRMWARE_MAGIC_HEADER = 0xE9
+ESP_FW_HDR_LEN = 8 + 16       # struct esp_fw_hdr + reserved
+ESP_FW_BLK_HDR_LEN = 8        # struct esp_fw_blk_hdr
+ESP_FW_HASH_OFFSET = 8        # first reserved word after struct esp_fw_hdr
+SIP_CTRL = 0
+SIP_CMD_WRITE_MEMORY = 1
+SIP_HDR_LEN = 12              # struct sip_hdr
+SIP_CMD_WRITE_MEMORY_LEN = 8  # struct sip_cmd_write_memory
+SIP_BOOT_BUF_SIZE = 256       # byte mode download frame size
+
+# Download time model of --report: 4-bit SDIO at 40 MHz, 10 us per SDMMC transaction,
+# QIO flash at 80 MHz, and an assumed LZ decode speed of the host CPU
+DL_BUS_BYTES_PER_US = 20.0
+DL_CMD_US = 10
+DL_PACE_US = 1000
+DL_BLOCK_SIZE = 512
+DL_FLASH_BYTES_PER_US = 40.0
+DL_DECODE_BYTES_PER_US = 50.0
+
+# LZSS parameters, keep in sync with ext_fw_lz.h
+LZ_MIN_MATCH = 3
+LZ_MAX_MATCH = LZ_MIN_MATCH + 0xf
+LZ_MAX_DIST = 0x1000
+LZ_STORED = 0x8000
+# hash chain search depth and lazy matching per compression level
+LZ_LEVELS = {1: (1, False), 2: (16, False), 3: (256, True)}
+
+
+def roundup(x, y):
+    return (x + y - 1) // y * y
+
+
+def load_fw(path):
+    with open(path, 'r') as f:
+        text = f.read()
+    body = text[text.index('{') + 1:text.index('}')]
+    return bytes(int(b, 16) for b in re.findall(r'0x([0-9a-fA-F]{2})', body))
+
+
+def fw_hash(fw):
+    """CRC32 of the image with the hash word cleared, never 0 which means no hash"""
+    image = fw[:ESP_FW_HASH_OFFSET] + bytes(4) + fw[ESP_FW_HASH_OFFSET + 4:]
+    return zlib.crc32(image) or 1
+
+
+def build_bin(fw):
+    """Raw image with its hash in the header, the download skips the reserved words"""
+    return fw[:ESP_FW_HASH_OFFSET] + struct.pack('<I', fw_hash(fw)) + fw[ESP_FW_HASH_OFFSET + 4:]
+
+
+def fw_chunks(fw, frame_size):
+    magic, blocks, entry_addr = fw[0], fw[1], struct.unpack_from('<I', fw, 4)[0]
+    if magic != FIRMWARE_MAGIC_HEADER:
+        raise SystemExit('Wrong magic num 0x%02x' % magic)
+
+    hdrs = SIP_HDR_LEN + SIP_CMD_WRITE_MEMORY_LEN
+    offset = ESP_FW_HDR_LEN
+    chunks = []
+
+    for _ in range(blocks):
+        load_addr, data_len = struct.unpack_from('<II', fw, offset)
+        offset += ESP_FW_BLK_HDR_LEN
+        data = fw[offset:offset + data_len]
+        offset += data_len
+
+        pos = 0
+        while pos < data_len:
+            remains = data_len - pos
+            if remains < frame_size - hdrs:
+                bufsize = roundup(remains, 4)
+            else:
+                bufsize = frame_size - hdrs
+            chunks.append((load_addr + pos, data[pos:pos + bufsize].ljust(bufsize, b'\0')))
+            pos += bufsize
+
+    return entry_addr, chunks
+
+
+def build_frames(fw, frame_size):
+    entry_addr, chunks = fw_chunks(fw, frame_size)
+    hdrs = SIP_HDR_LEN + SIP_CMD_WRITE_MEMORY_LEN
+    frames = bytearray()
+
+    for seq, (load_addr, chunk) in enumerate(chunks):
+        frame_len = hdrs + len(chunk)
+        frames += struct.pack('<BBHII', SIP_CTRL, 0, frame_len, SIP_CMD_WRITE_MEMORY, seq)
+        frames += struct.pack('<II', load_addr, len(chunk))
+        frames += chunk
+        frames += b'\0' * (roundup(frame_len, 4) - frame_len)
+
+    return entry_addr, len(chunks), bytes(frames)
+
+
+def lz_compress(data, level):
+    """LZSS limited to matches inside the chunk, so each chunk decodes on its own"""
+    depth, lazy = LZ_LEVELS[level]
+    head = {}
+    prev = [-1] * len(data)
+    out = bytearray()
+    tokens = []
+
+    def insert(i):
+        if i + LZ_MIN_MATCH <= len(data):
+            key = data[i:i + LZ_MIN_MATCH]
+            prev[i] = head.get(key, -1)
+            head[key] = i
+
+    def find(i):
+        best_len, best_dist = 0, 0
+        if i + LZ_MIN_MATCH > len(data):
+            return best_len, best_dist
+        cand = head.get(data[i:i + LZ_MIN_MATCH], -1)
+        limit = min(LZ_MAX_MATCH, len(data) - i)
+        n = 0
+        while cand >= 0 and i - cand <= LZ_MAX_DIST and n < depth:
+            length = 0
+            while length < limit and data[cand + length] == data[i + length]:
+                length += 1
+            if length > best_len:
+                best_len, best_dist = length, i - cand
+                if length == limit:
+                    break
+            cand = prev[cand]
+            n += 1
+        return best_len, best_dist
+
+    i = 0
+    while i < len(data):
+        length, dist = find(i)
+        if length >= LZ_MIN_MATCH and lazy:
+            insert(i)
+            next_len, _ = find(i + 1)
+            if next_len > length:
+                tokens.append(data[i])
+                i += 1
+                continue
+            for j in range(i + 1, i + length):
+                insert(j)
+        elif length >= LZ_MIN_MATCH:
+            for j in range(i, i + length):
+                insert(j)
+        if length >= LZ_MIN_MATCH:
+            tokens.append((dist, length))
+            i += length
+        else:
+            insert(i)
+            tokens.append(data[i])
+            i += 1
+
+    for k in range(0, len(tokens), 8):
+        group = tokens[k:k + 8]
+        flags = 0
+        body = bytearray()
+        for bit, tok in enumerate(group):
+            if isinstance(tok, int):
+                flags |= 1 << bit
+                body.append(tok)
+            else:
+                dist, length = tok
+                body += struct.pack('<H', ((length - LZ_MIN_MATCH) << 12) | (dist - 1))
+        out.append(flags)
+        out += body
+
+    return bytes(out)
+
+
+def build_lz(fw, frame_size, level):
+    entry_addr, chunks = fw_chunks(fw, frame_size)
+    image = bytearray()
+
+    for load_addr, chunk in chunks:
+        comp = lz_compress(chunk, level) if level else b''
+        if level and len(comp) < len(chunk):
+            image += struct.pack('<IHH', load_addr, len(chunk), len(comp))
+            image += comp
+        else:
+            image += struct.pack('<IHH', load_addr, len(chunk), len(chunk) | LZ_STORED)
+            image += chunk
+
+    return entry_addr, len(chunks), bytes(image)
+
+
+def write_array(f, name, data):
+    f.write('static const uint8_t %s[%d] __attribute__((aligned(4))) = {\n' % (name, len(data)))
+    for i in range(0, len(data), 16):
+        f.write('\t' + ', '.join('0x%02x' % b for b in data[i:i + 16]) + ',\n')
+    f.write('};\n')
+
+
+def write_header(path, entry_addr, num, frames, frame_size, hash):
+    with open(path, 'w') as f:
+        f.write('/*\n * Generated by gen_fw_frames.py, do not edit.\n */\n\n')
+        f.write('#pragma once\n\n#include <stdint.h>\n\n')
+        f.write('#define EAGLE_FW_FRAMES_ENTRY_ADDR (0x%08xU)\n' % entry_addr)
+        f.write('#define EAGLE_FW_FRAMES_NUM        (%d)\n' % num)
+        f.write('#define EAGLE_FW_FRAMES_SIZE       (%d)\n' % frame_size)
+        f.write('#define EAGLE_FW_FRAMES_HASH       (0x%08xU)\n\n' % hash)
+        write_array(f, 'eagle_fw_frames', frames)
+
+
+def write_lz_header(path, entry_addr, num, image, frame_size, level, hash):
+    with open(path, 'w') as f:
+        f.write('/*\n * Generated by gen_fw_frames.py, do not edit.\n */\n\n')
+        f.write('#pragma once\n\n#include <stdint.h>\n\n')
+        f.write('#define EAGLE_FW_LZ_ENTRY_ADDR (0x%08xU)\n' % entry_addr)
+        f.write('#define EAGLE_FW_LZ_NUM        (%d)\n' % num)
+        f.write('#define EAGLE_FW_LZ_SIZE       (%d)\n' % frame_size)
+        f.write('#define EAGLE_FW_LZ_LEVEL      (%d)\n' % level)
+        f.write('#define EAGLE_FW_LZ_HASH       (0x%08xU)\n\n' % hash)
+        write_array(f, 'eagle_fw_lz', image)
+
+
+def write_hash_header(path, hash):
+    with open(path, 'w') as f:
+        f.write('/*\n * Generated by gen_fw_frames.py, do not edit.\n */\n\n')
+        f.write('#pragma once\n\n')
+        f.write('#define EAGLE_FW_HASH (0x%08xU)\n' % hash)
+
+
+def frame_bus_us(frame_len, frame_size):
+    """Bus time of one download frame, as esp_sip_send_dl_frame sends it"""
+    if frame_size <= SIP_BOOT_BUF_SIZE:
+        # byte mode, paced by a 1 ms delay before every frame
+        return DL_PACE_US + DL_CMD_US + roundup(frame_len, 4) / DL_BUS_BYTES_PER_US
+    # block mode, a buffer count read then the frame in whole blocks
+    return 2 * DL_CMD_US + (4 + roundup(frame_len, DL_BLOCK_SIZE)) / DL_BUS_BYTES_PER_US
+
+
+def report(fw, frame_size):
+    """Image size and estimated download time per level, with the host work pipelined against the bus"""
+    hdrs = SIP_HDR_LEN + SIP_CMD_WRITE_MEMORY_LEN
+    raw = fw_chunks(fw, frame_size)[1]
+    raw_len = sum(len(c) for _, c in raw)
+    bus_us = sum(frame_bus_us(hdrs + len(c), frame_size) for _, c in raw)
+
+    def row(level, size, host_us, total_us):
+        print('%-8s %10d %7.1f%% %8.1f %8.1f %8.1f' % (level, size, size * 100.0 / raw_len,
+                                                        host_us / 1000, bus_us / 1000, total_us / 1000))
+
+    print('%d byte frames, %s mode' % (frame_size, 'byte' if frame_size <= SIP_BOOT_BUF_SIZE else 'block'))
+    print('%-8s %10s %8s %8s %8s %8s' % ('level', 'bytes', 'ratio', 'host ms', 'bus ms', 'total ms'))
+    host = [len(c) / DL_FLASH_BYTES_PER_US for _, c in raw]
+    row('raw', raw_len, sum(host), sum(max(h, frame_bus_us(hdrs + len(c), frame_size)) for h, (_, c) in zip(host, raw)))
+    for level in sorted(LZ_LEVELS):
+        image = build_lz(fw, frame_size, level)[2]
+        host = []
+        offset = 0
+        for _, chunk in raw:
+            comp_len = struct.unpack_from('<IHH', image, offset)[2]
+            offset += 8 + (comp_len & ~LZ_STORED)
+            us = (comp_len & ~LZ_STORED) / DL_FLASH_BYTES_PER_US
+            if not comp_len & LZ_STORED:
+                us += len(chunk) / DL_DECODE_BYTES_PER_US
+            host.append(us)
+        total = sum(max(h, frame_bus_us(hdrs + len(c), frame_size)) for h, (_, c) in zip(host, raw))
+        row(level, len(image), sum(host), total)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Generate pre-framed or compressed target firmware')
+    parser.add_argument('--frame-size', type=int, default=256, help='max frame size including SIP headers')
+    parser.add_argument('--lz', type=int, choices=sorted(LZ_LEVELS), help='generate compressed image with this level')
+    parser.add_argument('--bin', action='store_true', help='generate raw binary image for a data partition')
+    parser.add_argument('--hash', action='store_true', help='generate only the firmware hash, for the raw image')
+    parser.add_argument('--report', action='store_true', help='print image size and download time of every compression level')
+    parser.add_argument('input', help='eagle_fw.h')
+    parser.add_argument('output', nargs='?', help='generated header')
+    args = parser.parse_args()
+
+    if args.frame_size % 4:
+        raise SystemExit('frame size must be 4 bytes aligned')
+
+    fw = load_fw(args.input)
+    if args.report:
+        report(fw, args.frame_size)
+    if args.output is None:
+        return
+
+    if args.bin:
+        with open(args.output, 'wb') as f:
+            f.write(build_bin(fw))
+    elif args.hash:
+        write_hash_header(args.output, fw_hash(fw))
+    elif args.lz:
+        entry_addr, num, image = build_lz(fw, args.frame_size, args.lz)
+        write_lz_header(args.output, entry_addr, num, image, args.frame_size, args.lz, fw_hash(fw))
+    else:
+        entry_addr, num, frames = build_frames(fw, args.frame_size)
+        write_header(args.output, entry_addr, num, frames, args.frame_size, fw_hash(fw))
+
+
+if __name__ == '__main__':
+    main()